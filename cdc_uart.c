@@ -25,32 +25,60 @@
 
 #include "dirtyJtagConfig.h"
 
-#if ( CDC_UART_INTF_COUNT > 0 )
+#if ( CDC_INTF_COUNT > 0 )
 
 #include <pico/stdlib.h>
 #include <hardware/dma.h>
-#include <hardware/irq.h>
+#include <hardware/pio.h>
+#include <hardware/clocks.h>
+#include "uart.pio.h"
 #include "led.h"
 #include "tusb.h"
 #include "cdc_uart.h"
+#include "stats.h"
+
+/*
+ * Both directions run without interrupts. The DMA channels wrap their
+ * addresses in rings aligned to their size: RX writes into its ring for as
+ * long as its transfer count lasts, TX reads any stretch of its ring in one
+ * transfer, across the end. cdc_uart_task() only moves the read and write
+ * offsets and restarts TX when it is idle.
+ */
+
+// RX transfer count, hours of reception at the highest baud rates. cdc_uart_task() starts it
+// again should it ever run out.
+#define RX_DMA_COUNT 0xFFFFFFFF
+
+// The PIO UARTs take two state machines each of pio1, after those of chains 2 and 3
+#define PIO_UART_PIO pio1
+#define PIO_UART_FIRST_SM (JTAG_CHAIN_COUNT > 2 ? 2 * (JTAG_CHAIN_COUNT - 2) : 0)
+
+static uint8_t tx_bufs[CDC_INTF_COUNT][TX_BUFFER_SIZE] __attribute__((aligned(TX_BUFFER_SIZE)));
+static uint8_t rx_bufs[CDC_INTF_COUNT][RX_BUFFER_SIZE] __attribute__((aligned(RX_BUFFER_SIZE)));
 
 static struct uart_device
 {
-	uart_inst_t *inst;
-	volatile uint8_t tx_buf[TX_BUFFER_SIZE];
-	volatile uint8_t rx_buf[RX_BUFFER_SIZE];
+	uart_inst_t *inst;      // NULL for a PIO UART
+	PIO pio;
+	uint sm_tx;
+	uint sm_rx;
+	uint baud;              // in use
+	uint32_t clk_sys_hz;    // its clock dividers were computed for
+	uint8_t *tx_buf;
+	uint8_t *rx_buf;
 	uint rx_dma_channel;
 	uint tx_dma_channel;
-	volatile uint8_t *tx_write_address;
-	uint8_t *rx_read_address;
-	uint n_checks;
+	uint32_t tx_head;       // bytes ever queued from USB, masked to index tx_buf
+	uint32_t tx_tail;       // bytes ever sent
+	uint32_t tx_sending;    // length of the transfer under way, from tx_tail
+	uint32_t rx_read;       // offset in rx_buf of the next byte for USB
+	uint32_t rx_last_write; // offset the DMA writes to, when last seen
+	uint32_t rx_changed_us; // when it last moved
+	uint32_t rx_idle_us;    // idle time after which a partial packet goes out
+	bool rx_unflushed;      // bytes may wait in the CDC FIFO for a full packet
 	uint is_connected;
 	bool cdc_stopped;
-} uart_devices[2];
-
-static void dma_handler();
-
-static void set_tx_dma(volatile uint8_t *l_tx_write_address, struct uart_device *uart);
+} uart_devices[CDC_INTF_COUNT];
 
 static uint n_bits(uint n)
 {
@@ -64,23 +92,27 @@ static uint n_bits(uint n)
 	return i+1;
 }
 
-uint setup_usart_tx_dma(uart_inst_t *uart, volatile uint8_t *tx_address, uint buffer_size)
+static void set_rx_idle(struct uart_device *uart, uint baud, uint char_bits)
+{
+	uart->rx_idle_us = cdc_uart_idle_us(baud, char_bits);
+}
+
+static uint setup_tx_dma(volatile void *tx_fifo, uint dreq, volatile uint8_t *tx_address, uint buffer_size)
 {
 	uint dma_chan = dma_claim_unused_channel(true);
-	// Tell the DMA to raise IRQ line 1 when the channel finishes a block
-	dma_channel_set_irq1_enabled(dma_chan, true);
-	// enable DMA TX
-	hw_write_masked(&uart_get_hw(uart)->dmacr, 1 << UART_UARTDMACR_TXDMAE_LSB, UART_UARTDMACR_TXDMAE_BITS);
 
+	assert(((uintptr_t)tx_address & (buffer_size - 1)) == 0);
 	dma_channel_config c = dma_channel_get_default_config(dma_chan);
 	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
 	channel_config_set_read_increment(&c, true);
 	channel_config_set_write_increment(&c, false);
-	channel_config_set_dreq(&c, uart_get_dreq(uart, true));
+	// the read address wraps in the buffer
+	channel_config_set_ring(&c, false, n_bits(buffer_size) - 1);
+	channel_config_set_dreq(&c, dreq);
 	dma_channel_configure(
 		dma_chan,
 		&c,
-		&uart_get_hw(uart)->dr, // Write Ad
+		tx_fifo,                // Write Ad
 		tx_address,             // Read Address
 		0,                      // transfer count
 		false                   // start
@@ -88,162 +120,222 @@ uint setup_usart_tx_dma(uart_inst_t *uart, volatile uint8_t *tx_address, uint bu
 	return dma_chan;
 }
 
-uint setup_usart_rx_dma(uart_inst_t *uart, volatile void *rx_address, irq_handler_t handler, uint buffer_size)
+static uint setup_rx_dma(const volatile void *rx_fifo, uint dreq, volatile void *rx_address, uint buffer_size)
 {
 	uint dma_chan = dma_claim_unused_channel(true);
-	// Tell the DMA to raise IRQ line 1 when the channel finishes a block
-	dma_channel_set_irq1_enabled(dma_chan, true);
-
-	// Configure the processor to run dma_handler() when DMA IRQ 1 is asserted
-	irq_add_shared_handler(DMA_IRQ_1, handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
-	irq_set_enabled(DMA_IRQ_1, true);
-	// enable DMA RX
-	hw_write_masked(&uart_get_hw(uart)->dmacr, 1 << UART_UARTDMACR_RXDMAE_LSB, UART_UARTDMACR_RXDMAE_BITS);
 
+	assert(((uintptr_t)rx_address & (buffer_size - 1)) == 0);
 	dma_channel_config c = dma_channel_get_default_config(dma_chan);
 	channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
 	channel_config_set_read_increment(&c, false);
 	channel_config_set_write_increment(&c, true);
-	channel_config_set_dreq(&c, uart_get_dreq(uart, false));
-	hw_clear_bits(&uart_get_hw(uart)->rsr, UART_UARTRSR_BITS); // clear
+	// the write address wraps in the buffer
+	channel_config_set_ring(&c, true, n_bits(buffer_size) - 1);
+	channel_config_set_dreq(&c, dreq);
 	dma_channel_configure(
 		dma_chan,
 		&c,
 		rx_address,				// Write Address
-		&uart_get_hw(uart)->dr, // Read Address
-		buffer_size,			// transfer count
+		rx_fifo,				// Read Address
+		RX_DMA_COUNT,			// transfer count
 		true					// start
 	);
 	return dma_chan;
 }
 
-void cdc_uart_init( int index, uart_inst_t *const uart_, int uart_rx_pin, int uart_tx_pin )  {
-	uint uart_index;
-	uart_index = uart_get_index(uart_);
-    struct uart_device *uart;
-	uart = &uart_devices[index];
+uint setup_usart_tx_dma(uart_inst_t *uart, volatile uint8_t *tx_address, uint buffer_size)
+{
+	// enable DMA TX
+	hw_write_masked(&uart_get_hw(uart)->dmacr, 1 << UART_UARTDMACR_TXDMAE_LSB, UART_UARTDMACR_TXDMAE_BITS);
+	return setup_tx_dma(&uart_get_hw(uart)->dr, uart_get_dreq(uart, true), tx_address, buffer_size);
+}
 
-	gpio_set_function(uart_tx_pin, GPIO_FUNC_UART);
-	gpio_set_function(uart_rx_pin, GPIO_FUNC_UART);
-	gpio_set_pulls(uart_tx_pin, 1, 0);
-	gpio_set_pulls(uart_rx_pin, 1, 0);
+uint setup_usart_rx_dma(uart_inst_t *uart, volatile void *rx_address, uint buffer_size)
+{
+	// enable DMA RX
+	hw_write_masked(&uart_get_hw(uart)->dmacr, 1 << UART_UARTDMACR_RXDMAE_LSB, UART_UARTDMACR_RXDMAE_BITS);
+	hw_clear_bits(&uart_get_hw(uart)->rsr, UART_UARTRSR_BITS); // clear
+	return setup_rx_dma(&uart_get_hw(uart)->dr, uart_get_dreq(uart, false), rx_address, buffer_size);
+}
 
-	uart->inst = uart_;
-	uart_init(uart->inst, USBUSART_BAUDRATE);
-	uart_set_hw_flow(uart->inst, false, false);
-	uart_set_format(uart->inst, 8, 1, UART_PARITY_NONE);
-	uart_set_fifo_enabled(uart->inst, true);
-	uart->tx_dma_channel = setup_usart_tx_dma(uart->inst, &uart->tx_buf[0], TX_BUFFER_SIZE);
-	uart->rx_dma_channel = setup_usart_rx_dma(uart->inst, &uart->rx_buf[0], dma_handler, RX_BUFFER_SIZE);
-	uart->tx_write_address = &uart->tx_buf[0];
-	uart->rx_read_address = (uint8_t *)&uart->rx_buf[0];
-	uart->n_checks = 0;
+static void reset_rings(struct uart_device *uart)
+{
+	uart->tx_head = uart->tx_tail = uart->tx_sending = 0;
+	uart->rx_read = uart->rx_last_write = 0;
+	uart->rx_changed_us = time_us_32();
+	uart->rx_unflushed = false;
 	uart->cdc_stopped = false;
 }
 
-void set_tx_dma(volatile uint8_t *l_tx_write_address, struct uart_device *uart)
+// Takes and clears the receive overrun flag
+static bool rx_overrun(struct uart_device *uart)
 {
-	uint8_t *ra = (uint8_t *)(dma_channel_hw_addr(uart->tx_dma_channel)->read_addr);
-	if (ra >= (&uart->tx_buf[0] + TX_BUFFER_SIZE))
-	{
-		assert(ra == (&uart->tx_buf[0] + TX_BUFFER_SIZE));
-		dma_channel_set_read_addr(uart->tx_dma_channel, &uart->tx_buf[0], false);
-		ra = (uint8_t*)&uart->tx_buf[0];
-	}
-	if (ra != l_tx_write_address)
+	if (uart->inst)
 	{
-		size_t length = (l_tx_write_address >= ra) ? (l_tx_write_address - ra) : (TX_BUFFER_SIZE - (ra - &uart->tx_buf[0]));
-		dma_channel_set_trans_count(uart->tx_dma_channel, length, true);
+		if (!(uart_get_hw(uart->inst)->rsr & UART_UARTRSR_OE_BITS))
+			return false;
+		hw_clear_bits(&uart_get_hw(uart->inst)->rsr, UART_UARTRSR_OE_BITS);
+		return true;
 	}
+	// the RX state machine stalled on a full FIFO, bytes went by meanwhile
+	uint32_t stall = 1u << (PIO_FDEBUG_RXSTALL_LSB + uart->sm_rx);
+	if (!(uart->pio->fdebug & stall))
+		return false;
+	uart->pio->fdebug = stall;
+	return true;
+}
+
+#if ( PIO_UART_COUNT > 0 )
+static void pio_uart_set_baud(struct uart_device *uart, uint baud)
+{
+	float div = pio_uart_clkdiv(baud);
+	uart->baud = baud;
+	uart->clk_sys_hz = clock_get_hz(clk_sys);
+	pio_sm_set_clkdiv(uart->pio, uart->sm_tx, div);
+	pio_sm_set_clkdiv(uart->pio, uart->sm_rx, div);
+	set_rx_idle(uart, baud, 10);
 }
 
-// shared between rx_dma_channel and tx_dma_channel
-static void dma_handler()
+void cdc_pio_uart_init( int index, int uart_rx_pin, int uart_tx_pin )
 {
-	volatile uint32_t ints = dma_hw->ints1;
+	static int tx_offset = -1, rx_offset = -1;
 	struct uart_device *uart;
+	uart = &uart_devices[index];
 
-	for (size_t i = 0; i < CDC_UART_INTF_COUNT; i++)
+	// the two programs are shared by the PIO UARTs
+	if (tx_offset < 0)
 	{
-		uart = &uart_devices[i];
-		
-		if (dma_channel_get_irq1_status(uart->rx_dma_channel))
-		{
-			dma_channel_set_write_addr(uart->rx_dma_channel, &uart->rx_buf[0], true);
-		}
-		if (dma_channel_get_irq1_status(uart->tx_dma_channel))
-		{
-			// cdc_uart_task can modify uart->tx_write_address. cache it locally
-			volatile uint8_t *l_tx_write_address = uart->tx_write_address;
-            set_tx_dma(l_tx_write_address, uart);
-        }
+		tx_offset = pio_add_program(PIO_UART_PIO, &djtag_uart_tx_program);
+		rx_offset = pio_add_program(PIO_UART_PIO, &djtag_uart_rx_program);
 	}
-	
-	dma_hw->ints1 = ints;
+	uart->inst = NULL;
+	uart->pio = PIO_UART_PIO;
+	uart->sm_tx = PIO_UART_FIRST_SM + 2 * (index - CDC_UART_INTF_COUNT);
+	uart->sm_rx = uart->sm_tx + 1;
+	pio_sm_claim(uart->pio, uart->sm_tx);
+	pio_sm_claim(uart->pio, uart->sm_rx);
+	pio_uart_tx_init(uart->pio, uart->sm_tx, tx_offset, uart_tx_pin, USBUSART_BAUDRATE);
+	pio_uart_rx_init(uart->pio, uart->sm_rx, rx_offset, uart_rx_pin, USBUSART_BAUDRATE);
+	uart->tx_buf = tx_bufs[index];
+	uart->rx_buf = rx_bufs[index];
+	// a byte written to the TX FIFO goes to all four lanes, the RX byte is in the top lane
+	uart->tx_dma_channel = setup_tx_dma(&uart->pio->txf[uart->sm_tx], pio_get_dreq(uart->pio, uart->sm_tx, true),
+		uart->tx_buf, TX_BUFFER_SIZE);
+	uart->rx_dma_channel = setup_rx_dma((io_rw_8 *)&uart->pio->rxf[uart->sm_rx] + 3,
+		pio_get_dreq(uart->pio, uart->sm_rx, false), uart->rx_buf, RX_BUFFER_SIZE);
+	pio_uart_set_baud(uart, USBUSART_BAUDRATE);
+	reset_rings(uart);
 }
+#endif
 
+void cdc_uart_init( int index, uart_inst_t *const uart_, int uart_rx_pin, int uart_tx_pin )  {
+	struct uart_device *uart;
+	uart = &uart_devices[index];
 
+	gpio_set_function(uart_tx_pin, GPIO_FUNC_UART);
+	gpio_set_function(uart_rx_pin, GPIO_FUNC_UART);
+	gpio_set_pulls(uart_tx_pin, 1, 0);
+	gpio_set_pulls(uart_rx_pin, 1, 0);
+
+	uart->inst = uart_;
+	uart->baud = uart_init(uart->inst, USBUSART_BAUDRATE);
+	uart_set_hw_flow(uart->inst, false, false);
+	uart_set_format(uart->inst, 8, 1, UART_PARITY_NONE);
+	uart_set_fifo_enabled(uart->inst, true);
+	uart->tx_buf = tx_bufs[index];
+	uart->rx_buf = rx_bufs[index];
+	uart->tx_dma_channel = setup_usart_tx_dma(uart->inst, uart->tx_buf, TX_BUFFER_SIZE);
+	uart->rx_dma_channel = setup_usart_rx_dma(uart->inst, uart->rx_buf, RX_BUFFER_SIZE);
+	set_rx_idle(uart, uart->baud, 10);
+	reset_rings(uart);
+}
 
 void cdc_uart_task(void)
 {
 
 	struct uart_device *uart;
 
-	for (size_t i = 0; i < CDC_UART_INTF_COUNT; i++)
+	for (size_t i = 0; i < CDC_INTF_COUNT; i++)
 	{
 		uart = &uart_devices[i];
+#if ( PIO_UART_COUNT > 0 )
+		// CMD_FREQ may have moved clk_sys, the PIO UARTs divide it
+		if (!uart->inst && clock_get_hz(clk_sys) != uart->clk_sys_hz)
+			pio_uart_set_baud(uart, uart->baud);
+#endif
 		if (uart->cdc_stopped)
-			return;
+			continue;
 		if (tud_cdc_n_connected(i))
 		{
 			uart->is_connected = 1;
-			int written = 0;
-			volatile uint8_t *wa = (uint8_t*)(dma_channel_hw_addr(uart->rx_dma_channel)->write_addr);
-			if (wa == &uart->rx_buf[RX_BUFFER_SIZE])
+			if (rx_overrun(uart))
+				stats.uart_overruns[i]++;
+			if (!dma_channel_is_busy(uart->rx_dma_channel))
 			{
-				wa = &uart->rx_buf[0];
+				dma_channel_set_trans_count(uart->rx_dma_channel, RX_DMA_COUNT, true);
 			}
-			uint32_t rx_used_space = (wa >= uart->rx_read_address) ? (wa - uart->rx_read_address) : (wa + RX_BUFFER_SIZE - uart->rx_read_address);
-			uart->n_checks++;
-			if ((rx_used_space >= FULL_SWO_PACKET) || ((rx_used_space != 0) && (uart->n_checks > 4)))
+			uint32_t now = time_us_32();
+			uint32_t wa = (uint8_t *)(dma_channel_hw_addr(uart->rx_dma_channel)->write_addr) - uart->rx_buf;
+			if (wa != uart->rx_last_write)
+			{
+				uart->rx_last_write = wa;
+				uart->rx_changed_us = now;
+			}
+			uint32_t rx_used_space = (wa - uart->rx_read) & (RX_BUFFER_SIZE - 1);
+			bool idle = (now - uart->rx_changed_us) >= uart->rx_idle_us;
+			if ((rx_used_space >= FULL_SWO_PACKET) || ((rx_used_space != 0) && idle))
 			{
 				led_tx(1);
-				uart->n_checks = 0;
 				uint32_t capacity = tud_cdc_n_write_available(i);
 				uint32_t size_out = MIN(rx_used_space, capacity);
 				if (capacity >= FULL_SWO_PACKET)
 				{
-					uint32_t written = tud_cdc_n_write(i, uart->rx_read_address, size_out);
-					if (rx_used_space < FULL_SWO_PACKET)
-						tud_cdc_n_write_flush(i);
+					// in two pieces when the data wraps around the end of the ring
+					uint32_t written = 0;
+					while (written < size_out)
+					{
+						uint32_t chunk = MIN(size_out - written, RX_BUFFER_SIZE - uart->rx_read);
+						uint32_t n = tud_cdc_n_write(i, &uart->rx_buf[uart->rx_read], chunk);
+						uart->rx_read = (uart->rx_read + n) & (RX_BUFFER_SIZE - 1);
+						written += n;
+						if (n < chunk)
+							break;
+					}
+					stats.uart_rx_bytes[i] += written;
+					uart->rx_unflushed = true;
 					tud_task();
-					uart->rx_read_address += written;
-					if (uart->rx_read_address >= &uart->rx_buf[RX_BUFFER_SIZE])
-						uart->rx_read_address -= RX_BUFFER_SIZE;
 				}
 				led_tx(0);
 			}
+			// the end of a burst goes out once the line has been idle for a while
+			if (idle && uart->rx_unflushed)
+			{
+				tud_cdc_n_write_flush(i);
+				uart->rx_unflushed = false;
+			}
 			uint usb_available = tud_cdc_n_available(i);
-			uint8_t *ra = (uint8_t *)(dma_channel_hw_addr(uart->tx_dma_channel)->read_addr);
-			uint32_t tx_free_space = (uart->tx_write_address >= ra) ? (&uart->tx_buf[TX_BUFFER_SIZE] - uart->tx_write_address) : (ra - uart->tx_write_address);
+			uint32_t tx_offset = uart->tx_head & (TX_BUFFER_SIZE - 1);
+			uint32_t tx_free_space = MIN(TX_BUFFER_SIZE - (uart->tx_head - uart->tx_tail), TX_BUFFER_SIZE - tx_offset);
 			size_t watermark = MIN(usb_available, tx_free_space);
 			if (watermark > 0)
 			{
 				led_rx(1);
 				size_t tx_len;
-				tx_len = tud_cdc_n_read(i, (void*)uart->tx_write_address, watermark);
-				//be careful about modifying tx_write_address as it is used in the IRQ handler
-				volatile uint8_t *l_tx_write_address = uart->tx_write_address + tx_len;
-				if (l_tx_write_address >= &uart->tx_buf[TX_BUFFER_SIZE])
-					uart->tx_write_address = l_tx_write_address - TX_BUFFER_SIZE;
-				else
-					uart->tx_write_address = l_tx_write_address;
-				// restart dma if not active
-				if (!dma_channel_is_busy(uart->tx_dma_channel))
+				tx_len = tud_cdc_n_read(i, &uart->tx_buf[tx_offset], watermark);
+				stats.uart_tx_bytes[i] += tx_len;
+				uart->tx_head += tx_len;
+				led_rx(0);
+			}
+			// send what came in meanwhile once the transfer under way is done
+			if (!dma_channel_is_busy(uart->tx_dma_channel))
+			{
+				uart->tx_tail += uart->tx_sending;
+				uart->tx_sending = uart->tx_head - uart->tx_tail;
+				if (uart->tx_sending)
 				{
-					set_tx_dma(l_tx_write_address, uart);
+					dma_channel_set_read_addr(uart->tx_dma_channel, &uart->tx_buf[uart->tx_tail & (TX_BUFFER_SIZE - 1)], false);
+					dma_channel_set_trans_count(uart->tx_dma_channel, uart->tx_sending, true);
 				}
-				led_rx(0);
 			}
 		}
 		else if (uart->is_connected)
@@ -258,7 +350,7 @@ void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const* line_coding)
 {
 	struct uart_device *uart;
 
-	for (size_t i = 0; i < CDC_UART_INTF_COUNT; i++)
+	for (size_t i = 0; i < CDC_INTF_COUNT; i++)
 	{
 		uart = &uart_devices[i];
 		if (i == itf)
@@ -266,10 +358,20 @@ void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const* line_coding)
 			uart->cdc_stopped = true;
 			uart_parity_t parity;
 			uint data_bits, stop_bits;
-			uart_deinit(uart->inst);
 			tud_cdc_n_write_clear(itf);
 			tud_cdc_n_read_flush(itf);
-			uart_init(uart->inst, line_coding->bit_rate);
+#if ( PIO_UART_COUNT > 0 )
+			if (!uart->inst)
+			{
+				// the PIO UARTs only do 8N1, 0 keeps the previous rate
+				pio_uart_set_baud(uart, line_coding->bit_rate ? line_coding->bit_rate : uart->baud);
+				uart->cdc_stopped = false;
+				continue;
+			}
+#endif
+			uart_deinit(uart->inst);
+			// 0, which some hosts send, keeps the previous rate
+			uart->baud = uart_init(uart->inst, line_coding->bit_rate ? line_coding->bit_rate : uart->baud);
 			switch (line_coding->parity)
 			{
 			case CDC_LINE_CODING_PARITY_ODD:
@@ -316,6 +418,7 @@ void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const* line_coding)
 			}
 
 			uart_set_format(uart->inst, data_bits, stop_bits, parity);
+			set_rx_idle(uart, uart->baud, 1 + data_bits + (parity != UART_PARITY_NONE) + stop_bits);
 			uart->cdc_stopped = false;
 		}
 		}
@@ -323,7 +426,7 @@ void tud_cdc_line_coding_cb(uint8_t itf, cdc_line_coding_t const* line_coding)
 
 void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts)
 {
-	for (size_t i = 0; i < CDC_UART_INTF_COUNT; i++)
+	for (size_t i = 0; i < CDC_INTF_COUNT; i++)
 	{
 		struct uart_device *uart = &uart_devices[i];
 		if (i == itf)
@@ -338,4 +441,4 @@ void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts)
 	}
 }
 
-#endif // CDC_UART_INTF_COUNT
+#endif // CDC_INTF_COUNT
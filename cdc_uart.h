@@ -31,6 +31,8 @@
 #ifndef CDC_UART_H
 #define CDC_UART_H
 
+#include <stdint.h>
+
 #include "dirtyJtagConfig.h"
 
 #define USBUSART_BAUDRATE 115200
@@ -38,12 +40,31 @@
 /* For speed this is set to the USB transfer size */
 #define FULL_SWO_PACKET (64)
 
-#define TX_BUFFER_SIZE (4096) //needs to be a power of 2
+/* DMA rings, powers of 2 up to 32768 */
+#define TX_BUFFER_SIZE (4096)
 #define RX_BUFFER_SIZE (4096)
 
+/* Less than a full packet of RX goes to the host once the line has been idle for
+ * CDC_UART_IDLE_CHARS characters at the current baud rate, and no less than CDC_UART_IDLE_MIN_US */
+#define CDC_UART_IDLE_CHARS 2
+#define CDC_UART_IDLE_MIN_US 20
+
+/* That idle time for a baud rate and the bits of a character, the minimum for baud 0 */
+static inline uint32_t cdc_uart_idle_us(uint32_t baud, uint32_t char_bits)
+{
+	uint32_t us = baud ? CDC_UART_IDLE_CHARS * char_bits * 1000000u / baud : 0;
+	return us > CDC_UART_IDLE_MIN_US ? us : CDC_UART_IDLE_MIN_US;
+}
+
 #if (CDC_UART_INTF_COUNT > 0)
 /* index is the CDC interface number */
 void cdc_uart_init( int index, uart_inst_t *const uart, int uart_rx_pin, int uart_tx_pin );
+#endif
+#if (PIO_UART_COUNT > 0)
+/* index is the CDC interface number, CDC_UART_INTF_COUNT for the first PIO UART */
+void cdc_pio_uart_init( int index, int uart_rx_pin, int uart_tx_pin );
+#endif
+#if (CDC_INTF_COUNT > 0)
 void cdc_uart_task(void);
 #endif
 
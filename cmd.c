@@ -33,6 +33,13 @@
 #include "tusb.h"
 #include "pio_jtag.h"
 #include "cmd.h"
+#include "xsvf.h"
+#include "pack.h"
+#include "tck_tune.h"
+#include "settings.h"
+#include "stats.h"
+#include "trace.h"
+#include "dirtyJtagConfig.h"
 
 
 enum CommandIdentifier {
@@ -44,16 +51,49 @@ enum CommandIdentifier {
   CMD_GETSIG = 0x05,
   CMD_CLK = 0x06,
   CMD_SETVOLTAGE = 0x07,
-  CMD_GOTOBOOTLOADER = 0x08
+  CMD_GOTOBOOTLOADER = 0x08,
+  CMD_LONGXFER = 0x09,
+  CMD_VERIFY = 0x0A,
+  CMD_POLL = 0x0B,
+  CMD_MACRO = 0x0C,
+  CMD_XSVF = 0x0D,
+  CMD_CHAIN = 0x0E,
+  CMD_STATS = 0x0F
 };
 
 enum CommandModifier
 {
-  // CMD_XFER
+  // CMD_STOP
+  STREAM_MODE = 0x80,
+  PACKET_MODE = 0x40,
+  // CMD_XFER, CMD_LONGXFER, CMD_VERIFY, CMD_POLL (not NO_READ, EXTEND_LENGTH without CMD_LONGXFER)
   NO_READ = 0x80,
   EXTEND_LENGTH = 0x40,
+  LSB_FIRST = 0x20,
+  // CMD_LONGXFER
+  PACKED_TDO = 0x40,
+  PACKED_TDI = 0x10,
   // CMD_CLK
   READOUT = 0x80,
+  TMS_VECTOR = 0x40,
+  // CMD_FREQ
+  REAL_FREQ = 0x80,
+  AUTOTUNE = 0x40,
+  SAVE_FREQ = 0x20,
+  // CMD_MACRO, neither for a definition
+  MACRO_RUN = 0x80,
+  MACRO_HITS = 0x40,
+  // CMD_CHAIN
+  CHAIN_COUNT = 0x80,
+  // CMD_STATS
+  STATS_RESET = 0x80,
+  TRACE = 0x40,
+};
+
+enum TraceOperation {
+  TRACE_OFF = 0,
+  TRACE_ON = 1,
+  TRACE_DUMP = 2
 };
 
 enum SignalIdentifier {
@@ -74,27 +114,220 @@ enum SignalIdentifier {
  *
  * @param usbd_dev USB device
  */
-static uint32_t  cmd_info(uint8_t *buffer);
+static uint32_t  cmd_info(void);
 
 /**
  * @brief Handle CMD_FREQ command
  *
- * CMD_FREQ sets the clock frequency on the probe.
- * Currently this does not changes anything.
+ * CMD_FREQ sets the TCK frequency, in kHz, big endian. The probe picks the
+ * fastest TCK not above it it can make, with REAL_FREQ it answers that
+ * frequency in Hz, 4 bytes big endian. 0 kHz selects adaptive clocking when
+ * the probe has an RTCK pin (PIN_RTCK), the frequency answered is 0 then.
+ * With AUTOTUNE the frequency is the upper bound of a search for the fastest
+ * TCK the BYPASS registers of the chain shift without error (0 for no bound,
+ * see tck_tune()). It answers that TCK then the one set below it, in Hz, 4
+ * bytes big endian each, both 0 when the chain could not be tuned.
+ * With SAVE_FREQ the TCK set is also the one used from the next boot on.
  *
  * @param commands Command data
+ * @return Number of bytes answered
  */
-static void cmd_freq(pio_jtag_inst_t* jtag, const uint8_t *commands);
+static uint32_t cmd_freq(pio_jtag_inst_t* jtag, const uint8_t *commands);
 
 /**
  * @brief Handle CMD_XFER command
  *
  * CMD_XFER reads and writes data simultaneously.
+ * With LSB_FIRST, each byte is shifted from bit 0 to bit 7, as in SVF and
+ * bitstream files, and TDO comes back in the same order.
  *
  * @param usbd_dev USB device
  * @param commands Command data
  */
-static uint32_t cmd_xfer(pio_jtag_inst_t* jtag, const uint8_t *commands, bool extend_length, bool no_read, uint8_t* tx_buf);
+static uint32_t cmd_xfer(pio_jtag_inst_t* jtag, const uint8_t *commands, bool extend_length, bool no_read, bool lsb_first);
+
+/**
+ * @brief Handle CMD_VERIFY command
+ *
+ * CMD_VERIFY is CMD_XFER followed by the expected TDO and a mask, each as long
+ * as the TDI data: [cmd][length][TDI][expected][mask]. The TDO is compared on
+ * the probe, only the offset of the first bit that differs where the mask is
+ * set comes back, 2 bytes big endian, 0xFFFF when they all match.
+ *
+ * @param commands Command data
+ * @return Number of bytes written to the response
+ */
+static uint32_t cmd_verify(pio_jtag_inst_t* jtag, const uint8_t *commands, bool extend_length, bool lsb_first);
+
+/**
+ * @brief Handle CMD_POLL command
+ *
+ * CMD_POLL repeats a CMD_XFER until its TDO matches an expected value under
+ * a mask, such as a busy bit of a status register, or a limit is reached:
+ * [cmd][length][tries, 2 bytes][timeout in ms, 2 bytes][TDI][expected][mask],
+ * the limits big endian, 0 for none. It answers with the number of scans
+ * done, 2 bytes big endian and never more than 0xFFFF, followed by the TDO of
+ * the last one, which tells a match from a timeout. The TAP must be in
+ * Shift-DR and is left there. Between scans it goes through Exit1-DR,
+ * Update-DR and Capture-DR back to Shift-DR, so that each scan reads a new
+ * capture, the last TDI bit being shifted once more on the way out.
+ *
+ * @param commands Command data
+ * @return Number of bytes written to the response
+ */
+static uint32_t cmd_poll(pio_jtag_inst_t* jtag, const uint8_t *commands, bool extend_length, bool lsb_first);
+
+/**
+ * @brief Handle CMD_MACRO command
+ *
+ * A macro is a sequence of commands kept in RAM under an ID, to be run again
+ * with a 3 byte command, some of its bytes replaced each time:
+ * - [cmd][id][number of slots][body length, 2 bytes] defines it, followed in
+ *   the stream by its slots, [offset in body, 2 bytes][length] each, then the
+ *   body. It answers 1 byte, 1 when the macro is stored, 0 when it does not
+ *   fit or its body is not whole commands, CMD_STOP, CMD_MACRO, CMD_XSVF and CMD_CHAIN
+ *   excluded.
+ *   Lengths and offsets are big endian.
+ * - [cmd | MACRO_RUN][id][parameters length][parameters] copies the parameters
+ *   into the slots, in order, and runs the body. Nothing runs when the macro is
+ *   not defined or the length is not that of its slots, the parameters are
+ *   skipped all the same. A CMD_LONGXFER at its end may take its data from
+ *   the stream after the command.
+ * - [cmd | MACRO_HITS][id] answers the number of runs of the macro, 4 bytes
+ *   big endian.
+ *
+ * A definition only starts here, its data goes to cmd_macro_data() as it
+ * comes in.
+ *
+ * @param commands Command data
+ */
+static void cmd_macro(pio_jtag_inst_t* jtag, const uint8_t *commands);
+
+/**
+ * @brief Store the data of the macro being defined
+ *
+ * @param data Next bytes of the stream
+ * @param count Number of bytes available
+ * @return Number of bytes used, the rest belongs to the next commands
+ */
+static uint32_t cmd_macro_data(const uint8_t *data, uint32_t count);
+
+/**
+ * @brief Handle CMD_XSVF command
+ *
+ * CMD_XSVF plays an XSVF file on the probe, see xsvf.c: [cmd][length, 4 bytes
+ * big endian] followed in the stream by length bytes of XSVF. Once they are
+ * all there, it answers 5 bytes: the xsvf_status, then the index of the
+ * instruction it stopped at, counted from 0, 4 bytes big endian. This only
+ * starts the player, the data goes to cmd_xsvf_data() as it comes in.
+ *
+ * @param commands Command data
+ */
+static void cmd_xsvf(pio_jtag_inst_t* jtag, const uint8_t *commands);
+
+/**
+ * @brief Play the data of the current CMD_XSVF
+ *
+ * @param data Next bytes of the stream
+ * @param count Number of bytes available
+ * @return Number of bytes used, the rest belongs to the next commands
+ */
+static uint32_t cmd_xsvf_data(pio_jtag_inst_t* jtag, const uint8_t *data, uint32_t count);
+
+/**
+ * @brief Execute the whole commands of a buffer
+ *
+ * @param commands First command
+ * @param end End of the buffer
+ */
+static void cmd_run(pio_jtag_inst_t* jtag, const uint8_t *commands, const uint8_t *end);
+
+/**
+ * @brief Offset of the first bit of TDO differing from expected under mask
+ *
+ * @param length Number of bits shifted, the end of a partial last byte is ignored
+ * @param lsb_first Bit order of the bytes
+ * @return The bit offset, or 0xFFFF when they all match
+ */
+static uint32_t tdo_mismatch(const uint8_t *tdo, const uint8_t *expected, const uint8_t *mask, uint32_t length, bool lsb_first);
+
+/**
+ * @brief Handle CMD_LONGXFER command
+ *
+ * CMD_LONGXFER is CMD_XFER with a 32 bit length, big endian. Its data follows
+ * the 5 byte header in the stream, as long as it may be, and its TDO is
+ * streamed back in as many IN packets. This only starts the transfer, the data
+ * goes to cmd_longxfer_data() as it comes in.
+ *
+ * With PACKED_TDI, the data is packed as described in pack.h and unpacked
+ * here, the length still counting the bits shifted. With PACKED_TDO, the TDO
+ * is packed the same way before it goes out, it has then been read once it
+ * unpacks to the length.
+ *
+ * @param commands Command data
+ * @param no_read Do not return TDO
+ * @param lsb_first Shift each byte from bit 0
+ * @param packed_tdi The data is packed
+ * @param packed_tdo Pack the TDO
+ */
+static void cmd_longxfer(pio_jtag_inst_t* jtag, const uint8_t *commands, bool no_read, bool lsb_first, bool packed_tdi, bool packed_tdo);
+
+/**
+ * @brief Shift the data of the current CMD_LONGXFER
+ *
+ * @param data Next bytes of the stream
+ * @param count Number of bytes available
+ * @return Number of bytes used, the rest belongs to the next commands
+ */
+static uint32_t cmd_longxfer_data(pio_jtag_inst_t* jtag, const uint8_t *data, uint32_t count);
+
+/**
+ * @brief Shift the next bytes of TDI of the current CMD_LONGXFER
+ *
+ * @param data Bytes to shift, no more than remain
+ * @param count Number of bytes
+ */
+static void longxfer_shift(pio_jtag_inst_t* jtag, const uint8_t *data, uint32_t count);
+
+/**
+ * @brief Length of a command
+ *
+ * @param commands Command data
+ * @param available Bytes of it already received, at least 1
+ * @return Length of the command with its data, or more than available when
+ * the bytes needed to tell its length are still to come
+ */
+static uint32_t cmd_length(const uint8_t *commands, uint32_t available);
+
+/**
+ * @brief Execute one complete command
+ *
+ * @param commands Command data, cmd_length() bytes of it
+ * @return The command ends the USB packet unless in stream mode: CMD_STOP,
+ * or a command the probe does not know
+ */
+static bool cmd_execute(pio_jtag_inst_t* jtag, const uint8_t *commands);
+
+/**
+ * @brief Get room for a response
+ *
+ * Responses are written in place in the IN buffers of dirtyJtag.c. When the
+ * current one cannot take count more bytes, it is sent and another one taken.
+ *
+ * @param count Bytes the command is going to write
+ * @return Where to write them
+ */
+static uint8_t* response_reserve(uint32_t count);
+
+/**
+ * @brief Send the current IN buffer, if any
+ */
+static void response_flush(void);
+
+/**
+ * @brief Append data to the responses, over as many IN buffers as it takes
+ */
+static void response_write(const uint8_t *data, uint32_t count);
 
 /**
  * @brief Handle CMD_SETSIG command
@@ -112,7 +345,7 @@ static void cmd_setsig(pio_jtag_inst_t* jtag, const uint8_t *commands);
  * 
  * @param usbd_dev USB device
  */
-static uint32_t cmd_getsig(pio_jtag_inst_t* jtag, uint8_t *buffer);
+static uint32_t cmd_getsig(pio_jtag_inst_t* jtag);
 
 /**
  * @brief Handle CMD_CLK command
@@ -123,7 +356,19 @@ static uint32_t cmd_getsig(pio_jtag_inst_t* jtag, uint8_t *buffer);
  * @param commands Command data
  * @param readout Enable TDO readout
  */
-static uint32_t cmd_clk(pio_jtag_inst_t *jtag, const uint8_t *commands, bool readout, uint8_t *buffer);
+static uint32_t cmd_clk(pio_jtag_inst_t *jtag, const uint8_t *commands, bool readout);
+
+/**
+ * @brief Handle CMD_CLK command with TMS_VECTOR
+ *
+ * Shifts a TMS bit vector, MSB first, with a constant TDI, in one go through
+ * the PIO: [cmd][signals (SIG_TDI)][number of bits][TMS bytes]. With READOUT
+ * the TDO bits come back as for CMD_XFER.
+ *
+ * @param commands Command data
+ * @param readout Enable TDO readout
+ */
+static uint32_t cmd_tms(pio_jtag_inst_t *jtag, const uint8_t *commands, bool readout);
 /**
  * @brief Handle CMD_SETVOLTAGE command
  *
@@ -139,88 +384,390 @@ static void cmd_setvoltage(const uint8_t *commands);
  * CMD_GOTOBOOTLOADER resets the MCU and enters its bootloader (if installed)
  */
 static void cmd_gotobootloader(void);
+/**
+ * @brief Handle CMD_CHAIN command
+ *
+ * CMD_CHAIN selects the JTAG chain the next commands go to: [cmd][chain].
+ * A chain the probe does not have is ignored. With CHAIN_COUNT it answers
+ * one byte, the number of chains. A NO_READ XFER ending on a whole word
+ * keeps shifting on its chain while the commands for another one run.
+ *
+ * @param commands Command data
+ */
+static uint32_t cmd_chain(const uint8_t *commands);
+/**
+ * @brief Handle CMD_STATS command
+ *
+ * CMD_STATS answers the counters of stats.h, STATS_ENCODED_SIZE bytes: their
+ * number of 32 bit words, then the words, big endian. With STATS_RESET they
+ * start again from 0 once read.
+ *
+ * With TRACE it drives the trace ring of trace.h instead: [cmd][operation],
+ * TRACE_ON empties the ring and starts recording the commands, TRACE_OFF
+ * stops, TRACE_DUMP answers the ring as trace.h describes and empties it.
+ *
+ * @param commands Command data
+ */
+static void cmd_stats(const uint8_t *commands);
+
+/* IN buffer being filled and where the next response goes in it */
+static uint8_t *tx_buf;
+static uint8_t *output_buffer;
+
+/* Command split between two pieces of the stream, completed by the next piece, the longest a macro run */
+static uint8_t carry[3 + 255];
+static uint32_t carry_count;
+
+/* Data still expected by the CMD_LONGXFER in progress */
+static uint32_t longxfer_remaining;
+static bool longxfer_read;
+static bool longxfer_packed;
+static bool longxfer_packed_tdo;
 
-void cmd_handle(pio_jtag_inst_t* jtag, uint8_t* rxbuf, uint32_t count, uint8_t* tx_buf) {
-  uint8_t *commands= (uint8_t*)rxbuf;
-  uint8_t *output_buffer = tx_buf;
-  while ((commands < (rxbuf + count)) && (*commands != CMD_STOP))
+/* Parameters of a macro run are at most as long as the data of a CMD_XFER */
+#define MACRO_PARAMS_MAX 62
+
+typedef struct {
+  bool defined;
+  uint8_t slot_count;
+  uint8_t params_length; /* sum of the lengths of the slots */
+  uint16_t start;        /* of its slots in macro_pool, the body following them */
+  uint16_t length;       /* of the body */
+  uint32_t hits;
+} macro_info;
+
+static macro_info macros[MACRO_COUNT];
+static uint8_t macro_pool[MACRO_POOL_SIZE];
+static uint32_t macro_pool_used;
+
+/* XSVF data still expected by the CMD_XSVF in progress */
+static uint32_t xsvf_remaining;
+
+/* Macro definition whose slots and body are still coming */
+static uint32_t macro_remaining;
+static uint8_t macro_id;
+static bool macro_stored;
+
+/* Chain selected by CMD_CHAIN */
+static uint32_t chain_selected;
+
+/* Set by CMD_STOP | STREAM_MODE: CMD_STOP no longer ends the USB packet, core0 merges them */
+static volatile bool stream_mode;
+
+bool cmd_stream_mode(void) {
+  return stream_mode;
+}
+
+void cmd_handle(pio_jtag_inst_t* chains, uint8_t* rxbuf, uint32_t count) {
+  const uint8_t *commands = rxbuf;
+  const uint8_t *end = rxbuf + count;
+
+  while (commands < end)
   {
-    switch ((*commands)&0x0F) {
-    case CMD_INFO:
+    pio_jtag_inst_t *jtag = &chains[chain_selected];
+
+    if (longxfer_remaining)
     {
-      uint32_t trbytes = cmd_info(output_buffer);
-      output_buffer += trbytes;
-      break;
+      trace_begin(CMD_LONGXFER, TRACE_DATA, chain_selected);
+      commands += cmd_longxfer_data(jtag, commands, end - commands);
+      trace_end();
+      continue;
+    }
+    if (macro_remaining)
+    {
+      trace_begin(CMD_MACRO, TRACE_DATA, chain_selected);
+      commands += cmd_macro_data(commands, end - commands);
+      trace_end();
+      continue;
+    }
+    if (xsvf_remaining)
+    {
+      trace_begin(CMD_XSVF, TRACE_DATA, chain_selected);
+      commands += cmd_xsvf_data(jtag, commands, end - commands);
+      trace_end();
+      continue;
+    }
+    if (carry_count)
+    {
+      while ((carry_count < cmd_length(carry, carry_count)) && (commands < end))
+      {
+        carry[carry_count++] = *commands++;
+      }
+      if (carry_count < cmd_length(carry, carry_count))
+      {
+        break;
+      }
+      bool packet_mode = !stream_mode;
+      trace_begin(carry[0], 0, chain_selected);
+      bool stop = cmd_execute(jtag, carry);
+      trace_end();
+      carry_count = 0;
+      if (stop && packet_mode)
+      {
+        break;
+      }
+      continue;
     }
-    case CMD_FREQ:
-      cmd_freq(jtag, commands);
-      commands += 2;
-      break;
 
-    case CMD_XFER:
+    uint32_t length = cmd_length(commands, end - commands);
+    if (length > (uint32_t)(end - commands))
     {
-      bool no_read = *commands & NO_READ;
-      uint32_t trbytes = cmd_xfer(jtag, commands, *commands & EXTEND_LENGTH, no_read, output_buffer);
-      commands += 1 + trbytes;
-      output_buffer += (no_read ? 0 : trbytes);
+      /* The rest of this command is in the next piece */
+      carry_count = end - commands;
+      memcpy(carry, commands, carry_count);
       break;
     }
-    case CMD_SETSIG:
-      cmd_setsig(jtag, commands);
-      commands += 2;
+    bool packet_mode = !stream_mode;
+    trace_begin(*commands, 0, chain_selected);
+    bool stop = cmd_execute(jtag, commands);
+    trace_end();
+    if (stop && packet_mode)
+    {
+      /* The rest of the packet is not commands */
       break;
+    }
+    commands += length;
+  }
+  /* Send the responses back to host, more data may not come before they are read */
+  response_flush();
+}
 
-    case CMD_GETSIG:
+static uint32_t cmd_length(const uint8_t *commands, uint32_t available) {
+  switch ((*commands)&0x0F) {
+  case CMD_CLK:
+    if ((*commands & TMS_VECTOR) && (available >= 3))
     {
-      uint32_t trbytes = cmd_getsig(jtag, output_buffer);
-      output_buffer += trbytes;
-      break;
+      return 3 + (commands[2] + 7) / 8;
     }
-    case CMD_CLK:
+    return 3;
+
+  case CMD_FREQ:
+  case CMD_SETSIG:
+    return 3;
+
+  case CMD_CHAIN:
+    return 2;
+
+  case CMD_STATS:
+    return (*commands & TRACE) ? 2 : 1;
+
+  case CMD_XFER:
+  case CMD_VERIFY:
+  {
+    if (available < 2)
     {
-      uint32_t trbytes = cmd_clk(jtag, commands, !!(*commands & READOUT), output_buffer);
-      output_buffer += trbytes;
-      commands += 2;
-      break;
+      return 2;
     }
-    case CMD_SETVOLTAGE:
-      cmd_setvoltage(commands);
-      commands += 1;
-      break;
+    uint32_t transferred_bits = commands[1] + ((*commands & EXTEND_LENGTH) ? 256 : 0);
+    // Ensure we don't do over-read
+    if (transferred_bits > 62 * 8)
+    {
+      transferred_bits = 62 * 8;
+    }
+    /* CMD_VERIFY has the expected TDO and the mask after the TDI */
+    return 2 + (((*commands & 0x0F) == CMD_VERIFY) ? 3 : 1) * ((transferred_bits + 7) / 8);
+  }
+  case CMD_POLL:
+  {
+    if (available < 2)
+    {
+      return 6;
+    }
+    uint32_t transferred_bits = commands[1] + ((*commands & EXTEND_LENGTH) ? 256 : 0);
+    if (transferred_bits > 62 * 8)
+    {
+      transferred_bits = 62 * 8;
+    }
+    return 6 + 3 * ((transferred_bits + 7) / 8);
+  }
+  case CMD_LONGXFER:
+  case CMD_XSVF:
+    return 5;
 
-    case CMD_GOTOBOOTLOADER:
-      cmd_gotobootloader();
-      break;
-      
-    default:
-      return; /* Unsupported command, halt */
-      break;
+  case CMD_MACRO:
+    if (*commands & MACRO_RUN)
+    {
+      return (available < 3) ? 3 : 3 + commands[2];
+    }
+    return (*commands & MACRO_HITS) ? 2 : 5;
+
+  case CMD_SETVOLTAGE:
+    return 2;
+
+  default:
+    return 1;
+  }
+}
+
+static bool cmd_execute(pio_jtag_inst_t* jtag, const uint8_t *commands) {
+  stats.commands[(*commands)&0x0F]++;
+  switch ((*commands)&0x0F) {
+  case CMD_STOP:
+    if (*commands & STREAM_MODE)
+    {
+      stream_mode = true;
     }
+    else if (*commands & PACKET_MODE)
+    {
+      stream_mode = false;
+    }
+    /* End of a batch of commands, its responses are due */
+    response_flush();
+    return true;
+
+  case CMD_INFO:
+    output_buffer += cmd_info();
+    break;
+
+  case CMD_FREQ:
+    output_buffer += cmd_freq(jtag, commands);
+    break;
+
+  case CMD_XFER:
+  {
+    bool no_read = *commands & NO_READ;
+    uint32_t trbytes = cmd_xfer(jtag, commands, *commands & EXTEND_LENGTH, no_read, *commands & LSB_FIRST);
+    output_buffer += (no_read ? 0 : trbytes);
+    break;
+  }
+  case CMD_VERIFY:
+    output_buffer += cmd_verify(jtag, commands, *commands & EXTEND_LENGTH, *commands & LSB_FIRST);
+    break;
+
+  case CMD_POLL:
+    output_buffer += cmd_poll(jtag, commands, *commands & EXTEND_LENGTH, *commands & LSB_FIRST);
+    break;
+
+  case CMD_LONGXFER:
+    cmd_longxfer(jtag, commands, *commands & NO_READ, *commands & LSB_FIRST, *commands & PACKED_TDI, *commands & PACKED_TDO);
+    break;
+
+  case CMD_MACRO:
+    cmd_macro(jtag, commands);
+    break;
+
+  case CMD_XSVF:
+    cmd_xsvf(jtag, commands);
+    break;
+
+  case CMD_SETSIG:
+    cmd_setsig(jtag, commands);
+    break;
+
+  case CMD_GETSIG:
+    output_buffer += cmd_getsig(jtag);
+    break;
+
+  case CMD_CLK:
+    if (*commands & TMS_VECTOR)
+    {
+      output_buffer += cmd_tms(jtag, commands, !!(*commands & READOUT));
+    }
+    else
+    {
+      output_buffer += cmd_clk(jtag, commands, !!(*commands & READOUT));
+    }
+    break;
+
+  case CMD_SETVOLTAGE:
+    cmd_setvoltage(commands);
+    break;
+
+  case CMD_GOTOBOOTLOADER:
+    cmd_gotobootloader();
+    break;
+
+  case CMD_CHAIN:
+    output_buffer += cmd_chain(commands);
+    break;
+
+  case CMD_STATS:
+    cmd_stats(commands);
+    break;
+
+  default:
+    return true; /* Unsupported command, ends the packet */
+  }
+  return false;
+}
+
+static uint8_t* response_reserve(uint32_t count) {
+  if (tx_buf && (output_buffer + count > tx_buf + CMD_RESPONSE_SIZE))
+  {
+    response_flush();
+  }
+  if (!tx_buf)
+  {
+    tx_buf = output_buffer = cmd_response_buffer();
+  }
+  return output_buffer;
+}
 
-    commands++;
+static void response_flush(void) {
+  if (tx_buf)
+  {
+    cmd_response_send(tx_buf, output_buffer - tx_buf);
+    tx_buf = output_buffer = NULL;
   }
-  /* Send the transfer response back to host */
-  if (tx_buf != output_buffer)
+  trace_queued();
+}
+
+static void response_write(const uint8_t *data, uint32_t count) {
+  while (count)
   {
-    tud_vendor_write(tx_buf, output_buffer - tx_buf);
-    tud_vendor_flush();
+    /* fill up the current buffer first */
+    uint32_t chunk = tx_buf ? (uint32_t)(tx_buf + CMD_RESPONSE_SIZE - output_buffer) : CMD_RESPONSE_SIZE;
+    chunk = MIN(count, chunk ? chunk : CMD_RESPONSE_SIZE);
+    memcpy(response_reserve(chunk), data, chunk);
+    output_buffer += chunk;
+    data += chunk;
+    count -= chunk;
   }
-  return;
 }
 
-static uint32_t cmd_info(uint8_t *buffer) {
+static uint32_t cmd_info(void) {
   char info_string[10] = "DJTAG2\n";
-  memcpy(buffer, info_string, 10);
+  memcpy(response_reserve(10), info_string, 10);
   return 10;
 }
 
-static void cmd_freq(pio_jtag_inst_t* jtag, const uint8_t *commands) {
-  jtag_set_clk_freq(jtag, (commands[1] << 8) | commands[2]);
+static uint32_t cmd_freq(pio_jtag_inst_t* jtag, const uint8_t *commands) {
+  uint freq_khz = (commands[1] << 8) | commands[2];
+  uint32_t clean_hz = 0;
+  uint32_t hz;
+  uint8_t *response;
+
+  if (*commands & AUTOTUNE)
+  {
+    hz = tck_tune(jtag, freq_khz ? freq_khz : 0xFFFF, &clean_hz);
+  }
+  else
+  {
+    hz = jtag_set_clk_freq(jtag, freq_khz);
+  }
+  if ((*commands & SAVE_FREQ) && !((*commands & AUTOTUNE) && (hz == 0)))
+  {
+    settings_save_tck(jtag_get_clk_freq(jtag));
+  }
+
+  if (*commands & AUTOTUNE)
+  {
+    response = response_reserve(8);
+    put_u32(response, clean_hz);
+    put_u32(response + 4, hz);
+    return 8;
+  }
+  if (!(*commands & REAL_FREQ))
+  {
+    return 0;
+  }
+  put_u32(response_reserve(4), hz);
+  return 4;
 }
 
 //static uint8_t output_buffer[64];
 
-static uint32_t cmd_xfer(pio_jtag_inst_t* jtag, const uint8_t *commands, bool extend_length, bool no_read, uint8_t* tx_buf) {
+static uint32_t cmd_xfer(pio_jtag_inst_t* jtag, const uint8_t *commands, bool extend_length, bool no_read, bool lsb_first) {
   uint16_t transferred_bits;
   uint8_t* output_buffer = 0;
   transferred_bits = commands[1];
@@ -234,18 +781,379 @@ static uint32_t cmd_xfer(pio_jtag_inst_t* jtag, const uint8_t *commands, bool ex
     transferred_bits = 62 * 8;
   }
 
-  /* Fill the output buffer with zeroes */
+  /* Fill the output buffer with zeroes, the TDO then lands there without being copied */
   if (!no_read)
   {
-    output_buffer = tx_buf;
+    output_buffer = response_reserve((transferred_bits + 7) / 8);
     memset(output_buffer, 0, (transferred_bits + 7) / 8);
   }
 
+  jtag_set_bit_order(jtag, lsb_first);
   jtag_transfer(jtag, transferred_bits, commands+2, output_buffer);
 
   return (transferred_bits + 7) / 8;
 }
 
+static uint32_t cmd_verify(pio_jtag_inst_t* jtag, const uint8_t *commands, bool extend_length, bool lsb_first) {
+  static uint8_t tdo_buffer[62];
+  uint32_t transferred_bits = commands[1] + (extend_length ? 256 : 0);
+  if (transferred_bits > 62 * 8)
+  {
+    transferred_bits = 62 * 8;
+  }
+  uint32_t bytes = (transferred_bits + 7) / 8;
+  const uint8_t *expected = commands + 2 + bytes;
+  const uint8_t *mask = expected + bytes;
+  uint8_t *response = response_reserve(2);
+  uint32_t mismatch;
+
+  jtag_set_bit_order(jtag, lsb_first);
+  jtag_transfer(jtag, transferred_bits, commands+2, tdo_buffer);
+
+  mismatch = tdo_mismatch(tdo_buffer, expected, mask, transferred_bits, lsb_first);
+  response[0] = mismatch >> 8;
+  response[1] = mismatch;
+  return 2;
+}
+
+static uint32_t cmd_poll(pio_jtag_inst_t* jtag, const uint8_t *commands, bool extend_length, bool lsb_first) {
+  uint32_t transferred_bits = commands[1] + (extend_length ? 256 : 0);
+  if (transferred_bits > 62 * 8)
+  {
+    transferred_bits = 62 * 8;
+  }
+  uint32_t bytes = (transferred_bits + 7) / 8;
+  uint32_t tries = (commands[2] << 8) | commands[3];
+  uint32_t timeout_us = ((commands[4] << 8) | commands[5]) * 1000;
+  const uint8_t *tdi = commands + 6;
+  const uint8_t *expected = tdi + bytes;
+  const uint8_t *mask = expected + bytes;
+  /* the last TDO goes straight in the response, after the count */
+  uint8_t *response = response_reserve(2 + bytes);
+  uint32_t start = time_us_32();
+  uint32_t count = 0;
+  /* Exit1-DR, Update-DR, Select-DR-Scan, Capture-DR, Shift-DR */
+  static const uint8_t recapture[] = { 0xE0 };
+  uint32_t last = transferred_bits ? transferred_bits - 1 : 0;
+  bool last_tdi = (tdi[last / 8] >> (lsb_first ? (last & 7) : 7 - (last & 7))) & 1;
+
+  jtag_set_bit_order(jtag, lsb_first);
+  for (;;)
+  {
+    jtag_transfer(jtag, transferred_bits, tdi, response + 2);
+    count++;
+    if ((tdo_mismatch(response + 2, expected, mask, transferred_bits, lsb_first) == 0xFFFF)
+        || (count == tries) || (count == 0xFFFF)
+        || (timeout_us && (time_us_32() - start >= timeout_us)))
+    {
+      break;
+    }
+    jtag_tms_sequence(jtag, 5, recapture, last_tdi, NULL);
+  }
+
+  response[0] = count >> 8;
+  response[1] = count;
+  return 2 + bytes;
+}
+
+/* Frees the room of a macro, moving down the ones stored after it */
+static void macro_remove(uint8_t id) {
+  macro_info *m = &macros[id];
+  if (!m->defined)
+  {
+    return;
+  }
+  uint32_t size = 3 * m->slot_count + m->length;
+  memmove(macro_pool + m->start, macro_pool + m->start + size, macro_pool_used - m->start - size);
+  macro_pool_used -= size;
+  for (uint32_t i = 0; i < MACRO_COUNT; i++)
+  {
+    if (macros[i].defined && (macros[i].start > m->start))
+    {
+      macros[i].start -= size;
+    }
+  }
+  m->defined = false;
+}
+
+/* Commands a macro body cannot hold: they would end the batch, nest runs, read the stream or change the chain under cmd_handle */
+static bool macro_excluded(uint8_t command) {
+  return ((command & 0x0F) == CMD_STOP) || ((command & 0x0F) == CMD_MACRO) || ((command & 0x0F) == CMD_XSVF) || ((command & 0x0F) == CMD_CHAIN);
+}
+
+/* Checks the slots and that the body is whole commands, none macro_excluded() */
+static bool macro_valid(const macro_info *m) {
+  const uint8_t *slots = macro_pool + m->start;
+  const uint8_t *commands = slots + 3 * m->slot_count;
+  const uint8_t *end = commands + m->length;
+  uint32_t params_length = 0;
+
+  for (uint32_t i = 0; i < m->slot_count; i++)
+  {
+    if (((slots[3 * i] << 8) | slots[3 * i + 1]) + slots[3 * i + 2] > m->length)
+    {
+      return false;
+    }
+    params_length += slots[3 * i + 2];
+  }
+  if (params_length > MACRO_PARAMS_MAX)
+  {
+    return false;
+  }
+  while (commands < end)
+  {
+    uint32_t length = cmd_length(commands, end - commands);
+    if (macro_excluded(*commands) || (length > (uint32_t)(end - commands)))
+    {
+      return false;
+    }
+    if (((*commands & 0x0F) == CMD_LONGXFER) && (*commands & PACKED_TDI))
+    {
+      /* where packed data ends cannot be told, it takes the rest */
+      length = end - commands;
+    }
+    else if ((*commands & 0x0F) == CMD_LONGXFER)
+    {
+      uint32_t bits = ((uint32_t)commands[1] << 24) | ((uint32_t)commands[2] << 16) | (commands[3] << 8) | commands[4];
+      /* the data of a last one may come after the run */
+      length += MIN((bits + 7) / 8, (uint32_t)(end - commands) - length);
+    }
+    commands += length;
+  }
+  return true;
+}
+
+static void cmd_macro(pio_jtag_inst_t* jtag, const uint8_t *commands) {
+  uint8_t id = commands[1];
+
+  if (*commands & MACRO_RUN)
+  {
+    if ((id >= MACRO_COUNT) || !macros[id].defined || (commands[2] != macros[id].params_length))
+    {
+      return;
+    }
+    macro_info *m = &macros[id];
+    const uint8_t *slots = macro_pool + m->start;
+    uint8_t *body = macro_pool + m->start + 3 * m->slot_count;
+    const uint8_t *params = commands + 3;
+    /* the parameters are written over the previous ones, in place */
+    for (uint32_t i = 0; i < m->slot_count; i++, slots += 3)
+    {
+      memcpy(body + ((slots[0] << 8) | slots[1]), params, slots[2]);
+      params += slots[2];
+    }
+    m->hits++;
+    cmd_run(jtag, body, body + m->length);
+  }
+  else if (*commands & MACRO_HITS)
+  {
+    uint32_t hits = ((id < MACRO_COUNT) && macros[id].defined) ? macros[id].hits : 0;
+    put_u32(response_reserve(4), hits);
+    output_buffer += 4;
+  }
+  else
+  {
+    uint8_t slot_count = commands[2];
+    uint32_t length = (commands[3] << 8) | commands[4];
+
+    macro_id = id;
+    macro_remaining = 3 * slot_count + length;
+    macro_stored = false;
+    if (id < MACRO_COUNT)
+    {
+      macro_remove(id);
+      if (macro_pool_used + macro_remaining <= MACRO_POOL_SIZE)
+      {
+        macro_info *m = &macros[id];
+        m->slot_count = slot_count;
+        m->length = length;
+        m->start = macro_pool_used;
+        macro_stored = true;
+      }
+    }
+    if (!macro_remaining)
+    {
+      cmd_macro_data(commands, 0);
+    }
+  }
+}
+
+static uint32_t cmd_macro_data(const uint8_t *data, uint32_t count) {
+  /* only stored when macro_id is a valid one */
+  macro_info *m = macro_stored ? &macros[macro_id] : NULL;
+
+  count = MIN(count, macro_remaining);
+  if (macro_stored)
+  {
+    /* the slots and the body go after the macros already there */
+    memcpy(macro_pool + m->start + 3 * m->slot_count + m->length - macro_remaining, data, count);
+  }
+  macro_remaining -= count;
+  if (!macro_remaining)
+  {
+    if (macro_stored && macro_valid(m))
+    {
+      m->defined = true;
+      m->hits = 0;
+      m->params_length = 0;
+      for (uint32_t i = 0; i < m->slot_count; i++)
+      {
+        m->params_length += macro_pool[m->start + 3 * i + 2];
+      }
+      macro_pool_used += 3 * m->slot_count + m->length;
+    }
+    *response_reserve(1) = macro_stored && m->defined;
+    output_buffer += 1;
+  }
+  return count;
+}
+
+static void cmd_xsvf(pio_jtag_inst_t* jtag, const uint8_t *commands) {
+  xsvf_remaining = ((uint32_t)commands[1] << 24) | ((uint32_t)commands[2] << 16) | (commands[3] << 8) | commands[4];
+  xsvf_begin(jtag);
+  if (!xsvf_remaining)
+  {
+    cmd_xsvf_data(jtag, commands, 0);
+  }
+}
+
+static uint32_t cmd_xsvf_data(pio_jtag_inst_t* jtag, const uint8_t *data, uint32_t count) {
+  count = MIN(count, xsvf_remaining);
+  xsvf_data(jtag, data, count);
+  xsvf_remaining -= count;
+  if (!xsvf_remaining)
+  {
+    uint32_t index;
+    uint8_t *response = response_reserve(5);
+    response[0] = xsvf_end(&index);
+    put_u32(response + 1, index);
+    output_buffer += 5;
+  }
+  return count;
+}
+
+static void cmd_run(pio_jtag_inst_t* jtag, const uint8_t *commands, const uint8_t *end) {
+  while (commands < end)
+  {
+    if (longxfer_remaining)
+    {
+      commands += cmd_longxfer_data(jtag, commands, end - commands);
+      continue;
+    }
+    uint32_t length = cmd_length(commands, end - commands);
+    /* a parameter may have made the rest of the body something else */
+    if ((length > (uint32_t)(end - commands)) || macro_excluded(*commands))
+    {
+      break;
+    }
+    cmd_execute(jtag, commands);
+    commands += length;
+  }
+}
+
+static uint32_t tdo_mismatch(const uint8_t *tdo, const uint8_t *expected, const uint8_t *mask, uint32_t length, bool lsb_first) {
+  uint32_t bytes = (length + 7) / 8;
+
+  for (uint32_t i = 0; i < bytes; i++)
+  {
+    uint8_t diff = (tdo[i] ^ expected[i]) & mask[i];
+    /* the bits past the end of a partial last byte were not shifted */
+    if ((i == bytes - 1) && (length & 7))
+    {
+      diff &= lsb_first ? (0xFF >> (8 - (length & 7))) : (0xFF << (8 - (length & 7)));
+    }
+    if (diff)
+    {
+      return i * 8 + (lsb_first ? __builtin_ctz(diff) : __builtin_clz(diff) - 24);
+    }
+  }
+  return 0xFFFF;
+}
+
+static void cmd_longxfer(pio_jtag_inst_t* jtag, const uint8_t *commands, bool no_read, bool lsb_first, bool packed_tdi, bool packed_tdo) {
+  uint32_t transferred_bits = ((uint32_t)commands[1] << 24) | ((uint32_t)commands[2] << 16) | (commands[3] << 8) | commands[4];
+
+  if (transferred_bits == 0)
+  {
+    return;
+  }
+  longxfer_remaining = (transferred_bits >> 3) + ((transferred_bits & 7) ? 1 : 0);
+  longxfer_read = !no_read;
+  longxfer_packed = packed_tdi;
+  longxfer_packed_tdo = packed_tdo && !no_read;
+  if (packed_tdi)
+  {
+    unpack_begin(longxfer_remaining);
+  }
+  if (longxfer_packed_tdo)
+  {
+    pack_begin();
+  }
+  jtag_set_bit_order(jtag, lsb_first);
+  jtag_transfer_begin(jtag, transferred_bits, longxfer_read);
+}
+
+static uint32_t cmd_longxfer_data(pio_jtag_inst_t* jtag, const uint8_t *data, uint32_t count) {
+  uint32_t used = 0;
+
+  if (!longxfer_packed)
+  {
+    count = MIN(count, longxfer_remaining);
+    longxfer_shift(jtag, data, count);
+    return count;
+  }
+  while (longxfer_remaining)
+  {
+    const uint8_t *tdi;
+    uint32_t ready;
+    used += unpack(data + used, count - used, longxfer_read ? CMD_RESPONSE_SIZE : PACK_WINDOW_SIZE, &tdi, &ready);
+    if (!ready)
+    {
+      break;
+    }
+    longxfer_shift(jtag, tdi, ready);
+  }
+  return used;
+}
+
+static void longxfer_shift(pio_jtag_inst_t* jtag, const uint8_t *data, uint32_t count) {
+  uint32_t used = 0;
+
+  while (used < count)
+  {
+    uint32_t chunk = count - used;
+    if (!longxfer_read)
+    {
+      jtag_transfer_continue(jtag, data + used, NULL, chunk);
+    }
+    else if (longxfer_packed_tdo)
+    {
+      /* packed TDO fills whole IN buffers, there is no point sending each piece */
+      static uint8_t tdo[CMD_RESPONSE_SIZE];
+      static uint8_t packed_tdo[CMD_RESPONSE_SIZE + PACK_MARGIN];
+      uint32_t length;
+      chunk = MIN(chunk, CMD_RESPONSE_SIZE);
+      jtag_transfer_continue(jtag, data + used, tdo, chunk);
+      length = pack(tdo, chunk, packed_tdo);
+      if (used + chunk == longxfer_remaining)
+      {
+        length += pack_end(packed_tdo + length);
+      }
+      response_write(packed_tdo, length);
+    }
+    else
+    {
+      /* the TDO of each piece goes out while the next one is shifted */
+      chunk = MIN(chunk, CMD_RESPONSE_SIZE);
+      jtag_transfer_continue(jtag, data + used, response_reserve(chunk), chunk);
+      output_buffer += chunk;
+      response_flush();
+    }
+    used += chunk;
+  }
+  longxfer_remaining -= used;
+}
+
 static void cmd_setsig(pio_jtag_inst_t* jtag, const uint8_t *commands) {
   uint8_t signal_mask, signal_status;
 
@@ -273,8 +1181,9 @@ static void cmd_setsig(pio_jtag_inst_t* jtag, const uint8_t *commands) {
   }
 }
 
-static uint32_t cmd_getsig(pio_jtag_inst_t* jtag, uint8_t *buffer)
+static uint32_t cmd_getsig(pio_jtag_inst_t* jtag)
 {
+  uint8_t *buffer = response_reserve(1);
   uint8_t signal_status = 0;
   
   if (jtag_get_tdo(jtag)) {
@@ -284,7 +1193,7 @@ static uint32_t cmd_getsig(pio_jtag_inst_t* jtag, uint8_t *buffer)
   return 1;
 }
 
-static uint32_t cmd_clk(pio_jtag_inst_t *jtag, const uint8_t *commands, bool readout, uint8_t *buffer)
+static uint32_t cmd_clk(pio_jtag_inst_t *jtag, const uint8_t *commands, bool readout)
 {
   uint8_t signals, clk_pulses;
   signals = commands[1];
@@ -293,11 +1202,26 @@ static uint32_t cmd_clk(pio_jtag_inst_t *jtag, const uint8_t *commands, bool rea
 
   if (readout)
   {
-    buffer[0] = readout_val;
+    response_reserve(1)[0] = readout_val;
   }
   return readout ? 1 : 0;
 }
 
+static uint32_t cmd_tms(pio_jtag_inst_t *jtag, const uint8_t *commands, bool readout)
+{
+  uint8_t signals = commands[1];
+  uint32_t bits = commands[2];
+  uint32_t bytes = (bits + 7) / 8;
+  uint8_t *tdo_buffer = NULL;
+
+  if (readout && bits)
+  {
+    tdo_buffer = response_reserve(bytes);
+  }
+  jtag_tms_sequence(jtag, bits, commands + 3, signals & SIG_TDI, tdo_buffer);
+  return tdo_buffer ? bytes : 0;
+}
+
 static void cmd_setvoltage(const uint8_t *commands) {
   (void)commands;
 }
@@ -305,3 +1229,43 @@ static void cmd_setvoltage(const uint8_t *commands) {
 static void cmd_gotobootloader(void) {
 
 }
+
+static uint32_t cmd_chain(const uint8_t *commands) {
+  if (commands[1] < JTAG_CHAIN_COUNT)
+  {
+    chain_selected = commands[1];
+  }
+  if (*commands & CHAIN_COUNT)
+  {
+    *response_reserve(1) = JTAG_CHAIN_COUNT;
+    return 1;
+  }
+  return 0;
+}
+
+static void cmd_stats(const uint8_t *commands) {
+  uint8_t encoded[STATS_ENCODED_SIZE];
+
+  if (*commands & TRACE)
+  {
+    switch (commands[1])
+    {
+    case TRACE_OFF:
+      trace_stop();
+      break;
+    case TRACE_ON:
+      trace_start();
+      break;
+    case TRACE_DUMP:
+      trace_dump(response_write);
+      break;
+    }
+    return;
+  }
+  stats_encode(encoded);
+  if (*commands & STATS_RESET)
+  {
+    stats_reset();
+  }
+  response_write(encoded, sizeof(encoded));
+}
@@ -20,11 +20,60 @@
  * OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+/* Size of the IN buffers the responses are written to, one packet */
+#define CMD_RESPONSE_SIZE 64
+
+/**
+ * @brief Handle DirtyJTAG commands
+ *
+ * rxbuf is one USB packet, as hosts expect by default: CMD_STOP or a command
+ * the probe does not know ends it, the bytes after it are dropped. Once the
+ * host sends CMD_STOP | STREAM_MODE, the commands are a byte stream instead,
+ * rxbuf is any piece of it and CMD_STOP only ends a batch of commands, until
+ * CMD_STOP | PACKET_MODE. Either way a command cut at the end of rxbuf is
+ * completed by the next call.
+ *
+ * @param chains The JTAG_CHAIN_COUNT chains, CMD_CHAIN selects the one used
+ * @param rxbuf Next piece of the stream
+ * @param count Length of that piece
+ */
+void cmd_handle(pio_jtag_inst_t* chains, uint8_t* rxbuf, uint32_t count);
+
+/**
+ * @brief Tell whether the host asked for stream mode
+ *
+ * @return cmd_handle() takes any piece of the OUT stream, not only one USB packet
+ */
+bool cmd_stream_mode(void);
+
+/**
+ * @brief Get an IN buffer to write a response to
+ *
+ * Waits until one is free.
+ *
+ * @return A buffer of CMD_RESPONSE_SIZE bytes
+ */
+uint8_t* cmd_response_buffer(void);
+
+/**
+ * @brief Send an IN buffer to the host
+ *
+ * The buffer is handed as is to the IN endpoint, and is free again once sent.
+ *
+ * @param buffer Buffer from cmd_response_buffer()
+ * @param count Length of the response, 0 to give the buffer back unused
+ */
+void cmd_response_send(uint8_t* buffer, uint32_t count);
+
+typedef struct cmd_queue_info {
+    uint32_t depth;
+    uint32_t high_water; // most slots ever in use
+} cmd_queue_info;
+
 /**
- * @brief Handle a DirtyJTAG command
+ * @brief Get the size and use of the queues between the USB side and cmd_handle
  *
- * @param usbd_dev USB device
- * @param transfer Received packet
- * @return Command needs to send data back to host
+ * @param packets Receives the OUT packet queue information
+ * @param responses Receives the response queue information
  */
-void cmd_handle(pio_jtag_inst_t* jtag, uint8_t* rxbuf, uint32_t count, uint8_t* tx_buf);
+void cmd_queue_stats(cmd_queue_info* packets, cmd_queue_info* responses);
@@ -33,13 +33,21 @@
 #include "pico/binary_info.h"
 #include "hardware/pio.h"
 #include "pico/multicore.h"
+#include "pico/flash.h"
 #include "pio_jtag.h"
 #include "cdc_uart.h"
 #include "led.h"
 #include "bsp/board.h"
 #include "tusb.h"
+#include "device/usbd_pvt.h"
 #include "cmd.h"
 #include "get_serial.h"
+#include "sys_clock.h"
+#include "settings.h"
+#include "spsc_ring.h"
+#include "stats.h"
+#include "trace.h"
+#include "hardware/sync.h"
 
 #include "dirtyJtagConfig.h"
 
@@ -53,81 +61,233 @@ void init_pins()
     #endif
 }
 
-pio_jtag_inst_t jtag = {
+pio_jtag_inst_t jtag[JTAG_CHAIN_COUNT] = {
+    {
             .pio = pio0,
-            .sm = 0
+            .sm = 0,
+            .sm_tms = 1,
+            .pin_rtck = PIN_RTCK
+    },
+#if ( JTAG_CHAIN_COUNT > 1 )
+    { .pio = pio0, .sm = 2, .sm_tms = 3, .pin_rtck = 255 },
+#endif
+#if ( JTAG_CHAIN_COUNT > 2 )
+    { .pio = pio1, .sm = 0, .sm_tms = 1, .pin_rtck = 255 },
+#endif
+#if ( JTAG_CHAIN_COUNT > 3 )
+    { .pio = pio1, .sm = 2, .sm_tms = 3, .pin_rtck = 255 },
+#endif
 };
 
 void djtag_init()
 {
     init_pins();
     #if !( BOARD_TYPE == BOARD_QMTECH_RP2040_DAUGHTERBOARD )
-    init_jtag(&jtag, 1000, PIN_TCK, PIN_TDI, PIN_TDO, PIN_TMS, PIN_RST, PIN_TRST);
+    init_jtag(&jtag[0], settings_tck_khz(1000), PIN_TCK, PIN_TDI, PIN_TDO, PIN_TMS, PIN_RST, PIN_TRST);
     #else
-    init_jtag(&jtag, 1000, PIN_TCK, PIN_TDI, PIN_TDO, PIN_TMS, 255, 255);
+    init_jtag(&jtag[0], settings_tck_khz(1000), PIN_TCK, PIN_TDI, PIN_TDO, PIN_TMS, 255, 255);
+    #endif
+    #if ( JTAG_CHAIN_COUNT > 1 )
+    init_jtag(&jtag[1], settings_tck_khz(1000), PIN_TCK_1, PIN_TDI_1, PIN_TDO_1, PIN_TMS_1, 255, 255);
+    #endif
+    #if ( JTAG_CHAIN_COUNT > 2 )
+    init_jtag(&jtag[2], settings_tck_khz(1000), PIN_TCK_2, PIN_TDI_2, PIN_TDO_2, PIN_TMS_2, 255, 255);
+    #endif
+    #if ( JTAG_CHAIN_COUNT > 3 )
+    init_jtag(&jtag[3], settings_tck_khz(1000), PIN_TCK_3, PIN_TDI_3, PIN_TDO_3, PIN_TMS_3, 255, 255);
     #endif
 }
-typedef uint8_t cmd_buffer[64];
-static uint wr_buffer_number = 0;
-static uint rd_buffer_number = 0; 
+// core0 reads the OUT stream straight into the slots of packet_ring, core1 executes them in place.
+// core1 writes the responses in place in the slots of response_ring, core0 gives them as is to the
+// IN endpoint. So core0 keeps receiving while core1 executes, and core1 keeps executing while
+// earlier responses wait for the host.
+typedef uint8_t cmd_buffer[CMD_RESPONSE_SIZE];
 typedef struct buffer_info
 {
-    volatile uint8_t count;
-    volatile uint8_t busy;
+    uint32_t count;
     cmd_buffer buffer;
 } buffer_info;
+typedef struct packet_info
+{
+    uint32_t count;
+    uint32_t received_us; // for the trace
+    uint8_t buffer[PACKET_BUFFER_SIZE];
+} packet_info;
 
-#define n_buffers (4)
+#if (PACKET_QUEUE_DEPTH & (PACKET_QUEUE_DEPTH - 1)) || (RESPONSE_QUEUE_DEPTH & (RESPONSE_QUEUE_DEPTH - 1))
+#error "PACKET_QUEUE_DEPTH and RESPONSE_QUEUE_DEPTH must be powers of 2"
+#endif
 
-buffer_info buffer_infos[n_buffers];
+static packet_info packet_infos[PACKET_QUEUE_DEPTH];
+static spsc_ring packet_ring;         // core0 -> core1
+static buffer_info response_infos[RESPONSE_QUEUE_DEPTH];
+static spsc_ring response_ring;       // core1 -> core0
+static bool response_on_wire = false; // the tail of response_ring is being sent
+static uint32_t packet_full_since;    // OUT data has been waiting on a full packet_ring since then, 0 if not
 
-static cmd_buffer tx_buf;
+// Bytes of each OUT packet in the vendor RX FIFO not read yet, in order, for cmd_handle() to get one
+// packet at a time unless in stream mode. Every one holds at least a byte of the FIFO.
+static uint8_t out_lengths[CFG_TUD_VENDOR_RX_BUFSIZE];
+static uint32_t out_lengths_head, out_lengths_tail;
 
-void jtag_main_task()
+static void queues_init()
+{
+    spsc_ring_init(&packet_ring, PACKET_QUEUE_DEPTH);
+    spsc_ring_init(&response_ring, RESPONSE_QUEUE_DEPTH);
+}
+
+void jtag_main_task();
+
+// core1 waits for core0 with wfe, core0 signals each change with sev
+static inline void wait_for_core0()
 {
 #ifdef MULTICORE
-    if (multicore_fifo_rvalid())
+    __wfe();
+#else
+    jtag_main_task();
+#endif
+}
+
+// The host has gone or reset the bus: the IN transfer in progress will not complete, the responses
+// waiting are for nobody, and the vendor class has emptied its RX FIFO. core1 gets room again.
+static void responses_drop()
+{
+    response_on_wire = false;
+    while (!spsc_ring_empty(&response_ring))
     {
-        //some command processing has been done
-        uint rx_num = multicore_fifo_pop_blocking();
-        buffer_info* bi = &buffer_infos[rx_num];
-        bi->busy = false;
+        spsc_ring_pop(&response_ring);
+    }
+    out_lengths_tail = out_lengths_head;
+    __sev();
+    led_tx( 0 );
+}
 
+static void send_response()
+{
+    if (!tud_mounted())
+    {
+        if (!spsc_ring_empty(&response_ring))
+        {
+            responses_drop();
+        }
+        return;
     }
-#endif
-    if ((buffer_infos[wr_buffer_number].busy == false)) 
+    if (!response_on_wire && !spsc_ring_empty(&response_ring) && tud_ready() && usbd_edpt_claim(0, PROBE_IN_EP_NUM))
     {
-        //If tud_task() is called and tud_vendor_read isn't called immediately (i.e before calling tud_task again)
-        //after there is data available, there is a risk that data from 2 BULK OUT transaction will be (partially) combined into one
-        //The DJTAG protocol does not tolerate this. 
-        tud_task();// tinyusb device task
-        if (tud_vendor_available())
+        buffer_info* ri = &response_infos[spsc_ring_tail_slot(&response_ring)];
+        led_tx( 1 );
+        response_on_wire = true;
+        if (usbd_edpt_xfer(0, PROBE_IN_EP_NUM, ri->buffer, ri->count))
         {
-            led_rx( 1 );
-            uint bnum = wr_buffer_number;
-            uint count = tud_vendor_read(buffer_infos[wr_buffer_number].buffer, 64);
-            if (count != 0)
-            {
-                buffer_infos[bnum].count = count;
-                buffer_infos[bnum].busy = true;
-                wr_buffer_number = wr_buffer_number + 1; //switch buffer
-                if (wr_buffer_number == n_buffers)
-                {
-                    wr_buffer_number = 0; 
-                }
-#ifdef MULTICORE
-                multicore_fifo_push_blocking(bnum);
-#endif
-            }
-            led_rx( 0 );
-        } else {
-#if ( CDC_UART_INTF_COUNT > 0 )           
-            cdc_uart_task();
-#endif
+            stats.usb_in_packets++;
+            stats.usb_in_bytes += ri->count;
+        }
+        else
+        {
+            // tried again on the next call
+            usbd_edpt_release(0, PROBE_IN_EP_NUM);
+            response_on_wire = false;
+            led_tx( 0 );
         }
     }
 }
 
+//Called once the host has configured the device, after enumeration or a bus reset
+void tud_mount_cb(void)
+{
+    responses_drop();
+}
+
+//Called once the device is unplugged or the bus reset
+void tud_umount_cb(void)
+{
+    responses_drop();
+}
+
+//The vendor class calls this once an IN transfer completes, whoever started it
+void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes)
+{
+    if (response_on_wire)
+    {
+        response_on_wire = false;
+        spsc_ring_pop(&response_ring);
+        __sev();
+        led_tx( 0 );
+    }
+}
+
+//The vendor class calls this once an OUT packet is in its RX FIFO
+void tud_vendor_rx_cb(uint8_t itf, uint8_t const* buffer, uint16_t bufsize)
+{
+    if (bufsize)
+    {
+        out_lengths[out_lengths_head++ & (CFG_TUD_VENDOR_RX_BUFSIZE - 1)] = bufsize;
+    }
+}
+
+// Bytes to read from the vendor RX FIFO into a packet slot: one packet, or as much as fits in stream mode
+static uint32_t out_read_size(void)
+{
+    if (cmd_stream_mode() || (out_lengths_tail == out_lengths_head))
+    {
+        return PACKET_BUFFER_SIZE;
+    }
+    return out_lengths[out_lengths_tail & (CFG_TUD_VENDOR_RX_BUFSIZE - 1)];
+}
+
+static void out_lengths_consume(uint32_t count)
+{
+    while (count && (out_lengths_tail != out_lengths_head))
+    {
+        uint8_t* length = &out_lengths[out_lengths_tail & (CFG_TUD_VENDOR_RX_BUFSIZE - 1)];
+        uint32_t n = MIN(count, *length);
+        *length -= n;
+        count -= n;
+        if (*length == 0)
+        {
+            out_lengths_tail++;
+        }
+    }
+}
+
+void jtag_main_task()
+{
+    //A packet slot gets one OUT packet, or in stream mode whatever is in the vendor RX FIFO, packets merged
+    //or split: cmd_handle() then parses a stream.
+    tud_task();// tinyusb device task
+    send_response();
+    if (!spsc_ring_full(&packet_ring) && tud_vendor_available())
+    {
+        led_rx( 1 );
+        packet_info* bi = &packet_infos[spsc_ring_head_slot(&packet_ring)];
+        uint count = tud_vendor_read(bi->buffer, out_read_size());
+        out_lengths_consume(count);
+        if (count != 0)
+        {
+            stats.usb_out_packets++;
+            stats.usb_out_bytes += count;
+            bi->count = count;
+            bi->received_us = time_us_32();
+            spsc_ring_push(&packet_ring);
+            __sev();
+        }
+        led_rx( 0 );
+        if (packet_full_since)
+        {
+            stats.packet_full_us += time_us_32() - packet_full_since;
+            packet_full_since = 0;
+        }
+    } else {
+        if (!packet_full_since && spsc_ring_full(&packet_ring) && tud_vendor_available())
+        {
+            packet_full_since = time_us_32() | 1;
+        }
+#if ( CDC_INTF_COUNT > 0 )
+        cdc_uart_task();
+#endif
+    }
+}
+
 void jtag_task()
 {
 #ifndef MULTICORE
@@ -141,11 +301,14 @@ void core1_entry() {
     djtag_init();
     while (1)
     {
-        uint rx_num = multicore_fifo_pop_blocking();
-        buffer_info* bi = &buffer_infos[rx_num];
-        assert (bi->busy);
-        cmd_handle(&jtag, bi->buffer, bi->count, tx_buf);
-        multicore_fifo_push_blocking(rx_num);
+        while (spsc_ring_empty(&packet_ring))
+        {
+            wait_for_core0();
+        }
+        packet_info* bi = &packet_infos[spsc_ring_tail_slot(&packet_ring)];
+        trace_packet(bi->received_us);
+        cmd_handle(jtag, bi->buffer, bi->count);
+        spsc_ring_pop(&packet_ring);
     }
  
 }
@@ -154,17 +317,48 @@ void core1_entry() {
 void fetch_command()
 {
 #ifndef MULTICORE
-    if (buffer_infos[rd_buffer_number].busy)
+    if (!spsc_ring_empty(&packet_ring))
+    {
+        packet_info* bi = &packet_infos[spsc_ring_tail_slot(&packet_ring)];
+        trace_packet(bi->received_us);
+        cmd_handle(jtag, bi->buffer, bi->count);
+        spsc_ring_pop(&packet_ring);
+    }
+#endif
+}
+
+uint8_t* cmd_response_buffer(void)
+{
+    if (spsc_ring_full(&response_ring))
     {
-        cmd_handle(&jtag, buffer_infos[rd_buffer_number].buffer, buffer_infos[rd_buffer_number].count, tx_buf);
-        buffer_infos[rd_buffer_number].busy = false;
-        rd_buffer_number++; //switch buffer
-        if (rd_buffer_number == n_buffers)
+        uint32_t start = time_us_32();
+        while (spsc_ring_full(&response_ring))
         {
-            rd_buffer_number = 0; 
+            wait_for_core0();
         }
+        stats.response_wait_us += time_us_32() - start;
+    }
+    return response_infos[spsc_ring_head_slot(&response_ring)].buffer;
+}
+
+void cmd_response_send(uint8_t* buffer, uint32_t count)
+{
+    buffer_info* ri = &response_infos[spsc_ring_head_slot(&response_ring)];
+    assert (ri->buffer == buffer);
+    // with no data, the slot is simply not published
+    if (count != 0)
+    {
+        ri->count = count;
+        spsc_ring_push(&response_ring);
     }
-#endif
+}
+
+void cmd_queue_stats(cmd_queue_info* packets, cmd_queue_info* responses)
+{
+    packets->depth = PACKET_QUEUE_DEPTH;
+    packets->high_water = packet_ring.high_water;
+    responses->depth = RESPONSE_QUEUE_DEPTH;
+    responses->high_water = response_ring.high_water;
 }
 
 //this is to work around the fact that tinyUSB does not handle setup request automatically
@@ -177,20 +371,30 @@ bool tud_vendor_control_xfer_cb(uint8_t rhport, uint8_t stage, tusb_control_requ
 
 int main()
 {
+    sys_clock_init();
     board_init();
     usb_serial_init();
     tusb_init();
 
     led_init( LED_INVERTED, PIN_LED_TX, PIN_LED_RX, PIN_LED_ERROR );
+    queues_init();
 #if ( CDC_UART_INTF_COUNT > 0 )
     cdc_uart_init( 0, PIN_UART0, PIN_UART0_RX, PIN_UART0_TX );
 #endif
 #if ( CDC_UART_INTF_COUNT > 1)
     cdc_uart_init( 1, PIN_UART1, PIN_UART1_RX, PIN_UART1_TX );
 #endif
+#if ( PIO_UART_COUNT > 0 )
+    cdc_pio_uart_init( CDC_UART_INTF_COUNT, PIN_PIO_UART0_RX, PIN_PIO_UART0_TX );
+#endif
+#if ( PIO_UART_COUNT > 1 )
+    cdc_pio_uart_init( CDC_UART_INTF_COUNT + 1, PIN_PIO_UART1_RX, PIN_PIO_UART1_TX );
+#endif
 
 
 #ifdef MULTICORE
+    // core1 saves the settings in flash, core0 has to pause meanwhile
+    flash_safe_execute_core_init();
     multicore_launch_core1(core1_entry);
 #else 
     djtag_init();
@@ -69,6 +69,20 @@
 #define PIN_RST 20
 #define PIN_TRST 21
 
+// extra chains, see JTAG_CHAIN_COUNT
+#define PIN_TDI_1 6
+#define PIN_TDO_1 7
+#define PIN_TCK_1 8
+#define PIN_TMS_1 9
+#define PIN_TDI_2 10
+#define PIN_TDO_2 11
+#define PIN_TCK_2 14
+#define PIN_TMS_2 15
+#define PIN_TDI_3 0
+#define PIN_TDO_3 1
+#define PIN_TCK_3 2
+#define PIN_TMS_3 3
+
 #define LED_INVERTED   0
 #define PIN_LED_TX     25
 #define PIN_LED_ERROR  25
@@ -82,6 +96,12 @@
 #define PIN_UART1_TX    4
 #define PIN_UART1_RX    5
 
+// PIO UARTs, see PIO_UART_COUNT
+#define PIN_PIO_UART0_TX 26
+#define PIN_PIO_UART0_RX 27
+#define PIN_PIO_UART1_TX 28
+#define PIN_PIO_UART1_RX 22
+
 #elif ( BOARD_TYPE == BOARD_ADAFRUIT_ITSY )
 
 #define PIN_TDI 28 
@@ -190,4 +210,109 @@
 
 #endif // BOARD_TYPE
 
+// JTAG chains, up to 4, CMD_CHAIN selecting the one the commands go to. Each has two state
+// machines (chains 0 and 1 on pio0, 2 and 3 on pio1), DMA channels and a TCK of its own.
+// Chain 0 uses the pins above, chain n PIN_TDI_n, PIN_TDO_n, PIN_TCK_n and PIN_TMS_n, without
+// RST, TRST nor RTCK. Set from CMake with DIRTYJTAG_CHAIN_COUNT.
+#ifndef JTAG_CHAIN_COUNT
+#define JTAG_CHAIN_COUNT 1
+#endif
+#if ( JTAG_CHAIN_COUNT > 1 ) && !defined(PIN_TMS_1)
+#error "the pins of chain 1 are not defined"
+#endif
+#if ( JTAG_CHAIN_COUNT > 2 ) && !defined(PIN_TMS_2)
+#error "the pins of chain 2 are not defined"
+#endif
+#if ( JTAG_CHAIN_COUNT > 3 ) && !defined(PIN_TMS_3)
+#error "the pins of chain 3 are not defined"
+#endif
+
+// USB-CDC-UART bridges on PIO UARTs, up to 2, after the CDC_UART_INTF_COUNT ones on the PL011s.
+// They are 8N1 only, at any baud rate up to clk_sys / 8. Each takes two of the state machines of
+// pio1 (which chains 2 and 3 take first) and two DMA channels. PIO UART n uses PIN_PIO_UARTn_TX
+// and PIN_PIO_UARTn_RX. Set from CMake with DIRTYJTAG_PIO_UART_COUNT.
+#ifndef PIO_UART_COUNT
+#define PIO_UART_COUNT 0
+#endif
+#if ( PIO_UART_COUNT > 0 ) && !defined(PIN_PIO_UART0_TX)
+#error "the pins of PIO UART 0 are not defined"
+#endif
+#if ( PIO_UART_COUNT > 1 ) && !defined(PIN_PIO_UART1_TX)
+#error "the pins of PIO UART 1 are not defined"
+#endif
+#if ( PIO_UART_COUNT + ( JTAG_CHAIN_COUNT > 2 ? JTAG_CHAIN_COUNT - 2 : 0 ) > 2 )
+#error "pio1 has state machines for two of chains 2 and 3 and the PIO UARTs together"
+#endif
+
+// USB-CDC-UART bridges, CDC interface n on PL011 n then on PIO UART n - CDC_UART_INTF_COUNT
+#define CDC_INTF_COUNT ( CDC_UART_INTF_COUNT + PIO_UART_COUNT )
+#if ( 2 * JTAG_CHAIN_COUNT + 2 * CDC_INTF_COUNT > 12 )
+#error "the RP2040 has 12 DMA channels, two per chain and two per UART bridge"
+#endif
+
+// GPIO the target returns TCK on for adaptive clocking (CMD_FREQ at 0 kHz), 255 when not wired.
+// Set from CMake with DIRTYJTAG_PIN_RTCK.
+#ifndef PIN_RTCK
+#define PIN_RTCK 255
+#endif
+#if ( PIO_UART_COUNT > 1 ) && ( PIN_RTCK == PIN_PIO_UART1_RX || PIN_RTCK == PIN_PIO_UART1_TX )
+#error "RTCK and PIO UART 1 share a pin"
+#endif
+#if ( PIO_UART_COUNT > 0 ) && ( PIN_RTCK == PIN_PIO_UART0_RX || PIN_RTCK == PIN_PIO_UART0_TX )
+#error "RTCK and PIO UART 0 share a pin"
+#endif
+
+// clk_sys at boot, and the highest one CMD_FREQ may switch to when that gives the TCK asked for
+// more closely, in MHz. Set from CMake with DIRTYJTAG_SYS_CLK_MHZ and DIRTYJTAG_SYS_CLK_MAX_MHZ.
+// When clk_sys may leave the boot default, clk_peri moves to the USB PLL so that the UARTs keep
+// their baud rates, otherwise it stays on clk_sys. The flash of most boards takes clk_sys / 2,
+// keep it within its limit (133 MHz for a W25Q16).
+#ifndef SYS_CLK_MHZ
+#define SYS_CLK_MHZ 125
+#endif
+#ifndef SYS_CLK_MAX_MHZ
+#define SYS_CLK_MAX_MHZ SYS_CLK_MHZ
+#endif
+
+// Slots of the queues between core0 and core1, powers of 2. Set from CMake with
+// DIRTYJTAG_PACKET_QUEUE_DEPTH and DIRTYJTAG_RESPONSE_QUEUE_DEPTH.
+// OUT packets received and waiting for core1
+#ifndef PACKET_QUEUE_DEPTH
+#define PACKET_QUEUE_DEPTH 4
+#endif
+// IN buffers filled by core1 and waiting for or on the wire
+#ifndef RESPONSE_QUEUE_DEPTH
+#define RESPONSE_QUEUE_DEPTH 2
+#endif
+// Bytes of the OUT stream taken at once from the vendor RX FIFO into a packet slot
+#ifndef PACKET_BUFFER_SIZE
+#define PACKET_BUFFER_SIZE 256
+#endif
+// Command macros of CMD_MACRO: number of IDs, bytes of RAM shared by their bodies
+#ifndef MACRO_COUNT
+#define MACRO_COUNT 32
+#endif
+#ifndef MACRO_POOL_SIZE
+#define MACRO_POOL_SIZE 4096
+#endif
+// Bytes of the longest XSVF vector (XSDRSIZE or XSIR length) CMD_XSVF can play
+#ifndef XSVF_VECTOR_SIZE
+#define XSVF_VECTOR_SIZE 4096
+#endif
+// Bytes of the window the packed TDI of CMD_LONGXFER refers back to, a power of 2
+#ifndef PACK_WINDOW_SIZE
+#define PACK_WINDOW_SIZE 2048
+#endif
+// TCK tuning of CMD_FREQ: first TCK in kHz, percent faster at each step, percent kept below
+// the fastest TCK without a bit error
+#ifndef TCK_TUNE_MIN_KHZ
+#define TCK_TUNE_MIN_KHZ 1000
+#endif
+#ifndef TCK_TUNE_STEP
+#define TCK_TUNE_STEP 10
+#endif
+#ifndef TCK_TUNE_MARGIN
+#define TCK_TUNE_MARGIN 20
+#endif
+
 #endif // DirtyJtagConfig_h
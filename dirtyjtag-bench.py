@@ -0,0 +1,336 @@
+"""Throughput and latency benchmark of the DirtyJTAG protocol.
+
+Sweeps workloads, CMD_FREQ settings and packet fill levels on a probe and
+reports, for each combination, the sustained Mbit/s of a pipelined stream
+of packets and the round trip time of single commands:
+
+    python dirtyjtag-bench.py --freq 1000,6000,15000 --fill 16,32,64 -o results.jsonl
+    python dirtyjtag-bench.py --sim build/host/dirtyjtag_pipe --sim-args="-t 2" -o results.jsonl
+    python dirtyjtag-bench.py --compare before.jsonl after.jsonl
+
+The probe is the one on USB (libusb1), or with --sim the host-native build of
+the firmware behind host/dirtyjtag_pipe, which also reports the TCK cycles and
+the modelled CPU and PIO time: its modelled Mbit/s compare firmware revisions
+without depending on the speed of the machine.
+
+Workloads:
+    xfer_read    one XFER filling the packet, TDO read back
+    xfer_noread  the same, NO_READ
+    clk          CMD_CLK runs of 255 pulses
+    svf          SVF-like DR scans: TMS vector to Shift-DR, XFER read back, TMS vector to Idle
+
+Results are JSON lines (or CSV with --csv), one per workload, frequency and fill.
+"""
+
+import argparse
+import csv
+import json
+import struct
+import subprocess
+import sys
+import time
+
+VID = 0x1209
+PID = 0xC0CA
+EP_OUT = 0x01
+EP_IN  = 0x82
+PACKET_SIZE = 64
+TIMEOUT_MS = 2000
+
+CMD_STOP = 0x00
+CMD_INFO = 0x01
+CMD_FREQ = 0x02
+CMD_XFER = 0x03
+CMD_GETSIG = 0x05
+CMD_CLK = 0x06
+STREAM_MODE = 0x80
+NO_READ = 0x80
+EXTEND_LENGTH = 0x40
+TMS_VECTOR = 0x40
+REAL_FREQ = 0x80
+SIG_TDI = 1 << 2
+SIG_TMS = 1 << 4
+
+# Packets with responses in flight, about what the queues of the firmware hold
+WINDOW = 2
+
+
+class UsbProbe:
+    def __init__(self):
+        import usb1
+        self.usb1 = usb1
+        self.ctx = usb1.USBContext()
+        self.handle = self.ctx.openByVendorIDAndProductID(VID, PID, skip_on_error=True)
+        if self.handle is None:
+            sys.exit("Device not found")
+        self.handle.claimInterface(0)
+
+    def write(self, data):
+        self.handle.bulkWrite(EP_OUT, bytes(data))
+
+    def read(self):
+        try:
+            return bytes(self.handle.bulkRead(EP_IN, PACKET_SIZE, timeout=TIMEOUT_MS))
+        except self.usb1.USBErrorTimeout:
+            return None
+
+    def reset_stats(self):
+        pass
+
+    def stats(self):
+        return None
+
+    def close(self):
+        self.handle.releaseInterface(0)
+
+
+class SimProbe:
+    """host/dirtyjtag_pipe, see the requests it takes there"""
+
+    STATS = ("tck_cycles", "pio_cycles", "pio_sys_cycles", "cpu_cycles", "usb_out_packets",
+             "usb_out_bytes", "usb_in_packets", "usb_in_bytes", "sys_clk_hz", "tck_hz")
+
+    def __init__(self, path, args):
+        self.proc = subprocess.Popen([path] + args, stdin=subprocess.PIPE, stdout=subprocess.PIPE)
+
+    def _get(self, n):
+        data = self.proc.stdout.read(n)
+        if len(data) != n:
+            sys.exit("the simulator stopped")
+        return data
+
+    def _request(self, data):
+        self.proc.stdin.write(data)
+        self.proc.stdin.flush()
+
+    def write(self, data):
+        self._request(b"W" + struct.pack("<I", len(data)) + bytes(data))
+
+    def read(self):
+        self._request(b"R" + struct.pack("<I", TIMEOUT_MS))
+        n = struct.unpack("<i", self._get(4))[0]
+        return self._get(n) if n >= 0 else None
+
+    def reset_stats(self):
+        self._request(b"I")
+        self._get(1)
+        self._request(b"Z")
+        self._get(1)
+
+    def stats(self):
+        self._request(b"I")
+        self._get(1)
+        self._request(b"S")
+        count = struct.unpack("<I", self._get(4))[0]
+        values = struct.unpack(f"<{count}Q", self._get(8 * count))
+        return dict(zip(self.STATS, values))
+
+    def close(self):
+        self.proc.stdin.close()
+        self.proc.wait()
+
+
+class Reader:
+    """Collects response bytes, an IN packet can hold the end of one response and the start of the next"""
+
+    def __init__(self, probe):
+        self.probe = probe
+        self.buffered = b""
+
+    def take(self, n):
+        while len(self.buffered) < n:
+            data = self.probe.read()
+            if data is None:
+                sys.exit(f"timeout, {n - len(self.buffered)} response bytes missing")
+            self.buffered += data
+        data, self.buffered = self.buffered[:n], self.buffered[n:]
+        return data
+
+
+def xfer(data, read):
+    bits = 8 * len(data)
+    cmd = CMD_XFER | (EXTEND_LENGTH if bits > 255 else 0) | (0 if read else NO_READ)
+    return bytes([cmd, bits & 0xFF]) + bytes(data)
+
+
+def tms_vector(tms_bits):
+    """CMD_CLK with TMS_VECTOR, the bits MSB first"""
+    value = 0
+    for b in tms_bits:
+        value = value * 2 + b
+    value <<= 8 - len(tms_bits)
+    return bytes([CMD_CLK | TMS_VECTOR, 0, len(tms_bits), value])
+
+
+# Each workload gives, for a fill level, one packet: its bytes, the response length and the TCK cycles
+def workload_xfer_read(fill):
+    n = min(fill - 2, 62)
+    return xfer(bytes((0xA5 ^ i) & 0xFF for i in range(n)), True), n, 8 * n
+
+
+def workload_xfer_noread(fill):
+    n = min(fill - 2, 62)
+    return xfer(bytes((0xA5 ^ i) & 0xFF for i in range(n)), False), 0, 8 * n
+
+
+def workload_clk(fill):
+    n = max(fill // 3, 1)
+    return bytes([CMD_CLK, 0, 255] * n), 0, 255 * n
+
+
+def workload_svf(fill):
+    n = max(min(fill - 10, 62), 1)
+    packet = tms_vector([1, 0, 0]) + xfer(bytes(n), True) + tms_vector([1, 1, 0])
+    return packet, n, 6 + 8 * n
+
+
+WORKLOADS = {
+    "xfer_read": workload_xfer_read,
+    "xfer_noread": workload_xfer_noread,
+    "clk": workload_clk,
+    "svf": workload_svf,
+}
+
+
+def set_freq(probe, reader, khz):
+    probe.write(bytes([CMD_FREQ | REAL_FREQ, khz >> 8, khz & 0xFF, CMD_STOP]))
+    return struct.unpack(">I", reader.take(4))[0]
+
+
+def fence(probe, reader):
+    """Everything sent before has been executed once this returns"""
+    probe.write(bytes([CMD_GETSIG, CMD_STOP]))
+    reader.take(1)
+
+
+def throughput(probe, reader, packet, response, packets):
+    expected = []
+    probe.reset_stats()
+    start = time.perf_counter()
+    for _ in range(packets):
+        probe.write(packet)
+        expected.append(response)
+        while len(expected) > WINDOW:
+            reader.take(expected.pop(0))
+    for n in expected:
+        reader.take(n)
+    fence(probe, reader)
+    return time.perf_counter() - start, probe.stats()
+
+
+def latency(probe, reader, packet, response, probes):
+    """Round trip of one packet, the GETSIG after it makes sure there is an answer to wait for"""
+    times = []
+    for _ in range(probes):
+        start = time.perf_counter()
+        probe.write(packet + bytes([CMD_GETSIG, CMD_STOP]))
+        reader.take(response + 1)
+        times.append((time.perf_counter() - start) * 1e6)
+    times.sort()
+    return {f"latency_us_p{p}": round(times[min(len(times) - 1, len(times) * p // 100)], 1) for p in (50, 90, 99)} \
+        | {"latency_us_max": round(times[-1], 1)}
+
+
+def run(args):
+    probe = SimProbe(args.sim, args.sim_args.split()) if args.sim else UsbProbe()
+    reader = Reader(probe)
+    probe.write(bytes([CMD_INFO, CMD_STOP]))
+    firmware = reader.take(10).rstrip(b"\0\n").decode(errors="replace")
+    # measure the stream of commands, not the packets one at a time
+    probe.write(bytes([CMD_STOP | STREAM_MODE]))
+    # reset the TAPs, the svf scans start from Run-Test/Idle
+    probe.write(tms_vector([1, 1, 1, 1, 1, 0]) + bytes([CMD_STOP]))
+
+    results = []
+    for khz in args.freq:
+        tck_hz = set_freq(probe, reader, khz)
+        for name in args.workload:
+            for fill in args.fill:
+                packet, response, bits = WORKLOADS[name](fill)
+                seconds, stats = throughput(probe, reader, packet, response, args.packets)
+                r = {
+                    "transport": "sim" if args.sim else "usb",
+                    "firmware": firmware,
+                    "workload": name,
+                    "freq_khz": khz,
+                    "tck_hz": tck_hz,
+                    "fill": len(packet),
+                    "packets": args.packets,
+                    "bits": bits * args.packets,
+                    "seconds": round(seconds, 6),
+                    "mbps": round(bits * args.packets / seconds / 1e6, 3),
+                }
+                if stats:
+                    modelled_s = (stats["pio_sys_cycles"] + stats["cpu_cycles"]) / stats["sys_clk_hz"]
+                    r["modelled_mbps"] = round(stats["tck_cycles"] / modelled_s / 1e6, 3) if modelled_s else 0
+                    r["cpu_cycles_per_packet"] = round(stats["cpu_cycles"] / args.packets, 1)
+                r.update(latency(probe, reader, packet, response, args.probes))
+                results.append(r)
+                print(f"{name:<12} {khz:>6} kHz fill {len(packet):>2}: {r['mbps']:8.3f} Mbit/s"
+                      + (f" (modelled {r['modelled_mbps']:.3f})" if stats else "")
+                      + f", round trip {r['latency_us_p50']} us", file=sys.stderr)
+    probe.close()
+    return results
+
+
+def write_results(results, output, as_csv):
+    out = open(output, "w", newline="") if output else sys.stdout
+    if as_csv:
+        fields = list(dict.fromkeys(k for r in results for k in r))
+        writer = csv.DictWriter(out, fieldnames=fields)
+        writer.writeheader()
+        writer.writerows(results)
+    else:
+        for r in results:
+            out.write(json.dumps(r) + "\n")
+    if output:
+        out.close()
+
+
+def compare(before_path, after_path):
+    def load(path):
+        with open(path) as f:
+            return {(r["workload"], r["freq_khz"], r["fill"]): r for r in map(json.loads, f) if r}
+
+    before, after = load(before_path), load(after_path)
+    key = "modelled_mbps" if all("modelled_mbps" in r for r in list(before.values()) + list(after.values())) else "mbps"
+    print(f"{'workload':<12} {'kHz':>6} {'fill':>4} {key:>14} {'change':>8} {'p50 us':>16}")
+    for k in sorted(before.keys() & after.keys()):
+        b, a = before[k], after[k]
+        change = (a[key] / b[key] - 1) * 100 if b[key] else 0
+        print(f"{k[0]:<12} {k[1]:>6} {k[2]:>4} {b[key]:>6.3f} -> {a[key]:<6.3f} {change:>+7.1f}% "
+              f"{b['latency_us_p50']:>7} -> {a['latency_us_p50']:<7}")
+
+
+def int_list(text):
+    return [int(v) for v in text.split(",")]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="DirtyJTAG protocol benchmark")
+    parser.add_argument("--sim", metavar="DIRTYJTAG_PIPE", help="run against the simulator, path of host/dirtyjtag_pipe")
+    parser.add_argument("--sim-args", default="", help="options of dirtyjtag_pipe, e.g. \"-t 2\" for a TAP chain")
+    parser.add_argument("--freq", type=int_list, default=[1000, 6000, 15000], help="CMD_FREQ settings, kHz")
+    parser.add_argument("--fill", type=int_list, default=[16, 32, 64], help="bytes used of each 64 byte packet")
+    parser.add_argument("--workload", type=lambda s: s.split(","), default=list(WORKLOADS),
+                        help="among " + ", ".join(WORKLOADS))
+    parser.add_argument("--packets", type=int, default=1000, help="packets streamed per measurement")
+    parser.add_argument("--probes", type=int, default=100, help="round trips timed per measurement")
+    parser.add_argument("-o", "--output", help="results file, stdout by default")
+    parser.add_argument("--csv", action="store_true", help="CSV instead of JSON lines")
+    parser.add_argument("--compare", nargs=2, metavar=("BEFORE", "AFTER"), help="compare two JSON lines results")
+    args = parser.parse_args()
+
+    if args.compare:
+        compare(*args.compare)
+        return
+    for name in args.workload:
+        if name not in WORKLOADS:
+            sys.exit(f"unknown workload {name}")
+    if any(f < 11 or f > PACKET_SIZE for f in args.fill):
+        sys.exit(f"fill levels go from 11 to {PACKET_SIZE} bytes")
+    write_results(run(args), args.output, args.csv)
+
+
+if __name__ == "__main__":
+    main()
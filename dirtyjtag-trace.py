@@ -0,0 +1,150 @@
+"""Command trace of a DirtyJTAG probe, as per-stage latency histograms.
+
+    python dirtyjtag-trace.py start             empty the trace ring and start recording
+    python dirtyjtag-trace.py dump [-o file]    read the ring back (and save it), print the histograms
+    python dirtyjtag-trace.py stop
+    python dirtyjtag-trace.py show file         print the histograms of a saved dump
+
+Start the trace, run the programming tool, then dump: the ring keeps the last
+records (TRACE_RECORDS in trace.h) and counts the ones it overwrote.
+host/dirtyjtag_bench -d file trace saves a dump made on the simulator.
+"""
+
+import argparse
+import struct
+import sys
+
+VID = 0x1209
+PID = 0xC0CA
+EP_OUT = 0x01
+EP_IN  = 0x82
+
+CMD_STATS = 0x0F
+TRACE = 0x40
+TRACE_OFF, TRACE_ON, TRACE_DUMP = 0, 1, 2
+TRACE_DATA = 0x01
+
+HEADER = struct.Struct(">HI")
+RECORD = struct.Struct(">BBBxIIIII")
+
+CMD_NAMES = {
+    0x0: "STOP", 0x1: "INFO", 0x2: "FREQ", 0x3: "XFER", 0x4: "SETSIG",
+    0x5: "GETSIG", 0x6: "CLK", 0x7: "SETVOLTAGE", 0x8: "GOTOBOOTLOADER",
+    0x9: "LONGXFER", 0xA: "VERIFY", 0xB: "POLL", 0xC: "MACRO", 0xD: "XSVF",
+    0xE: "CHAIN", 0xF: "STATS",
+}
+
+
+def wrap(delta):
+    """Difference of two 32 bit timer values"""
+    return delta & 0xFFFFFFFF
+
+
+def probe_command(data, answer=False):
+    import usb1
+    ctx = usb1.USBContext()
+    handle = ctx.openByVendorIDAndProductID(VID, PID, skip_on_error=True)
+    if handle is None:
+        sys.exit("Device not found")
+    with handle.claimInterface(0):
+        handle.bulkWrite(EP_OUT, bytes(data))
+        if not answer:
+            return b""
+        dump = bytes(handle.bulkRead(EP_IN, 64, timeout=1000))
+        count = struct.unpack_from(">H", dump)[0]
+        length = HEADER.size + RECORD.size * count
+        while len(dump) < length:
+            dump += bytes(handle.bulkRead(EP_IN, 64, timeout=1000))
+        return dump[:length]
+
+
+def parse(dump):
+    count, dropped = HEADER.unpack_from(dump)
+    records = []
+    for k in range(count):
+        cmd, flags, chain, bits, received, start, shifted, queued = \
+            RECORD.unpack_from(dump, HEADER.size + RECORD.size * k)
+        records.append(dict(cmd=cmd, flags=flags, chain=chain, bits=bits, received=received,
+                            start=start, shifted=shifted, queued=queued))
+    return records, dropped
+
+
+def histogram(title, values):
+    print(f"{title}: {len(values)} samples", end="")
+    if not values:
+        print()
+        return
+    values = sorted(values)
+    print(f", min {values[0]} us, median {values[len(values) // 2]} us, max {values[-1]} us")
+    # power of 2 buckets, in us
+    buckets = {}
+    for v in values:
+        b = v.bit_length()
+        buckets[b] = buckets.get(b, 0) + 1
+    most = max(buckets.values())
+    for b in range(min(buckets), max(buckets) + 1):
+        low = 0 if b == 0 else 1 << (b - 1)
+        high = (1 << b) - 1
+        n = buckets.get(b, 0)
+        print(f"  {low:>8}-{high:<8} us {n:>7} {'#' * ((n * 50 + most - 1) // most)}")
+
+
+def show(dump):
+    records, dropped = parse(dump)
+    print(f"{len(records)} records, {dropped} overwritten before them")
+    if not records:
+        return
+
+    # USB arrival gaps: between the OUT reads, commands of the same read share its time
+    arrivals = []
+    for r in records:
+        if not arrivals or arrivals[-1] != r["received"]:
+            arrivals.append(r["received"])
+    histogram("USB arrival gaps", [wrap(b - a) for a, b in zip(arrivals, arrivals[1:])])
+    histogram("received to executing (queueing to core1)", [wrap(r["start"] - r["received"]) for r in records])
+    histogram("executing to shifted (PIO and DMA)", [wrap(r["shifted"] - r["start"]) for r in records])
+    queued = [r for r in records if r["queued"]]
+    histogram("shifted to response queued (flush)", [wrap(r["queued"] - r["shifted"]) for r in queued])
+    histogram("received to response queued", [wrap(r["queued"] - r["received"]) for r in queued])
+
+    print("by command:")
+    kinds = {}
+    for r in records:
+        name = CMD_NAMES[r["cmd"] & 0x0F] + (" data" if r["flags"] & TRACE_DATA else "")
+        k = kinds.setdefault(name, [0, 0, 0])
+        k[0] += 1
+        k[1] += r["bits"]
+        k[2] += wrap(r["shifted"] - r["start"])
+    for name, (n, bits, us) in sorted(kinds.items(), key=lambda kv: -kv[1][2]):
+        rate = f"{bits / us:.2f} Mbit/s" if us else "-"
+        print(f"  {name:<16} {n:>7} commands {bits:>10} bits {us:>9} us executing  {rate}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="DirtyJTAG command trace")
+    sub = parser.add_subparsers(dest="action", required=True)
+    sub.add_parser("start")
+    sub.add_parser("stop")
+    dump = sub.add_parser("dump")
+    dump.add_argument("-o", "--output", help="save the dump to this file")
+    show_parser = sub.add_parser("show")
+    show_parser.add_argument("file")
+    args = parser.parse_args()
+
+    if args.action == "start":
+        probe_command([CMD_STATS | TRACE, TRACE_ON, 0x00])
+    elif args.action == "stop":
+        probe_command([CMD_STATS | TRACE, TRACE_OFF, 0x00])
+    elif args.action == "dump":
+        data = probe_command([CMD_STATS | TRACE, TRACE_DUMP, 0x00], answer=True)
+        if args.output:
+            with open(args.output, "wb") as f:
+                f.write(data)
+        show(data)
+    else:
+        with open(args.file, "rb") as f:
+            show(f.read())
+
+
+if __name__ == "__main__":
+    main()
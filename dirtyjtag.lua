@@ -19,10 +19,18 @@ local cmd_names = {
     [0x5] = "CMD_GETSIG",
     [0x6] = "CMD_CLK",
     [0x7] = "CMD_SETVOLTAGE",
-    [0x8] = "CMD_GOTOBOOTLOADER"
+    [0x8] = "CMD_GOTOBOOTLOADER",
+    [0x9] = "CMD_LONGXFER",
+    [0xA] = "CMD_VERIFY",
+    [0xB] = "CMD_POLL",
+    [0xC] = "CMD_MACRO",
+    [0xD] = "CMD_XSVF",
+    [0xE] = "CMD_CHAIN",
+    [0xF] = "CMD_STATS"
 }
 
 -- Logger state
+local macro_params = {} -- parameter bytes of a run of each macro, from its definition
 local events = {}
 local pending_out = {}
 --local processed_frames = {}
@@ -43,15 +51,92 @@ local function merge_in(ev_in)
         local needed = 0
         table.remove(pending_out, 1)
         if idx <= #tdo_bits then
-            if out_ev.cmd == 0x3 and not out_ev.noread then
+            if (out_ev.cmd == 0x3 and not out_ev.noread)
+                or (out_ev.cmd == 0x6 and out_ev.readout and out_ev.tms_bits) then
                 needed = out_ev.cycles  -- bit_len
                 out_ev.tdo = {}
+                if out_ev.lsb then
+                    -- LSB_FIRST: the bits of each byte come back in the other order
+                    for c = 0, needed - 1 do
+                        local k = idx + c - c % 8 + 7 - c % 8
+                        if k > #tdo_bits then break end
+                        table.insert(out_ev.tdo, tdo_bits[k])
+                    end
+                    idx = idx + needed
+                else
+                    for c = 1, needed do
+                        if idx > #tdo_bits then break end
+                        table.insert(out_ev.tdo, tdo_bits[idx])
+                        idx = idx + 1
+                    end
+                end
+
+            elseif out_ev.cmd == 0xA then
+                -- first mismatching bit, 16 bits big endian, 0xFFFF when all match
+                local val = 0
+                for j = 0,15 do
+                    val = val * 2 + (tdo_bits[idx+j] or 0)
+                end
+                out_ev.mismatch = val
+                idx = idx + 16
+            elseif out_ev.cmd == 0xB then
+                -- number of scans, 16 bits big endian, then the TDO of the last one
+                local val = 0
+                for j = 0,15 do
+                    val = val * 2 + (tdo_bits[idx+j] or 0)
+                end
+                out_ev.scans = val
+                idx = idx + 16
+                needed = out_ev.cycles
+                out_ev.tdo = {}
                 for c = 1, needed do
                     if idx > #tdo_bits then break end
                     table.insert(out_ev.tdo, tdo_bits[idx])
                     idx = idx + 1
                 end
-
+            elseif out_ev.cmd == 0x2 and out_ev.real_freq then
+                -- TCK set, in Hz, 32 bits big endian
+                local val = 0
+                for j = 0,31 do
+                    val = val * 2 + (tdo_bits[idx+j] or 0)
+                end
+                out_ev.real_hz = val
+                idx = idx + 32
+            elseif out_ev.cmd == 0x2 and out_ev.autotune then
+                -- fastest TCK without error then TCK set, in Hz, 32 bits big endian each
+                local clean, val = 0, 0
+                for j = 0,31 do
+                    clean = clean * 2 + (tdo_bits[idx+j] or 0)
+                    val = val * 2 + (tdo_bits[idx+32+j] or 0)
+                end
+                out_ev.clean_hz = clean
+                out_ev.real_hz = val
+                idx = idx + 64
+            elseif out_ev.cmd == 0xE then
+                -- number of chains
+                local val = 0
+                for j = 0,7 do
+                    val = val * 2 + (tdo_bits[idx+j] or 0)
+                end
+                out_ev.chains = val
+                idx = idx + 8
+            elseif out_ev.cmd == 0xF and out_ev.trace then
+                -- number of records (16 bits), overwritten ones (32 bits), then 24 bytes a record
+                local records = 0
+                for j = 0,15 do
+                    records = records * 2 + (tdo_bits[idx+j] or 0)
+                end
+                idx = idx + 48 + 192 * records
+            elseif out_ev.cmd == 0xF then
+                -- number of 32 bit counters, then the counters
+                local words = 0
+                for j = 0,7 do
+                    words = words * 2 + (tdo_bits[idx+j] or 0)
+                end
+                idx = idx + 8 + 32 * words
+            elseif out_ev.cmd == 0xC then
+                -- what a macro run answers depends on its body: give up on the rest
+                idx = #tdo_bits + 1
             elseif (out_ev.cmd == 0x6 and out_ev.readout)
                 or (out_ev.cmd == 0x5) then
                 -- Only one TDO bit: derived from the whole byte
@@ -149,13 +234,25 @@ local function write_vcd(filename)
                 -- drive TDI/TMS at start of cycle
                 f:write("#" .. (time +25) .. "\n")
                 f:write((ev.tdi and "1" or "0") .. vcd_ids.TDI .. "\n")
-                f:write((ev.tms and "1" or "0") .. vcd_ids.TMS .. "\n")
+                if ev.tms_bits then
+                    f:write((ev.tms_bits[c]==0 and "0" or "1") .. vcd_ids.TMS .. "\n")
+                else
+                    f:write((ev.tms and "1" or "0") .. vcd_ids.TMS .. "\n")
+                end
 
                 -- rising edge
                 f:write("#" .. (time + 50) .. "\n1" .. vcd_ids.CLK .. "\n")
 
+                -- TMS vector READOUT logs TDO on every cycle
+                if readout and ev.tms_bits then
+                    f:write("#" .. (time + 75) .. "\n")
+                    if ev.tdo and ev.tdo[c] ~= nil then
+                        f:write((ev.tdo[c]==0 and "0" or "1") .. vcd_ids.TDO .. "\n")
+                    else
+                        f:write("x" .. vcd_ids.TDO .. "\n")
+                    end
                 -- only log TDO on the last cycle if READOUT
-                if readout and c == cycles then
+                elseif readout and c == cycles then
                     f:write("#" .. (time + 75) .. "\n")
                     if ev.tdo and ev.tdo[1] ~= nil then
                         f:write((ev.tdo[1]==0 and "0" or "1") .. vcd_ids.TDO .. "\n")
@@ -303,10 +400,20 @@ function dirtyjtag.dissector(buffer, pinfo, tree)
                             readout and " [READOUT]" or "").. " cycles=" ..cycles)
                     offset = offset + 2
 
+                    -- TMS_VECTOR modifier (bit 0x40): one TMS bit per cycle follows, MSB first
+                    local tms_bits = nil
+                    if bit.band(cmd_val, 0x40) ~= 0 then
+                        local byte_len = math.ceil(cycles/8)
+                        if buffer:len() < offset+byte_len then return false end
+                        tms_bits = decode_bitstream(buffer(offset, byte_len), cycles)
+                        cmd_item:add(f_payload, buffer(offset, byte_len)):append_text(" (TMS vector)")
+                        offset = offset + byte_len
+                    end
+
                     table.insert(pending_out, {
                         dir="OUT", cmd=base_cmd,
                         txn=seqno, seq = pinfo.number,
-                        tms=tms, tdi=tdi,
+                        tms=tms, tdi=tdi, tms_bits=tms_bits,
                         cycles=cycles, readout=readout
                     })
                 end
@@ -328,10 +435,12 @@ function dirtyjtag.dissector(buffer, pinfo, tree)
                 if bit.band(cmd_val, 0x40) ~= 0 then bit_len = bit_len + 256 end
                 local byte_len = math.ceil(bit_len/8)
                 local noread   = bit.band(cmd_val, 0x80) ~= 0
+                -- LSB_FIRST modifier (bit 0x20): each byte is shifted from bit 0
+                local lsb      = bit.band(cmd_val, 0x20) ~= 0
 
                 cmd_item:append_text(string.format(
-                    " length=%d bits (%d bytes)%s",
-                    bit_len, byte_len, noread and " [NOREAD]" or ""))
+                    " length=%d bits (%d bytes)%s%s",
+                    bit_len, byte_len, noread and " [NOREAD]" or "", lsb and " [LSB]" or ""))
 
                 if buffer:len() >= offset+byte_len then
                     local payload = buffer(offset, byte_len)
@@ -341,8 +450,9 @@ function dirtyjtag.dissector(buffer, pinfo, tree)
                     local tdi_bits = {}
                     for i=0, byte_len-1 do
                         local b = payload(i,1):uint()
-                        for j=7,0,-1 do
-                            table.insert(tdi_bits, bit.band(b, 1<<j) ~= 0 and 1 or 0)
+                        for j=0,7 do
+                            local k = lsb and j or 7 - j
+                            table.insert(tdi_bits, bit.band(b, 1<<k) ~= 0 and 1 or 0)
                         end
                     end
                     if #tdi_bits > bit_len then
@@ -360,11 +470,112 @@ function dirtyjtag.dissector(buffer, pinfo, tree)
                         dir="OUT", cmd=base_cmd, 
                         txn=seqno, seq = pinfo.number,
                         cycles=bit_len,
-                        noread=noread, tdi=tdi_bits
+                        noread=noread, lsb=lsb, tdi=tdi_bits
                     })
                 else
                     return false
                 end
+            elseif base_cmd == 0xA then -- CMD_VERIFY: TDI, expected TDO, mask
+                if buffer:len() < offset+1 then return false end
+                local bit_len = buffer(offset,1):uint()
+                offset = offset + 1
+                if bit.band(cmd_val, 0x40) ~= 0 then bit_len = bit_len + 256 end
+                local byte_len = math.ceil(bit_len/8)
+                local lsb      = bit.band(cmd_val, 0x20) ~= 0
+                cmd_item:append_text(string.format(
+                    " length=%d bits (%d bytes)%s", bit_len, byte_len, lsb and " [LSB]" or ""))
+                if buffer:len() < offset+3*byte_len then return false end
+                cmd_item:add(f_payload, buffer(offset, byte_len)):append_text(" (TDI)")
+                cmd_item:add(f_payload, buffer(offset+byte_len, byte_len)):append_text(" (expected TDO)")
+                cmd_item:add(f_payload, buffer(offset+2*byte_len, byte_len)):append_text(" (mask)")
+                offset = offset + 3*byte_len
+                table.insert(pending_out, {dir="OUT", cmd=base_cmd, txn=seqno, seq = pinfo.number})
+            elseif base_cmd == 0xB then -- CMD_POLL: limits, TDI, expected TDO, mask
+                if buffer:len() < offset+5 then return false end
+                local bit_len = buffer(offset,1):uint()
+                if bit.band(cmd_val, 0x40) ~= 0 then bit_len = bit_len + 256 end
+                local byte_len = math.ceil(bit_len/8)
+                local tries    = buffer(offset+1,2):uint()
+                local timeout  = buffer(offset+3,2):uint()
+                offset = offset + 5
+                cmd_item:append_text(string.format(
+                    " length=%d bits tries=%d timeout=%d ms%s", bit_len, tries, timeout,
+                    bit.band(cmd_val, 0x20) ~= 0 and " [LSB]" or ""))
+                if buffer:len() < offset+3*byte_len then return false end
+                cmd_item:add(f_payload, buffer(offset, byte_len)):append_text(" (TDI)")
+                cmd_item:add(f_payload, buffer(offset+byte_len, byte_len)):append_text(" (expected TDO)")
+                cmd_item:add(f_payload, buffer(offset+2*byte_len, byte_len)):append_text(" (mask)")
+                offset = offset + 3*byte_len
+                table.insert(pending_out, {dir="OUT", cmd=base_cmd, txn=seqno, seq = pinfo.number, cycles=bit_len})
+            elseif base_cmd == 0xC then -- CMD_MACRO
+                if buffer:len() < offset+1 then return false end
+                local id = buffer(offset,1):uint()
+                offset = offset + 1
+                if bit.band(cmd_val, 0x80) ~= 0 then
+                    local params = macro_params[id] or 0
+                    cmd_item:append_text(string.format(" RUN id=%d", id))
+                    if buffer:len() < offset+params then return false end
+                    if params > 0 then
+                        cmd_item:add(f_payload, buffer(offset, params)):append_text(" (parameters)")
+                    end
+                    offset = offset + params
+                    table.insert(pending_out, {dir="OUT", cmd=base_cmd, txn=seqno, seq = pinfo.number})
+                elseif bit.band(cmd_val, 0x40) ~= 0 then
+                    cmd_item:append_text(string.format(" HITS id=%d", id))
+                else
+                    -- DEFINE: the slots and the body follow, maybe in the next packets
+                    if buffer:len() < offset+3 then return false end
+                    local slots  = buffer(offset,1):uint()
+                    local length = buffer(offset+1,2):uint()
+                    offset = offset + 3
+                    cmd_item:append_text(string.format(" DEFINE id=%d slots=%d body=%d bytes", id, slots, length))
+                    local params = 0
+                    for i = 0, slots-1 do
+                        if buffer:len() >= offset+3*i+3 then
+                            params = params + buffer(offset+3*i+2,1):uint()
+                        end
+                    end
+                    macro_params[id] = params
+                    local total = math.min(3*slots + length, buffer:len() - offset)
+                    if total > 0 then
+                        cmd_item:add(f_payload, buffer(offset, total)):append_text(" (slots and body)")
+                    end
+                    offset = offset + total
+                end
+            elseif base_cmd == 0xD then -- CMD_XSVF: the XSVF file follows, maybe in the next packets
+                if buffer:len() < offset+4 then return false end
+                local length = buffer(offset,4):uint()
+                offset = offset + 4
+                cmd_item:append_text(string.format(" length=%d bytes", length))
+                local here = math.min(length, buffer:len() - offset)
+                if here > 0 then
+                    cmd_item:add(f_payload, buffer(offset, here)):append_text(" (XSVF)")
+                end
+                offset = offset + here
+            elseif base_cmd == 0xE then -- CMD_CHAIN: the JTAG chain of the next commands
+                if buffer:len() < offset+1 then return false end
+                cmd_item:append_text(" chain=" .. buffer(offset,1):uint())
+                offset = offset + 1
+                -- CHAIN_COUNT modifier (bit 0x80): the number of chains comes back, one byte
+                if bit.band(cmd_val, 0x80) ~= 0 then
+                    cmd_item:append_text(" [CHAIN_COUNT]")
+                    table.insert(pending_out, {dir="OUT", cmd=base_cmd, txn=seqno, seq = pinfo.number})
+                end
+            elseif base_cmd == 0xF and bit.band(cmd_val, 0x40) ~= 0 then -- CMD_STATS with TRACE: trace ring operation
+                if buffer:len() < offset+1 then return false end
+                local op = buffer(offset,1):uint()
+                local op_names = { [0] = "TRACE_OFF", [1] = "TRACE_ON", [2] = "TRACE_DUMP" }
+                cmd_item:append_text(" [TRACE] " .. (op_names[op] or ("op=" .. op)))
+                offset = offset + 1
+                if op == 2 then
+                    table.insert(pending_out, {dir="OUT", cmd=base_cmd, txn=seqno, seq = pinfo.number, trace=true})
+                end
+            elseif base_cmd == 0xF then -- CMD_STATS: the counters come back
+                -- STATS_RESET modifier (bit 0x80): they restart from 0 once read
+                if bit.band(cmd_val, 0x80) ~= 0 then
+                    cmd_item:append_text(" [STATS_RESET]")
+                end
+                table.insert(pending_out, {dir="OUT", cmd=base_cmd, txn=seqno, seq = pinfo.number})
             elseif base_cmd == 0x5 then -- GETSIG
                 table.insert(pending_out, ev)
             elseif base_cmd < 0x2 then -- STOP and INFO
@@ -372,8 +583,25 @@ function dirtyjtag.dissector(buffer, pinfo, tree)
             elseif base_cmd == 0x2 then -- FREQ
                 if buffer:len() < offset+2 then return false end
                 local freq = buffer(offset,2):le_uint()
-                cmd_item:append_text(" Frequency=" .. freq .. " KHz")
+                if freq == 0 then
+                    cmd_item:append_text(" Frequency=RTCK")
+                else
+                    cmd_item:append_text(" Frequency=" .. freq .. " KHz")
+                end
                 offset = offset + 2
+                -- SAVE_FREQ modifier (bit 0x20): TCK used from the next boot on
+                if bit.band(cmd_val, 0x20) ~= 0 then
+                    cmd_item:append_text(" [SAVE_FREQ]")
+                end
+                -- AUTOTUNE modifier (bit 0x40): the frequency bounds a search, two TCKs come back in Hz
+                -- REAL_FREQ modifier (bit 0x80): the TCK set comes back in Hz
+                if bit.band(cmd_val, 0x40) ~= 0 then
+                    cmd_item:append_text(" [AUTOTUNE]")
+                    table.insert(pending_out, {dir="OUT", cmd=base_cmd, txn=seqno, seq = pinfo.number, autotune=true})
+                elseif bit.band(cmd_val, 0x80) ~= 0 then
+                    cmd_item:append_text(" [REAL_FREQ]")
+                    table.insert(pending_out, {dir="OUT", cmd=base_cmd, txn=seqno, seq = pinfo.number, real_freq=true})
+                end
 
             elseif base_cmd < 0x2 then -- STOP, INFO
                 -- no payload
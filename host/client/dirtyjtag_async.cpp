@@ -0,0 +1,182 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Streams XFERs through the pipelined client, once waiting for each response
+ * before sending the next command as the synchronous tools do, then with the
+ * responses collected by callbacks, and compares the two. A GETSIG and a
+ * CMD_CLK READOUT go between the XFERs, to check their responses are told
+ * apart, and with TDI looped back to TDO every TDO is checked against its TDI.
+ *
+ * Runs on the simulated probe, or with -u on the one on USB (when built with
+ * libusb), TDI wired to TDO for -l.
+ *
+ * usage: dirtyjtag_async [-n xfers] [-d depth] [-f freq_khz] [-u] [-l]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "dirtyjtag_client.h"
+
+using namespace dirtyjtag;
+
+/* Bytes of TDI per XFER, one packet's worth */
+#define XFER_BYTES 62
+
+static std::atomic<unsigned> mismatches;
+static std::atomic<unsigned> failures;
+
+static void fill(uint8_t *tdi, unsigned i)
+{
+    for (unsigned j = 0; j < XFER_BYTES; j++)
+        tdi[j] = (uint8_t)(i * 7 + j * 13);
+}
+
+static void check(const uint8_t *tdi, int status, const Bytes &tdo, bool loopback)
+{
+    if (status)
+        failures++;
+    else if (loopback && Bytes(tdi, tdi + XFER_BYTES) != tdo)
+        mismatches++;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::unique_ptr<Transport> open_transport(bool usb)
+{
+#ifdef DIRTYJTAG_CLIENT_USB
+    if (usb)
+        return open_usb();
+#else
+    if (usb)
+    {
+        fprintf(stderr, "built without libusb\n");
+        exit(2);
+    }
+#endif
+    return open_loopback();
+}
+
+int main(int argc, char **argv)
+{
+    unsigned n = 2000, depth = 4, freq_khz = 15000;
+    bool usb = false, loopback = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:d:f:ul")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            depth = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            freq_khz = strtoul(optarg, NULL, 0);
+            break;
+        case 'u':
+            usb = true;
+            loopback = false;
+            break;
+        case 'l':
+            loopback = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n xfers] [-d depth] [-f freq_khz] [-u] [-l]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<uint8_t> tdi(XFER_BYTES * n);
+    for (unsigned i = 0; i < n; i++)
+        fill(&tdi[XFER_BYTES * i], i);
+    double sync_s, async_s;
+    unsigned clk_readouts = 0, getsigs = 0;
+
+    try
+    {
+        Client client(open_transport(usb), depth);
+
+        Bytes info = client.info().get();
+        Bytes hz = client.freq(freq_khz).get();
+        std::string version(info.begin(), info.end());
+        printf("%s, TCK %u Hz, %u XFERs of %u bytes, depth %u\n", version.substr(0, version.find('\n')).c_str(),
+               (unsigned)hz[0] << 24 | hz[1] << 16 | hz[2] << 8 | hz[3], n, XFER_BYTES, depth);
+
+        /* one round trip per XFER */
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < n; i++)
+        {
+            Bytes tdo = client.xfer(&tdi[XFER_BYTES * i], XFER_BYTES * 8).get();
+            check(&tdi[XFER_BYTES * i], 0, tdo, loopback);
+        }
+        sync_s = seconds_since(start);
+
+        /* pipelined, the responses matched to their callbacks */
+        start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < n; i++)
+        {
+            const uint8_t *t = &tdi[XFER_BYTES * i];
+            client.xfer(t, XFER_BYTES * 8, [t, loopback](int status, Bytes tdo) { check(t, status, tdo, loopback); });
+            if (i % 16 == 5)
+                client.getsig([&getsigs](int status, Bytes sig) { getsigs += !status && sig.size() == 1; });
+            if (i % 16 == 11)
+                client.clk_readout(false, true, 3, [&clk_readouts, loopback](int status, Bytes tdo) {
+                    clk_readouts += !status && tdo.size() == 1 && (!loopback || tdo[0]);
+                });
+        }
+        if (client.sync())
+            failures++;
+        async_s = seconds_since(start);
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    double mbit = 8.0 * XFER_BYTES * n / 1e6;
+    printf("round trip per XFER: %8.3f s %8.3f Mbit/s\n", sync_s, mbit / sync_s);
+    printf("pipelined:           %8.3f s %8.3f Mbit/s, x%.1f\n", async_s, mbit / async_s, sync_s / async_s);
+    unsigned expected_getsigs = n / 16 + (n % 16 > 5), expected_readouts = n / 16 + (n % 16 > 11);
+    if (mismatches || failures || getsigs != expected_getsigs || clk_readouts != expected_readouts)
+    {
+        printf("FAILED: %u TDO mismatches, %u failed transfers, %u/%u GETSIG, %u/%u CMD_CLK READOUT\n",
+               mismatches.load(), failures.load(), getsigs, expected_getsigs, clk_readouts, expected_readouts);
+        return 1;
+    }
+    return 0;
+}
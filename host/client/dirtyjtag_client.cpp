@@ -0,0 +1,412 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <errno.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "dirtyjtag_client.h"
+
+namespace dirtyjtag {
+
+/* As in cmd.c */
+enum {
+    CMD_STOP = 0x00,
+    CMD_INFO = 0x01,
+    CMD_FREQ = 0x02,
+    CMD_XFER = 0x03,
+    CMD_SETSIG = 0x04,
+    CMD_GETSIG = 0x05,
+    CMD_CLK = 0x06,
+    CMD_CHAIN = 0x0E,
+
+    STREAM_MODE = 0x80,
+    NO_READ = 0x80,
+    EXTEND_LENGTH = 0x40,
+    LSB_FIRST = 0x20,
+    READOUT = 0x80,
+    TMS_VECTOR = 0x40,
+    REAL_FREQ = 0x80,
+
+    SIG_TDI = 1 << 2,
+    SIG_TMS = 1 << 4,
+};
+
+/* Longest CMD_XFER, whole bytes so the TDO of the pieces of a long one just adds up */
+static const size_t XFER_MAX_BITS = 62 * 8;
+/* Longest TMS_VECTOR cut on a byte boundary */
+static const unsigned TMS_MAX_BITS = 248;
+/* Longest event wait, bounds how long the destructor waits for the event thread */
+static const unsigned EVENT_WAIT_MS = 10;
+
+static std::future<Bytes> promised(const std::function<void(Callback)> &issue)
+{
+    auto promise = std::make_shared<std::promise<Bytes>>();
+    std::future<Bytes> future = promise->get_future();
+    issue([promise](int status, Bytes response) {
+        if (status)
+            promise->set_exception(std::make_exception_ptr(
+                std::runtime_error("DirtyJTAG transfer failed, error " + std::to_string(status))));
+        else
+            promise->set_value(std::move(response));
+    });
+    return future;
+}
+
+Client::Client(std::unique_ptr<Transport> transport, unsigned depth)
+    : transport(std::move(transport)), depth(std::max(depth, 1u))
+{
+    {
+        std::lock_guard<std::mutex> l(lock);
+        for (unsigned i = 0; i < this->depth; i++)
+            this->transport->read([this](int status, const uint8_t *data, size_t length) {
+                read_done(status, data, length);
+            });
+    }
+    events = std::thread(&Client::run, this);
+    /* the commands are packed across packets, in its own packet as the probe drops what follows it */
+    const uint8_t cmd[] = { CMD_STOP | STREAM_MODE };
+    command(cmd, sizeof(cmd), 0, nullptr);
+    flush();
+}
+
+Client::~Client()
+{
+    sync();
+    {
+        std::lock_guard<std::mutex> l(lock);
+        stopping = true;
+    }
+    events.join();
+    /* the reads still posted go with the transport, without completing */
+    transport.reset();
+}
+
+void Client::command(const uint8_t *data, size_t length, size_t response_length, Callback done)
+{
+    std::unique_lock<std::mutex> l(lock);
+    /* the event thread must not wait for itself */
+    if (std::this_thread::get_id() != events.get_id())
+        changed.wait(l, [this] { return error || ready.size() < depth; });
+    if (error)
+    {
+        int status = error;
+        l.unlock();
+        if (response_length)
+            done(status, Bytes());
+        return;
+    }
+    if (response_length)
+    {
+        Pending p = { response_length, Bytes(), std::move(done) };
+        p.response.reserve(response_length);
+        pending.push_back(std::move(p));
+    }
+    append(data, length);
+}
+
+void Client::info(Callback done)
+{
+    const uint8_t cmd[] = { CMD_INFO };
+    command(cmd, sizeof(cmd), 10, std::move(done));
+}
+
+std::future<Bytes> Client::info()
+{
+    return promised([this](Callback done) { info(std::move(done)); });
+}
+
+void Client::freq(unsigned khz, Callback done)
+{
+    const uint8_t cmd[] = { CMD_FREQ | REAL_FREQ, (uint8_t)(khz >> 8), (uint8_t)khz };
+    command(cmd, sizeof(cmd), 4, std::move(done));
+}
+
+std::future<Bytes> Client::freq(unsigned khz)
+{
+    return promised([this, khz](Callback done) { freq(khz, std::move(done)); });
+}
+
+/* The CMD_XFER pieces of a shift of any length */
+static Bytes xfer_commands(const uint8_t *tdi, size_t bits, bool no_read, bool lsb_first)
+{
+    Bytes commands;
+    for (size_t done = 0; done < bits; done += XFER_MAX_BITS)
+    {
+        size_t n = std::min(bits - done, XFER_MAX_BITS);
+        commands.push_back(CMD_XFER | (n > 255 ? EXTEND_LENGTH : 0) | (no_read ? NO_READ : 0) |
+                           (lsb_first ? LSB_FIRST : 0));
+        commands.push_back((uint8_t)(n > 255 ? n - 256 : n));
+        commands.insert(commands.end(), tdi + done / 8, tdi + done / 8 + (n + 7) / 8);
+    }
+    return commands;
+}
+
+void Client::xfer(const uint8_t *tdi, size_t bits, Callback done, bool lsb_first)
+{
+    Bytes commands = xfer_commands(tdi, bits, false, lsb_first);
+    command(commands.data(), commands.size(), (bits + 7) / 8, std::move(done));
+}
+
+std::future<Bytes> Client::xfer(const uint8_t *tdi, size_t bits, bool lsb_first)
+{
+    return promised([=](Callback done) { xfer(tdi, bits, std::move(done), lsb_first); });
+}
+
+void Client::xfer_noread(const uint8_t *tdi, size_t bits, bool lsb_first)
+{
+    Bytes commands = xfer_commands(tdi, bits, true, lsb_first);
+    command(commands.data(), commands.size(), 0, nullptr);
+}
+
+/* The CMD_CLK runs of a pulse count, READOUT on the last one */
+static Bytes clk_commands(bool tms, bool tdi, unsigned pulses, bool readout)
+{
+    Bytes commands;
+    uint8_t signals = (tms ? SIG_TMS : 0) | (tdi ? SIG_TDI : 0);
+    do
+    {
+        unsigned n = std::min(pulses, 255u);
+        pulses -= n;
+        commands.push_back(CMD_CLK | ((readout && !pulses) ? READOUT : 0));
+        commands.push_back(signals);
+        commands.push_back((uint8_t)n);
+    } while (pulses);
+    return commands;
+}
+
+void Client::clk(bool tms, bool tdi, unsigned pulses)
+{
+    if (!pulses)
+        return;
+    Bytes commands = clk_commands(tms, tdi, pulses, false);
+    command(commands.data(), commands.size(), 0, nullptr);
+}
+
+void Client::clk_readout(bool tms, bool tdi, unsigned pulses, Callback done)
+{
+    Bytes commands = clk_commands(tms, tdi, pulses, true);
+    command(commands.data(), commands.size(), 1, std::move(done));
+}
+
+std::future<Bytes> Client::clk_readout(bool tms, bool tdi, unsigned pulses)
+{
+    return promised([=](Callback done) { clk_readout(tms, tdi, pulses, std::move(done)); });
+}
+
+void Client::tms(const uint8_t *tms, unsigned count, bool tdi)
+{
+    Bytes commands;
+    for (unsigned done = 0; done < count; done += TMS_MAX_BITS)
+    {
+        unsigned n = std::min(count - done, TMS_MAX_BITS);
+        commands.push_back(CMD_CLK | TMS_VECTOR);
+        commands.push_back(tdi ? SIG_TDI : 0);
+        commands.push_back((uint8_t)n);
+        commands.insert(commands.end(), tms + done / 8, tms + done / 8 + (n + 7) / 8);
+    }
+    command(commands.data(), commands.size(), 0, nullptr);
+}
+
+void Client::setsig(uint8_t mask, uint8_t value)
+{
+    const uint8_t cmd[] = { CMD_SETSIG, mask, value };
+    command(cmd, sizeof(cmd), 0, nullptr);
+}
+
+void Client::getsig(Callback done)
+{
+    const uint8_t cmd[] = { CMD_GETSIG };
+    command(cmd, sizeof(cmd), 1, std::move(done));
+}
+
+std::future<Bytes> Client::getsig()
+{
+    return promised([this](Callback done) { getsig(std::move(done)); });
+}
+
+void Client::chain(unsigned chain)
+{
+    const uint8_t cmd[] = { CMD_CHAIN, (uint8_t)chain };
+    command(cmd, sizeof(cmd), 0, nullptr);
+}
+
+void Client::flush()
+{
+    std::lock_guard<std::mutex> l(lock);
+    if (!packet.empty())
+    {
+        ready.push_back(std::move(packet));
+        packet.clear();
+    }
+    pump();
+}
+
+int Client::sync()
+{
+    flush();
+    std::unique_lock<std::mutex> l(lock);
+    changed.wait(l, [this] {
+        return (error || (pending.empty() && ready.empty() && packet.empty() && !writes_in_flight)) && !completing;
+    });
+    return error;
+}
+
+/* called with lock held */
+void Client::append(const uint8_t *data, size_t length)
+{
+    while (length)
+    {
+        size_t n = std::min(length, Transport::PACKET_SIZE - packet.size());
+        packet.insert(packet.end(), data, data + n);
+        data += n;
+        length -= n;
+        if (packet.size() == Transport::PACKET_SIZE)
+        {
+            ready.push_back(std::move(packet));
+            packet.clear();
+        }
+    }
+    pump();
+}
+
+/*
+ * Start the OUT transfers there are slots for, called with lock held. A partly
+ * filled packet only goes when nothing else is on the way: the probe has no
+ * more work queued then, and the commands that come meanwhile fill it up.
+ */
+void Client::pump()
+{
+    while (!error && writes_in_flight < depth && (!ready.empty() || (!writes_in_flight && !packet.empty())))
+    {
+        Bytes data;
+        if (!ready.empty())
+        {
+            data = std::move(ready.front());
+            ready.pop_front();
+        }
+        else
+        {
+            data.swap(packet);
+        }
+        writes_in_flight++;
+        transport->write(std::move(data), [this](int status, const uint8_t *, size_t) { write_done(status); });
+    }
+    changed.notify_all();
+}
+
+void Client::write_done(int status)
+{
+    Completions completed;
+    {
+        std::lock_guard<std::mutex> l(lock);
+        writes_in_flight--;
+        if (status)
+            fail(status, completed);
+        pump();
+        completing += completed.size();
+    }
+    complete(completed);
+}
+
+void Client::read_done(int status, const uint8_t *data, size_t length)
+{
+    Completions completed;
+    {
+        std::lock_guard<std::mutex> l(lock);
+        if (status)
+        {
+            fail(status, completed);
+        }
+        else
+        {
+            while (length && !pending.empty())
+            {
+                Pending &p = pending.front();
+                size_t n = std::min(length, p.remaining);
+                p.response.insert(p.response.end(), data, data + n);
+                p.remaining -= n;
+                data += n;
+                length -= n;
+                if (!p.remaining)
+                {
+                    completed.push_back({ std::move(p.done), 0, std::move(p.response) });
+                    pending.pop_front();
+                }
+            }
+            /* more bytes than the commands sent answer, the matching is lost */
+            if (length)
+                fail(-EPROTO, completed);
+        }
+        if (!error)
+            transport->read([this](int read_status, const uint8_t *read_data, size_t read_length) {
+                read_done(read_status, read_data, read_length);
+            });
+        completing += completed.size();
+        changed.notify_all();
+    }
+    complete(completed);
+}
+
+/* called with lock held, the responses still due fail with the first error */
+void Client::fail(int status, Completions &completed)
+{
+    if (!error)
+        error = status;
+    for (auto &p : pending)
+        completed.push_back({ std::move(p.done), error, Bytes() });
+    pending.clear();
+    ready.clear();
+    packet.clear();
+}
+
+/* Run the callbacks taken from pending, without the lock so that they can queue commands */
+void Client::complete(Completions &completed)
+{
+    if (completed.empty())
+        return;
+    for (auto &c : completed)
+        c.done(c.status, std::move(c.response));
+    std::lock_guard<std::mutex> l(lock);
+    completing -= completed.size();
+    changed.notify_all();
+}
+
+void Client::run()
+{
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            if (stopping)
+                return;
+        }
+        transport->handle_events(EVENT_WAIT_MS);
+    }
+}
+
+}
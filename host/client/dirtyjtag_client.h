@@ -0,0 +1,194 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Pipelined host side of the DirtyJTAG protocol. Commands are packed into
+ * 64 byte OUT packets, up to depth of them are in flight at once and depth IN
+ * reads stay posted, so the probe always has the next packet queued and room
+ * for its responses. The responses come back as one byte stream, in command
+ * order, and are matched to the commands that produce them from their known
+ * lengths. The client first puts the probe in stream mode (CMD_STOP |
+ * STREAM_MODE), so the packet boundaries do not matter.
+ *
+ * A partly filled packet goes out when the OUT pipe is idle, on flush() or
+ * sync(), full ones as soon as a slot is free. Commands are issued from one
+ * thread; callbacks run on the client's event thread, they may issue
+ * commands but must not wait for a response.
+ */
+
+#ifndef _DIRTYJTAG_CLIENT_H
+#define _DIRTYJTAG_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dirtyjtag {
+
+using Bytes = std::vector<uint8_t>;
+
+/*
+ * status is 0, or the negative error of the transfer that failed, -EPROTO when
+ * the probe answered more bytes than the commands sent produce
+ */
+using Callback = std::function<void(int status, Bytes response)>;
+
+/*
+ * Asynchronous bulk transfers on the probe interface. write() and read() only
+ * queue a transfer, never complete it before returning: the completions run
+ * from handle_events(), on the client's event thread.
+ */
+class Transport {
+public:
+    using Completion = std::function<void(int status, const uint8_t *data, size_t length)>;
+
+    static constexpr size_t PACKET_SIZE = 64;
+
+    virtual ~Transport() = default;
+
+    /* One OUT transfer of at most PACKET_SIZE bytes */
+    virtual void write(Bytes data, Completion done) = 0;
+
+    /* One IN transfer, done gets the packet received */
+    virtual void read(Completion done) = 0;
+
+    /* Run the completions due, waiting up to timeout_ms for one */
+    virtual void handle_events(unsigned timeout_ms) = 0;
+};
+
+#ifdef DIRTYJTAG_CLIENT_USB
+/* The probe on USB, through libusb; throws std::runtime_error when it cannot be opened */
+std::unique_ptr<Transport> open_usb(uint16_t vid = 0x1209, uint16_t pid = 0xC0CA);
+#endif
+
+/*
+ * The host-native build of the firmware (host/sim.h) in this process, booted
+ * here and stopped with the transport, so there is one at a time. Its JTAG
+ * chains are whatever sim_set_chain_target() attached, TDI looped back to TDO
+ * by default.
+ */
+std::unique_ptr<Transport> open_loopback();
+
+class Client {
+public:
+    explicit Client(std::unique_ptr<Transport> transport, unsigned depth = 4);
+
+    /* Waits for the responses still due */
+    ~Client();
+
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    /*
+     * Queue a raw command, whole: length bytes producing response_length bytes
+     * of response, which go to done. Several commands may share one done, the
+     * response is then the concatenation of theirs.
+     */
+    void command(const uint8_t *data, size_t length, size_t response_length, Callback done);
+
+    /* CMD_INFO: the 10 byte version string */
+    void info(Callback done);
+    std::future<Bytes> info();
+
+    /* CMD_FREQ with REAL_FREQ: the TCK set, in Hz, 4 bytes big endian */
+    void freq(unsigned khz, Callback done);
+    std::future<Bytes> freq(unsigned khz);
+
+    /* CMD_XFER of any length, split in as many commands: the TDO, (bits + 7) / 8 bytes */
+    void xfer(const uint8_t *tdi, size_t bits, Callback done, bool lsb_first = false);
+    std::future<Bytes> xfer(const uint8_t *tdi, size_t bits, bool lsb_first = false);
+    void xfer_noread(const uint8_t *tdi, size_t bits, bool lsb_first = false);
+
+    /* CMD_CLK, pulses split in runs of 255; with READOUT, TDO after the last one, 1 byte */
+    void clk(bool tms, bool tdi, unsigned pulses);
+    void clk_readout(bool tms, bool tdi, unsigned pulses, Callback done);
+    std::future<Bytes> clk_readout(bool tms, bool tdi, unsigned pulses);
+
+    /* CMD_CLK with TMS_VECTOR, count bits of tms MSB first, split in as many commands */
+    void tms(const uint8_t *tms, unsigned count, bool tdi);
+
+    /* CMD_SETSIG, CMD_GETSIG (1 byte, the SIG_* levels) */
+    void setsig(uint8_t mask, uint8_t value);
+    void getsig(Callback done);
+    std::future<Bytes> getsig();
+
+    /* CMD_CHAIN */
+    void chain(unsigned chain);
+
+    /* Send the partly filled packet now */
+    void flush();
+
+    /* Flush and wait until every response has been received, returns the first error or 0 */
+    int sync();
+
+private:
+    struct Pending {
+        size_t remaining;
+        Bytes response;
+        Callback done;
+    };
+
+    /* Callbacks due, run once the lock is released */
+    struct Completed {
+        Callback done;
+        int status;
+        Bytes response;
+    };
+    using Completions = std::vector<Completed>;
+
+    void append(const uint8_t *data, size_t length);
+    void pump();
+    void write_done(int status);
+    void read_done(int status, const uint8_t *data, size_t length);
+    void fail(int status, Completions &completed);
+    void complete(Completions &completed);
+    void run();
+
+    std::unique_ptr<Transport> transport;
+    unsigned depth;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    Bytes packet;                   /* being filled */
+    std::deque<Bytes> ready;        /* full, waiting for an OUT slot */
+    unsigned writes_in_flight = 0;
+    std::deque<Pending> pending;    /* responses due, in order */
+    size_t completing = 0;          /* callbacks taken from pending, not run yet */
+    int error = 0;
+    bool stopping = false;
+    std::thread events;
+};
+
+}
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Transport to the simulated probe. An OUT transfer completes once the
+ * simulated endpoint took its packet, as the ACK of a real bus would, so the
+ * client sees the same back pressure as from the firmware on USB. A thread
+ * waits on the simulator and queues the completions for handle_events().
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "dirtyjtag_client.h"
+#include "sim.h"
+
+namespace dirtyjtag {
+
+namespace {
+
+/* Longest simulator wait, bounds how long the destructor waits for the thread */
+const unsigned SIM_WAIT_MS = 1;
+
+class LoopbackTransport : public Transport {
+public:
+    LoopbackTransport()
+    {
+        sim_start();
+        /* the count of OUT packets taken goes on from any earlier run */
+        taken = sim_usb_host_wait(false, UINT64_MAX, 0);
+        acked = taken;
+        worker = std::thread(&LoopbackTransport::run, this);
+    }
+
+    ~LoopbackTransport() override
+    {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            closing = true;
+        }
+        worker.join();
+        sim_stop();
+    }
+
+    void write(Bytes data, Completion done) override
+    {
+        std::lock_guard<std::mutex> l(lock);
+        sim_usb_host_write(data.data(), data.size());
+        writes.push_back(std::move(done));
+    }
+
+    void read(Completion done) override
+    {
+        std::lock_guard<std::mutex> l(lock);
+        reads.push_back(std::move(done));
+    }
+
+    void handle_events(unsigned timeout_ms) override
+    {
+        std::deque<Event> due;
+        {
+            std::unique_lock<std::mutex> l(lock);
+            completed.wait_for(l, std::chrono::milliseconds(timeout_ms), [this] { return !events.empty(); });
+            due.swap(events);
+        }
+        for (auto &e : due)
+            e.done(0, e.data.data(), e.data.size());
+    }
+
+private:
+    struct Event {
+        Completion done;
+        Bytes data;
+    };
+
+    void run()
+    {
+        uint8_t packet[PACKET_SIZE];
+        for (;;)
+        {
+            bool reading;
+            {
+                std::lock_guard<std::mutex> l(lock);
+                if (closing)
+                    return;
+                reading = !reads.empty();
+            }
+            taken = sim_usb_host_wait(reading, taken, SIM_WAIT_MS);
+            int n = reading ? sim_usb_host_read(packet, sizeof(packet), 0) : -1;
+
+            std::lock_guard<std::mutex> l(lock);
+            for (; acked < taken && !writes.empty(); acked++)
+            {
+                events.push_back({ std::move(writes.front()), Bytes() });
+                writes.pop_front();
+            }
+            if (n >= 0)
+            {
+                events.push_back({ std::move(reads.front()), Bytes(packet, packet + n) });
+                reads.pop_front();
+            }
+            if (!events.empty())
+                completed.notify_one();
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable completed;
+    std::deque<Completion> writes;      /* OUT packets not taken yet, in order */
+    std::deque<Completion> reads;
+    std::deque<Event> events;           /* for handle_events() */
+    uint64_t taken;                     /* OUT packets taken by the simulated endpoint */
+    uint64_t acked;                     /* and completed */
+    bool closing = false;
+    std::thread worker;
+};
+
+}
+
+std::unique_ptr<Transport> open_loopback()
+{
+    return std::unique_ptr<Transport>(new LoopbackTransport());
+}
+
+}
@@ -0,0 +1,196 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Transport to the probe on USB, with libusb asynchronous bulk transfers on
+ * the endpoints of the vendor interface (usb_descriptors.c).
+ */
+
+#include <sys/time.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+#include <libusb.h>
+
+#include "dirtyjtag_client.h"
+
+namespace dirtyjtag {
+
+namespace {
+
+const unsigned char EP_OUT = 0x01;
+const unsigned char EP_IN = 0x82;
+
+class UsbTransport : public Transport {
+public:
+    UsbTransport(uint16_t vid, uint16_t pid)
+    {
+        int rc = libusb_init(&ctx);
+        if (rc < 0)
+            throw std::runtime_error(std::string("libusb_init: ") + libusb_error_name(rc));
+        handle = libusb_open_device_with_vid_pid(ctx, vid, pid);
+        if (!handle)
+        {
+            libusb_exit(ctx);
+            throw std::runtime_error("DirtyJTAG probe not found");
+        }
+        rc = libusb_claim_interface(handle, 0);
+        if (rc < 0)
+        {
+            libusb_close(handle);
+            libusb_exit(ctx);
+            throw std::runtime_error(std::string("cannot claim the probe interface: ") + libusb_error_name(rc));
+        }
+    }
+
+    ~UsbTransport() override
+    {
+        /* the reads are posted without timeout, cancel them and wait for libusb to give them back */
+        closing = true;
+        {
+            std::lock_guard<std::mutex> l(lock);
+            for (libusb_transfer *t : in_flight)
+                libusb_cancel_transfer(t);
+        }
+        for (;;)
+        {
+            {
+                std::lock_guard<std::mutex> l(lock);
+                if (in_flight.empty())
+                    break;
+            }
+            struct timeval tv = { 0, 100000 };
+            libusb_handle_events_timeout_completed(ctx, &tv, nullptr);
+        }
+        libusb_release_interface(handle, 0);
+        libusb_close(handle);
+        libusb_exit(ctx);
+    }
+
+    void write(Bytes data, Completion done) override
+    {
+        submit(EP_OUT, std::move(data), std::move(done));
+    }
+
+    void read(Completion done) override
+    {
+        submit(EP_IN, Bytes(PACKET_SIZE), std::move(done));
+    }
+
+    void handle_events(unsigned timeout_ms) override
+    {
+        std::deque<std::pair<Completion, int>> failed;
+        {
+            std::lock_guard<std::mutex> l(lock);
+            failed.swap(submit_failures);
+        }
+        for (auto &f : failed)
+            f.first(f.second, nullptr, 0);
+        struct timeval tv = { (time_t)(timeout_ms / 1000), (suseconds_t)(timeout_ms % 1000) * 1000 };
+        libusb_handle_events_timeout_completed(ctx, &tv, nullptr);
+    }
+
+private:
+    struct Transfer {
+        UsbTransport *transport;
+        Bytes buffer;
+        Completion done;
+    };
+
+    void submit(unsigned char endpoint, Bytes buffer, Completion done)
+    {
+        libusb_transfer *t = libusb_alloc_transfer(0);
+        Transfer *transfer = new Transfer{ this, std::move(buffer), std::move(done) };
+        libusb_fill_bulk_transfer(t, handle, endpoint, transfer->buffer.data(), (int)transfer->buffer.size(),
+                                  completed, transfer, 0);
+        std::lock_guard<std::mutex> l(lock);
+        int rc = libusb_submit_transfer(t);
+        if (rc < 0)
+        {
+            /* the completion still has to come from handle_events() */
+            submit_failures.emplace_back(std::move(transfer->done), rc);
+            delete transfer;
+            libusb_free_transfer(t);
+            return;
+        }
+        in_flight.insert(t);
+    }
+
+    static int transfer_error(enum libusb_transfer_status status)
+    {
+        switch (status)
+        {
+        case LIBUSB_TRANSFER_COMPLETED:
+            return 0;
+        case LIBUSB_TRANSFER_TIMED_OUT:
+            return LIBUSB_ERROR_TIMEOUT;
+        case LIBUSB_TRANSFER_STALL:
+            return LIBUSB_ERROR_PIPE;
+        case LIBUSB_TRANSFER_NO_DEVICE:
+            return LIBUSB_ERROR_NO_DEVICE;
+        case LIBUSB_TRANSFER_OVERFLOW:
+            return LIBUSB_ERROR_OVERFLOW;
+        case LIBUSB_TRANSFER_CANCELLED:
+            return LIBUSB_ERROR_INTERRUPTED;
+        default:
+            return LIBUSB_ERROR_IO;
+        }
+    }
+
+    static void LIBUSB_CALL completed(libusb_transfer *t)
+    {
+        Transfer *transfer = static_cast<Transfer *>(t->user_data);
+        UsbTransport *self = transfer->transport;
+        {
+            std::lock_guard<std::mutex> l(self->lock);
+            self->in_flight.erase(t);
+        }
+        if (!self->closing)
+            transfer->done(transfer_error(t->status), transfer->buffer.data(), t->actual_length);
+        delete transfer;
+        libusb_free_transfer(t);
+    }
+
+    libusb_context *ctx = nullptr;
+    libusb_device_handle *handle = nullptr;
+    std::mutex lock;
+    std::set<libusb_transfer *> in_flight;
+    std::deque<std::pair<Completion, int>> submit_failures;
+    std::atomic<bool> closing{ false };
+};
+
+}
+
+std::unique_ptr<Transport> open_usb(uint16_t vid, uint16_t pid)
+{
+    return std::unique_ptr<Transport>(new UsbTransport(vid, pid));
+}
+
+}
@@ -0,0 +1,2061 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Throughput benchmark of the command engine running on the host-native
+ * simulator. Each scenario streams DirtyJTAG packets through the vendor
+ * interface, collects the responses, and reports what the simulated hardware
+ * did per packet: TCK cycles, PIO time at the current TCK rate, estimated CPU
+ * cycles, plus the host time core1 spent in cmd_handle().
+ *
+ * With -t, a chain of ECP5-like TAP controllers (sim_tap.c) is attached
+ * instead of the TDI to TDO loopback, the tap_* scenarios check what comes
+ * back against it, and the TAP statistics are reported as well. -m makes the
+ * chain flip TDO bits above that TCK, for tap_tune. -r selects adaptive
+ * clocking, the target returning TCK on RTCK that many PIO cycles late.
+ * The other JTAG chains of the probe, if any, delay TDI by their number of
+ * TCK cycles on TDO, for chain_xfer to tell them apart. -d saves the trace
+ * ring the trace scenario dumps, for dirtyjtag-trace.py.
+ *
+ * usage: dirtyjtag_bench [-n packets] [-f freq_khz] [-t devices] [-m max_tck_khz] [-r rtck_cycles] [-d trace_file] [-c] [scenario...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "sim_tap.h"
+
+#define PACKET_SIZE 64
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#define RESPONSE_TIMEOUT_MS 2000
+
+enum {
+    CMD_STOP = 0x00,
+    CMD_INFO = 0x01,
+    CMD_FREQ = 0x02,
+    CMD_XFER = 0x03,
+    CMD_SETSIG = 0x04,
+    CMD_GETSIG = 0x05,
+    CMD_CLK = 0x06,
+    CMD_SETVOLTAGE = 0x07,
+    CMD_LONGXFER = 0x09,
+    CMD_VERIFY = 0x0A,
+    CMD_POLL = 0x0B,
+    CMD_MACRO = 0x0C,
+    CMD_XSVF = 0x0D,
+    CMD_CHAIN = 0x0E,
+    CMD_STATS = 0x0F,
+};
+
+#define STREAM_MODE 0x80
+#define PACKET_MODE 0x40
+#define NO_READ 0x80
+#define EXTEND_LENGTH 0x40
+#define LSB_FIRST 0x20
+#define PACKED_TDO 0x40
+#define PACKED_TDI 0x10
+#define READOUT 0x80
+#define TMS_VECTOR 0x40
+#define REAL_FREQ 0x80
+#define AUTOTUNE 0x40
+#define SAVE_FREQ 0x20
+#define MACRO_RUN 0x80
+#define MACRO_HITS 0x40
+#define CHAIN_COUNT 0x80
+#define STATS_RESET 0x80
+#define TRACE 0x40
+#define TRACE_OFF 0
+#define TRACE_ON 1
+#define TRACE_DUMP 2
+#define SIG_TCK (1 << 1)
+#define SIG_TDI (1 << 2)
+#define SIG_TDO (1 << 3)
+#define SIG_TMS (1 << 4)
+
+/* PACK_WINDOW_SIZE of the firmware, how far back packed TDI may copy from */
+#define PACK_WINDOW 2048
+
+/* an LFE5UM-45 as far as the TAP is concerned */
+#define TAP_IR_LENGTH 8
+#define TAP_IDCODE 0x41112043
+#define TAP_IDCODE_INSTR 0xE0
+#define TAP_USER_INSTR 0x32
+#define TAP_USER_DR_LENGTH (1u << 20)
+/* and a status register that reads busy for TAP_STATUS_BUSY captures */
+#define TAP_STATUS_INSTR 0x05
+#define TAP_STATUS_BUSY 5
+
+/* what CMD_STATS answers, see stats.h */
+#define STATS_WORDS 42
+#define STATS_SIZE (1 + 4 * STATS_WORDS)
+
+/* the trace ring, see trace.h */
+#define TRACE_RECORDS 256
+#define TRACE_HEADER_SIZE 6
+#define TRACE_RECORD_SIZE 24
+
+typedef struct packet {
+    uint8_t data[PACKET_SIZE];
+    uint32_t len;
+} packet;
+
+typedef struct scenario {
+    const char *name;
+    const char *description;
+    bool needs_tap;
+    /* fills packet i of n, returns its length */
+    uint32_t (*build)(uint8_t *buf, unsigned i, unsigned n);
+    /* checks the response to packet i, returns the number of errors */
+    unsigned (*check)(const uint8_t *response, uint32_t len, unsigned i, unsigned n);
+    /* checks the target once every packet has been executed */
+    unsigned (*check_target)(unsigned n);
+    /* what comes back cannot be told with the TAP chain attached */
+    bool needs_loopback;
+    /* runs with the probe in packet mode, the others in stream mode */
+    bool packet_mode;
+    /* the bus is reset first, while the responses to packets never read are sent */
+    bool bus_reset;
+} scenario;
+
+static bool csv;
+static int exit_status;
+static sim_tap_chain *tap;
+static unsigned tap_devices;
+static unsigned tap_max_khz;
+static unsigned chain_count;
+static const char *trace_file;
+static uint32_t trace_expected;
+/* records the next TRACE_DUMP answers, a dump empties the ring */
+static uint32_t trace_in_ring;
+
+/* CMD_LONGXFER data still to come in the next packets */
+static uint32_t longxfer_remaining;
+static bool longxfer_read;
+
+/* Packed CMD_LONGXFER data: the token being received, and its literal bytes still to come */
+static bool longxfer_packed;
+static uint8_t packed_token[3];
+static uint32_t packed_token_len;
+static uint32_t packed_literal;
+
+/* Packed TDO of CMD_LONGXFER: the bytes of the literal token and of the run being packed */
+static bool longxfer_packed_tdo;
+static uint32_t tdo_literal;
+static uint8_t tdo_value;
+static uint32_t tdo_run;
+
+/* CMD_XSVF data still to come */
+static uint32_t xsvf_remaining;
+
+/* CMD_MACRO definition data still to come, and what a run of each macro takes and gives, set by the scenarios */
+static uint32_t macro_remaining;
+static uint8_t macro_params[256];
+static uint32_t macro_response[256];
+
+/* Command cut at the end of the previous packet */
+static uint8_t carry[3 + 255];
+static uint32_t carry_len;
+
+/* Set by CMD_STOP | STREAM_MODE, CMD_STOP ends the packet until then */
+static bool stream_mode;
+
+/* Length of the command at p, or more than avail when it cannot be told yet, mirrors cmd_length() */
+static uint32_t command_length(const uint8_t *p, uint32_t avail)
+{
+    switch (p[0] & 0x0F)
+    {
+    case CMD_CLK:
+        if ((p[0] & TMS_VECTOR) && avail >= 3)
+            return 3 + (p[2] + 7) / 8;
+        return 3;
+    case CMD_FREQ:
+    case CMD_SETSIG:
+        return 3;
+    case CMD_CHAIN:
+        return 2;
+    case CMD_STATS:
+        return (p[0] & TRACE) ? 2 : 1;
+    case CMD_XFER:
+    case CMD_VERIFY:
+    {
+        if (avail < 2)
+            return 2;
+        uint32_t bits = MIN(p[1] + ((p[0] & EXTEND_LENGTH) ? 256 : 0), 62 * 8);
+        return 2 + (((p[0] & 0x0F) == CMD_VERIFY) ? 3 : 1) * ((bits + 7) / 8);
+    }
+    case CMD_POLL:
+    {
+        if (avail < 2)
+            return 6;
+        uint32_t bits = MIN(p[1] + ((p[0] & EXTEND_LENGTH) ? 256 : 0), 62 * 8);
+        return 6 + 3 * ((bits + 7) / 8);
+    }
+    case CMD_LONGXFER:
+    case CMD_XSVF:
+        return 5;
+    case CMD_MACRO:
+        if (p[0] & MACRO_RUN)
+            return avail < 3 ? 3 : 3 + p[2];
+        return (p[0] & MACRO_HITS) ? 2 : 5;
+    case CMD_SETVOLTAGE:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+/* Walks packed CMD_LONGXFER data, returns the bytes of it used and in unpacked the bytes they give, mirrors unpack() */
+static uint32_t unpacked_length(const uint8_t *p, uint32_t len, uint32_t *unpacked)
+{
+    uint32_t i = 0, n = 0;
+    while (i < len && longxfer_remaining)
+    {
+        uint32_t run;
+        if (packed_literal)
+        {
+            run = MIN(MIN(len - i, packed_literal), longxfer_remaining);
+            packed_literal -= run;
+            longxfer_remaining -= run;
+            n += run;
+            i += run;
+            continue;
+        }
+        packed_token[packed_token_len++] = p[i++];
+        if (packed_token_len < ((packed_token[0] & 0x80) ? 3 : 1))
+            continue;
+        packed_token_len = 0;
+        if (!(packed_token[0] & 0x80))
+        {
+            packed_literal = packed_token[0] + 1;
+            continue;
+        }
+        if (packed_token[0] & 0x40)
+            run = (packed_token[0] & 0x3F) + 4;
+        else
+            run = (((packed_token[0] & 0x3F) << 8) | packed_token[1]) + 1;
+        run = MIN(run, longxfer_remaining);
+        longxfer_remaining -= run;
+        n += run;
+    }
+    *unpacked = n;
+    return i;
+}
+
+/* Ends the run of TDO being packed, returns the bytes written, mirrors pack_run() */
+static uint32_t packed_tdo_run(void)
+{
+    uint32_t n = 0;
+    if (tdo_run >= 4)
+    {
+        n = (tdo_literal ? tdo_literal + 1 : 0) + 3;
+        tdo_literal = 0;
+    }
+    else
+    {
+        for (uint32_t j = 0; j < tdo_run; j++)
+        {
+            if (tdo_literal == 128)
+            {
+                n += 129;
+                tdo_literal = 0;
+            }
+            tdo_literal++;
+        }
+    }
+    tdo_run = 0;
+    return n;
+}
+
+/* Bytes the firmware packs TDO into, TDI being looped back to it, mirrors pack() and pack_end() */
+static uint32_t packed_tdo_length(const uint8_t *tdo, uint32_t len, bool last)
+{
+    uint32_t n = 0;
+    for (uint32_t j = 0; j < len; j++)
+    {
+        if (tdo_run && tdo[j] == tdo_value && tdo_run < (1 << 14))
+        {
+            tdo_run++;
+            continue;
+        }
+        n += packed_tdo_run();
+        tdo_value = tdo[j];
+        tdo_run = 1;
+    }
+    if (last)
+    {
+        n += packed_tdo_run();
+        n += tdo_literal ? tdo_literal + 1 : 0;
+        tdo_literal = 0;
+    }
+    return n;
+}
+
+/* Bytes the firmware sends back once it has a packet, mirrors cmd_handle() */
+static uint32_t expected_response(const uint8_t *packet, uint32_t len)
+{
+    uint8_t p[sizeof(carry) + PACKET_SIZE];
+    uint32_t i = 0, n = 0;
+
+    memcpy(p, carry, carry_len);
+    memcpy(p + carry_len, packet, len);
+    len += carry_len;
+    carry_len = 0;
+    while (i < len)
+    {
+        /* the bench does not combine PACKED_TDI with PACKED_TDO */
+        if (longxfer_remaining && longxfer_packed)
+        {
+            uint32_t unpacked;
+            i += unpacked_length(&p[i], len - i, &unpacked);
+            if (longxfer_read)
+                n += unpacked;
+            continue;
+        }
+        if (longxfer_remaining)
+        {
+            uint32_t here = MIN(len - i, longxfer_remaining);
+            longxfer_remaining -= here;
+            if (longxfer_read && longxfer_packed_tdo)
+                n += packed_tdo_length(&p[i], here, !longxfer_remaining);
+            else if (longxfer_read)
+                n += here;
+            i += here;
+            continue;
+        }
+        if (xsvf_remaining)
+        {
+            uint32_t here = MIN(len - i, xsvf_remaining);
+            xsvf_remaining -= here;
+            if (!xsvf_remaining)
+                n += 5;
+            i += here;
+            continue;
+        }
+        if (macro_remaining)
+        {
+            uint32_t here = MIN(len - i, macro_remaining);
+            macro_remaining -= here;
+            if (!macro_remaining)
+                n += 1;
+            i += here;
+            continue;
+        }
+        uint32_t length = command_length(&p[i], len - i);
+        if (length > len - i)
+        {
+            carry_len = len - i;
+            memcpy(carry, &p[i], carry_len);
+            break;
+        }
+        uint8_t cmd = p[i];
+        if ((cmd & 0x0F) == CMD_STOP)
+        {
+            bool packet_mode = !stream_mode;
+            if (cmd & STREAM_MODE)
+                stream_mode = true;
+            else if (cmd & PACKET_MODE)
+                stream_mode = false;
+            if (packet_mode)
+            {
+                /* the rest of the packet is dropped */
+                carry_len = 0;
+                break;
+            }
+        }
+        switch (cmd & 0x0F)
+        {
+        case CMD_INFO:
+            n += 10;
+            break;
+        case CMD_FREQ:
+            if (cmd & AUTOTUNE)
+                n += 8;
+            else if (cmd & REAL_FREQ)
+                n += 4;
+            break;
+        case CMD_XFER:
+            if (!(cmd & NO_READ))
+                n += length - 2;
+            break;
+        case CMD_VERIFY:
+            n += 2;
+            break;
+        case CMD_POLL:
+            n += 2 + (length - 6) / 3;
+            break;
+        case CMD_XSVF:
+            xsvf_remaining = ((uint32_t)p[i + 1] << 24) | (p[i + 2] << 16) | (p[i + 3] << 8) | p[i + 4];
+            if (!xsvf_remaining)
+                n += 5;
+            break;
+        case CMD_MACRO:
+            if (cmd & MACRO_RUN)
+            {
+                /* an undefined macro, or parameters not of its length, does not run */
+                if (p[i + 2] == macro_params[p[i + 1]])
+                    n += macro_response[p[i + 1]];
+            }
+            else if (cmd & MACRO_HITS)
+                n += 4;
+            else
+            {
+                macro_remaining = 3 * p[i + 2] + ((p[i + 3] << 8) | p[i + 4]);
+                if (!macro_remaining)
+                    n += 1;
+            }
+            break;
+        case CMD_LONGXFER:
+        {
+            uint32_t bits = ((uint32_t)p[i + 1] << 24) | (p[i + 2] << 16) | (p[i + 3] << 8) | p[i + 4];
+            longxfer_remaining = (bits >> 3) + ((bits & 7) ? 1 : 0);
+            longxfer_read = !(cmd & NO_READ);
+            longxfer_packed = cmd & PACKED_TDI;
+            longxfer_packed_tdo = (cmd & PACKED_TDO) && longxfer_read;
+            tdo_literal = tdo_run = 0;
+            packed_token_len = packed_literal = 0;
+            break;
+        }
+        case CMD_GETSIG:
+            n += 1;
+            break;
+        case CMD_CHAIN:
+            if (cmd & CHAIN_COUNT)
+                n += 1;
+            break;
+        case CMD_STATS:
+            if (!(cmd & TRACE))
+                n += STATS_SIZE;
+            else if (p[i + 1] == TRACE_DUMP)
+            {
+                n += TRACE_HEADER_SIZE + TRACE_RECORD_SIZE * trace_in_ring;
+                trace_in_ring = 0;
+            }
+            break;
+        case CMD_CLK:
+            if ((cmd & READOUT) && (cmd & TMS_VECTOR))
+                n += length - 3;
+            else if (cmd & READOUT)
+                n += 1;
+            break;
+        }
+        i += length;
+    }
+    return n;
+}
+
+static uint32_t build_xfer(uint8_t *buf, bool read)
+{
+    buf[0] = CMD_XFER | EXTEND_LENGTH | (read ? 0 : NO_READ);
+    buf[1] = 62 * 8 - 256;
+    for (int i = 0; i < 62; i++)
+        buf[2 + i] = (uint8_t)(0xA5 ^ i);
+    return 64;
+}
+
+static uint32_t build_xfer_read(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    (void)i;
+    (void)n_packets;
+    return build_xfer(buf, true);
+}
+
+static uint32_t build_xfer_noread(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    (void)i;
+    (void)n_packets;
+    return build_xfer(buf, false);
+}
+
+/* 491 bits LSB first, the last byte partial */
+#define XFER_LSB_BITS (61 * 8 + 3)
+
+static uint32_t build_xfer_lsb(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    (void)i;
+    (void)n_packets;
+    buf[0] = CMD_XFER | EXTEND_LENGTH | LSB_FIRST;
+    buf[1] = XFER_LSB_BITS - 256;
+    for (int j = 0; j < 62; j++)
+        buf[2 + j] = (uint8_t)(0xA5 ^ j);
+    return 64;
+}
+
+/* TDI is looped back to TDO: the data comes back in the low bits of the last byte */
+static unsigned check_xfer_lsb(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    unsigned errors = 0;
+    (void)i;
+    (void)n;
+    if (tap)
+        return 0;
+    for (uint32_t j = 0; j < len; j++)
+    {
+        uint8_t mask = (j == XFER_LSB_BITS / 8) ? (1 << (XFER_LSB_BITS % 8)) - 1 : 0xff;
+        if (response[j] != ((0xA5 ^ j) & mask))
+            errors++;
+    }
+    return errors;
+}
+
+/*
+ * An LSB_FIRST XFER, then a TCK pulse by CMD_SETSIG with TDI set on even
+ * packets, cleared on odd ones: the loopback must give it back to CMD_GETSIG
+ * whatever the bit order the XFER left.
+ */
+static uint32_t build_setsig_lsb(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    uint32_t n = 0;
+    (void)n_packets;
+    buf[n++] = CMD_XFER | NO_READ | LSB_FIRST;
+    buf[n++] = 8;
+    buf[n++] = (i & 1) ? 0xFF : 0x00;
+    buf[n++] = CMD_SETSIG;
+    buf[n++] = SIG_TDI;
+    buf[n++] = (i & 1) ? 0 : SIG_TDI;
+    buf[n++] = CMD_SETSIG;
+    buf[n++] = SIG_TCK;
+    buf[n++] = SIG_TCK;
+    buf[n++] = CMD_GETSIG;
+    return n;
+}
+
+static unsigned check_setsig_lsb(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    (void)n;
+    if (tap)
+        return 0;
+    return len != 1 || !(response[0] & SIG_TDO) != (i & 1);
+}
+
+/*
+ * A 160 bit CMD_VERIFY per packet, expecting the TDI back. A bit that differs
+ * under a cleared mask bit is always there, every other packet has one more
+ * that counts.
+ */
+#define VERIFY_BITS 160
+
+static unsigned verify_mismatch(unsigned i)
+{
+    return (i & 1) ? 8 + (i * 13) % (VERIFY_BITS - 8) : 0xFFFF;
+}
+
+static uint32_t build_verify(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    const uint32_t bytes = VERIFY_BITS / 8;
+    unsigned k = verify_mismatch(i);
+    (void)n_packets;
+    buf[0] = CMD_VERIFY;
+    buf[1] = VERIFY_BITS;
+    for (uint32_t j = 0; j < bytes; j++)
+    {
+        buf[2 + j] = (uint8_t)(0x5A ^ (i + j * 7));
+        buf[2 + bytes + j] = buf[2 + j];
+        buf[2 + 2 * bytes + j] = 0xff;
+    }
+    buf[2 + bytes] ^= 0x10;
+    buf[2 + 2 * bytes] &= ~0x10;
+    if (k != 0xFFFF)
+        buf[2 + bytes + k / 8] ^= 0x80 >> (k % 8);
+    return 2 + 3 * bytes;
+}
+
+static unsigned check_verify(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    (void)n;
+    if (tap)
+        return 0;
+    return len != 2 || ((response[0] << 8) | response[1]) != verify_mismatch(i);
+}
+
+/*
+ * A 32 bit CMD_POLL per packet of at most POLL_TRIES scans. The loopback
+ * matches at once on even packets, never on odd ones, the busy bit being
+ * expected clear while TDI keeps it set.
+ */
+#define POLL_TRIES 20
+
+static uint32_t build_poll(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    (void)n_packets;
+    buf[0] = CMD_POLL;
+    buf[1] = 32;
+    buf[2] = 0;
+    buf[3] = POLL_TRIES;
+    buf[4] = 0;
+    buf[5] = 100;
+    for (int j = 0; j < 4; j++)
+    {
+        buf[6 + j] = (uint8_t)(0x81 ^ (i + j));
+        buf[10 + j] = buf[6 + j];
+        buf[14 + j] = j == 0 ? 0x80 : 0;
+    }
+    if (i & 1)
+    {
+        buf[6] |= 0x80;
+        buf[10] &= ~0x80;
+    }
+    return 18;
+}
+
+static unsigned check_poll(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    unsigned errors = 0;
+    (void)n;
+    if (tap)
+        return 0;
+    if (len != 6 || ((response[0] << 8) | response[1]) != ((i & 1) ? POLL_TRIES : 1))
+        return 1;
+    for (int j = 0; j < 4; j++)
+    {
+        uint8_t tdi = (uint8_t)(0x81 ^ (i + j)) | ((i & 1) && j == 0 ? 0x80 : 0);
+        if (response[2 + j] != tdi)
+            errors++;
+    }
+    return errors;
+}
+
+/*
+ * Packet 0 defines a macro of a 32 bit XFER, whose TDI is its parameter, a
+ * CMD_CLK and a fixed 8 bit XFER. The next packets run it MACRO_RUNS times
+ * each, the last one then asks for its hit count. Each also runs an undefined
+ * macro, whose parameters must not be taken for commands: its definition, a
+ * CMD_STOP, is refused.
+ */
+#define MACRO_ID 1
+#define MACRO_RUNS 7
+#define MACRO_UNDEFINED 2
+
+static const uint8_t macro_body[] = { CMD_XFER, 32, 0, 0, 0, 0, CMD_CLK, SIG_TMS, 4, CMD_XFER, 8, 0xA5 };
+
+static uint8_t macro_param(unsigned i, unsigned k, unsigned j)
+{
+    return (uint8_t)(i * 31 + k * 7 + j);
+}
+
+static uint32_t build_macro(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    uint32_t n = 0;
+    if (i == 0)
+    {
+        macro_params[MACRO_ID] = 4;
+        macro_response[MACRO_ID] = 5;
+        buf[n++] = CMD_MACRO;
+        buf[n++] = MACRO_UNDEFINED;
+        buf[n++] = 0;
+        buf[n++] = 0;
+        buf[n++] = 1;
+        buf[n++] = CMD_STOP;
+        buf[n++] = CMD_MACRO;
+        buf[n++] = MACRO_ID;
+        buf[n++] = 1;
+        buf[n++] = 0;
+        buf[n++] = sizeof(macro_body);
+        /* the slot, 4 bytes at offset 2 */
+        buf[n++] = 0;
+        buf[n++] = 2;
+        buf[n++] = 4;
+        memcpy(&buf[n], macro_body, sizeof(macro_body));
+        return n + sizeof(macro_body);
+    }
+    buf[n++] = CMD_MACRO | MACRO_RUN;
+    buf[n++] = MACRO_UNDEFINED;
+    buf[n++] = 4;
+    for (unsigned j = 0; j < 4; j++)
+        buf[n++] = CMD_GETSIG;
+    for (unsigned k = 0; k < MACRO_RUNS; k++)
+    {
+        buf[n++] = CMD_MACRO | MACRO_RUN;
+        buf[n++] = MACRO_ID;
+        buf[n++] = 4;
+        for (unsigned j = 0; j < 4; j++)
+            buf[n++] = macro_param(i, k, j);
+    }
+    if (i == n_packets - 1)
+    {
+        buf[n++] = CMD_MACRO | MACRO_HITS;
+        buf[n++] = MACRO_ID;
+    }
+    return n;
+}
+
+static unsigned check_macro(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    unsigned errors = 0;
+    if (i == 0)
+        return len != 2 || response[0] != 0 || response[1] != 1;
+    if (len != 5 * MACRO_RUNS + (i == n - 1 ? 4 : 0))
+        return 1;
+    for (unsigned k = 0; k < MACRO_RUNS && !tap; k++)
+    {
+        for (unsigned j = 0; j < 4; j++)
+            errors += response[5 * k + j] != macro_param(i, k, j);
+        errors += response[5 * k + 4] != 0xA5;
+    }
+    if (i == n - 1)
+    {
+        const uint8_t *hits = &response[5 * MACRO_RUNS];
+        uint32_t expected = MACRO_RUNS * (n - 1);
+        errors += ((uint32_t)hits[0] << 24 | hits[1] << 16 | hits[2] << 8 | hits[3]) != expected;
+    }
+    return errors;
+}
+
+/* many short scans per packet, dominated by parse and setup overhead */
+static uint32_t build_xfer_short(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    uint32_t n = 0;
+    (void)i;
+    (void)n_packets;
+    while (n + 3 <= PACKET_SIZE - 1)
+    {
+        buf[n++] = CMD_XFER;
+        buf[n++] = 8;
+        buf[n++] = 0x5A;
+    }
+    buf[n++] = CMD_STOP;
+    return n;
+}
+
+/* packet mode: a CHAIN_COUNT then CMD_STOP, and CMD_INFOs ending with a cut XFER the probe must drop */
+static uint32_t build_packet_mode(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    uint32_t n = 0;
+    (void)i;
+    (void)n_packets;
+    buf[n++] = CMD_CHAIN | CHAIN_COUNT;
+    buf[n++] = 0;
+    buf[n++] = CMD_STOP;
+    while (n < PACKET_SIZE - 2)
+        buf[n++] = CMD_INFO;
+    buf[n++] = CMD_XFER | EXTEND_LENGTH;
+    buf[n++] = 255;
+    return n;
+}
+
+static unsigned check_packet_mode(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    (void)i;
+    (void)n;
+    return len != 1 || response[0] != chain_count;
+}
+
+/* one-byte XFERs back to back in a stream cut into full packets, so commands straddle them */
+static uint32_t build_xfer_stream(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    static const uint8_t command[3] = { CMD_XFER, 8, 0x5A };
+    uint32_t len = PACKET_SIZE;
+    /* the stream ends with a whole command */
+    if (i == n_packets - 1)
+        len -= (n_packets * PACKET_SIZE) % 3;
+    for (uint32_t n = 0; n < len; n++)
+        buf[n] = command[(i * PACKET_SIZE + n) % 3];
+    return len;
+}
+
+static uint32_t build_clk(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    uint32_t n = 0;
+    (void)i;
+    (void)n_packets;
+    while (n + 3 <= PACKET_SIZE - 1)
+    {
+        buf[n++] = CMD_CLK;
+        buf[n++] = 0;
+        buf[n++] = 255;
+    }
+    buf[n++] = CMD_STOP;
+    return n;
+}
+
+/* the sequence of dirtyjtag-test4.py: TAP navigation, IR and DR scans */
+static const uint8_t test4_packets[][PACKET_SIZE + 1] = {
+    { 4, 0x6, 0x10, 0x7, 0x0 },
+    { 13, 0x6, 0x10, 0x3, 0x6, 0x0, 0x1, 0x6, 0x10, 0x1, 0x6, 0x0, 0x2, 0x0 },
+    { 34, 0x3, 0xaf, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x86, 0x14, 0x1, 0x6, 0x0, 0x1, 0x6, 0x10, 0x7, 0x0 },
+    { 26, 0x6, 0x10, 0x2, 0x6, 0x0, 0x1, 0x6, 0x10, 0x2, 0x6, 0x0, 0x2, 0x3, 0xf, 0xff, 0xff, 0x86, 0x14,
+      0x1, 0x6, 0x10, 0x1, 0x6, 0x0, 0x1, 0x0 },
+    { 64, 0x6, 0x10, 0x2, 0x6, 0x0, 0x2, 0x83, 0xd, 0xff, 0xd4, 0x6, 0x14, 0x1, 0x6, 0x10, 0x1,
+      0x6, 0x0, 0x1, 0x6, 0x10, 0x1, 0x6, 0x0, 0x2, 0x3, 0x23, 0x10, 0x0, 0x0, 0x0, 0x0,
+      0x86, 0x10, 0x1, 0x6, 0x10, 0x1, 0x6, 0x0, 0x1, 0x6, 0x10, 0x1, 0x6, 0x0, 0x2, 0x3,
+      0x23, 0x24, 0x40, 0x0, 0x0, 0xa0, 0x86, 0x10, 0x1, 0x6, 0x10, 0x1, 0x6, 0x0, 0x1, 0x0 },
+};
+
+static uint32_t build_test4(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    (void)n_packets;
+    const uint8_t *p = test4_packets[i % (sizeof(test4_packets) / sizeof(test4_packets[0]))];
+    memcpy(buf, &p[1], p[0]);
+    return p[0];
+}
+
+/*
+ * A single CMD_LONGXFER spanning all the packets: the header and the first
+ * LONGXFER_FIRST bytes in packet 0, then full packets of data.
+ */
+#define LONGXFER_FIRST (PACKET_SIZE - 5)
+
+static uint8_t longxfer_byte(uint64_t k)
+{
+    return (uint8_t)(0x3C ^ ((k % 62) * 11));
+}
+
+static uint64_t longxfer_offset(unsigned i)
+{
+    return i ? LONGXFER_FIRST + (uint64_t)(i - 1) * PACKET_SIZE : 0;
+}
+
+static uint32_t build_longxfer(uint8_t *buf, unsigned i, unsigned n_packets, bool read)
+{
+    uint32_t len = 0;
+    if (i == 0)
+    {
+        uint32_t bits = (uint32_t)longxfer_offset(n_packets) * 8;
+        buf[len++] = CMD_LONGXFER | (read ? 0 : NO_READ);
+        buf[len++] = bits >> 24;
+        buf[len++] = bits >> 16;
+        buf[len++] = bits >> 8;
+        buf[len++] = bits;
+    }
+    for (uint64_t k = longxfer_offset(i); k < longxfer_offset(i + 1); k++)
+        buf[len++] = longxfer_byte(k);
+    return len;
+}
+
+static uint32_t build_longxfer_read(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    return build_longxfer(buf, i, n_packets, true);
+}
+
+static uint32_t build_longxfer_noread(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    return build_longxfer(buf, i, n_packets, false);
+}
+
+/* TDI is looped back to TDO: the response to a packet is its data */
+static unsigned check_longxfer_read(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    unsigned errors = 0;
+    (void)n;
+    if (tap)
+        return 0;
+    for (uint32_t j = 0; j < len; j++)
+    {
+        if (response[j] != longxfer_byte(longxfer_offset(i) + j))
+            errors++;
+    }
+    return errors;
+}
+
+/*
+ * A packed CMD_LONGXFER spanning all the packets, as many bytes of a made up
+ * FPGA bitstream as fit. Its 128 byte frames are empty, erased, copies of a
+ * recent frame, sparse or noise.
+ */
+static uint8_t *bitstream;
+static uint32_t bitstream_length;
+static uint8_t *packed;
+static uint32_t packed_length;
+static uint32_t packed_checked;
+
+static uint32_t lcg(uint32_t x)
+{
+    return x * 1664525u + 1013904223u;
+}
+
+static void bitstream_frame(uint8_t *frame, uint32_t f)
+{
+    uint32_t h = lcg(f ^ 0x5EED);
+    switch ((h >> 16) % 8)
+    {
+    case 0:
+    case 1:
+    case 2:
+    case 3:
+        memset(frame, 0x00, 128);
+        break;
+    case 4:
+        memset(frame, 0xFF, 128);
+        break;
+    case 5:
+        if (f)
+        {
+            memcpy(frame, frame - 128 * (1 + h % MIN(f, 8)), 128);
+            break;
+        }
+        /* fall through */
+    case 6:
+        memset(frame, 0x00, 128);
+        for (int j = 0; j < 16; j++)
+        {
+            h = lcg(h);
+            frame[(h >> 8) % 128] = h >> 24;
+        }
+        break;
+    default:
+        for (int j = 0; j < 128; j++)
+        {
+            h = lcg(h);
+            frame[j] = h >> 24;
+        }
+        break;
+    }
+}
+
+/* Longest repeat of the byte at k, and longest match with the PACK_WINDOW bytes before it */
+static uint32_t pack_repeat(uint32_t k, uint32_t n)
+{
+    uint32_t len = 1;
+    while (k + len < n && len < (1 << 14) && bitstream[k + len] == bitstream[k])
+        len++;
+    return len;
+}
+
+static uint32_t pack_match(uint32_t k, uint32_t n, uint32_t *distance)
+{
+    uint32_t best = 0;
+    for (uint32_t d = 1; d <= PACK_WINDOW && d <= k; d++)
+    {
+        uint32_t len = 0;
+        while (k + len < n && len < 0x3F + 4 && bitstream[k + len] == bitstream[k + len - d])
+            len++;
+        if (len > best)
+        {
+            best = len;
+            *distance = d;
+        }
+    }
+    return best;
+}
+
+/* Packs the bitstream into packed until budget bytes are used, greedily, returns the bytes of bitstream packed */
+static uint32_t pack_bitstream(uint32_t budget)
+{
+    uint32_t k = 0, literal = 0, out = 0, n = bitstream_length;
+    packed_length = 0;
+    while (k < n)
+    {
+        uint32_t distance = 0;
+        uint32_t repeat = pack_repeat(k, n);
+        uint32_t match = repeat >= 4 ? 0 : pack_match(k, n, &distance);
+        uint32_t token = repeat >= 4 || match >= 4 ? 3 : 0;
+        /* a literal token ends before any other one, or when full */
+        if (literal && (token || literal == 128))
+        {
+            packed[out - literal - 1] = literal - 1;
+            literal = 0;
+        }
+        if (out + (token ? token : literal ? 1 : 2) > budget)
+            break;
+        if (repeat >= 4)
+        {
+            packed[out++] = 0x80 | (repeat - 1) >> 8;
+            packed[out++] = repeat - 1;
+            packed[out++] = bitstream[k];
+            k += repeat;
+        }
+        else if (match >= 4)
+        {
+            packed[out++] = 0xC0 | (match - 4);
+            packed[out++] = (distance - 1) >> 8;
+            packed[out++] = distance - 1;
+            k += match;
+        }
+        else
+        {
+            if (!literal)
+                out++;
+            packed[out++] = bitstream[k++];
+            literal++;
+        }
+    }
+    if (literal)
+        packed[out - literal - 1] = literal - 1;
+    packed_length = out;
+    return k;
+}
+
+static void packed_build(unsigned n_packets)
+{
+    uint32_t budget = (uint32_t)longxfer_offset(n_packets);
+    /* room for 32 times as much as the data takes */
+    bitstream_length = budget * 32 / 128 * 128;
+    bitstream = realloc(bitstream, bitstream_length);
+    packed = realloc(packed, budget);
+    for (uint32_t f = 0; f < bitstream_length / 128; f++)
+        bitstream_frame(&bitstream[f * 128], f);
+    bitstream_length = pack_bitstream(budget);
+    packed_checked = 0;
+}
+
+static uint32_t build_longxfer_packed(uint8_t *buf, unsigned i, unsigned n_packets, bool read)
+{
+    uint32_t len = 0, start = (uint32_t)longxfer_offset(i), end = (uint32_t)longxfer_offset(i + 1);
+    if (i == 0)
+    {
+        uint32_t bits;
+        packed_build(n_packets);
+        bits = bitstream_length * 8;
+        buf[len++] = CMD_LONGXFER | PACKED_TDI | (read ? 0 : NO_READ);
+        buf[len++] = bits >> 24;
+        buf[len++] = bits >> 16;
+        buf[len++] = bits >> 8;
+        buf[len++] = bits;
+    }
+    /* what is left of the last packet after the data is CMD_STOPs */
+    for (uint32_t k = start; k < end; k++)
+        buf[len++] = k < packed_length ? packed[k] : CMD_STOP;
+    return len;
+}
+
+static uint32_t build_longxfer_packed_read(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    return build_longxfer_packed(buf, i, n_packets, true);
+}
+
+static uint32_t build_longxfer_packed_noread(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    return build_longxfer_packed(buf, i, n_packets, false);
+}
+
+/* TDI is looped back to TDO: the responses are the bitstream */
+static unsigned check_longxfer_packed(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    unsigned errors = 0;
+    (void)i;
+    (void)n;
+    if (tap)
+        return 0;
+    for (uint32_t j = 0; j < len; j++)
+    {
+        if (packed_checked >= bitstream_length || response[j] != bitstream[packed_checked++])
+            errors++;
+    }
+    return errors;
+}
+
+/* The bitstream, not packed, read back with a PACKED_TDO CMD_LONGXFER spanning all the packets */
+static uint8_t unpack_token[3];
+static uint32_t unpack_token_len;
+static uint32_t unpack_literal;
+
+static uint32_t build_longxfer_packed_tdo(uint8_t *buf, unsigned i, unsigned n_packets)
+{
+    uint32_t len = 0;
+    if (i == 0)
+    {
+        uint32_t bits;
+        bitstream_length = (uint32_t)longxfer_offset(n_packets);
+        bitstream = realloc(bitstream, bitstream_length + 128);
+        for (uint32_t f = 0; f * 128 < bitstream_length; f++)
+            bitstream_frame(&bitstream[f * 128], f);
+        packed_checked = 0;
+        unpack_token_len = unpack_literal = 0;
+        bits = bitstream_length * 8;
+        buf[len++] = CMD_LONGXFER | PACKED_TDO;
+        buf[len++] = bits >> 24;
+        buf[len++] = bits >> 16;
+        buf[len++] = bits >> 8;
+        buf[len++] = bits;
+    }
+    for (uint64_t k = longxfer_offset(i); k < longxfer_offset(i + 1); k++)
+        buf[len++] = bitstream[k];
+    return len;
+}
+
+/* TDI is looped back to TDO: the responses unpack to the bitstream */
+static unsigned check_longxfer_packed_tdo(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    unsigned errors = 0;
+    (void)i;
+    (void)n;
+    for (uint32_t j = 0; j < len; j++)
+    {
+        if (unpack_literal)
+        {
+            unpack_literal--;
+            if (packed_checked >= bitstream_length || response[j] != bitstream[packed_checked++])
+                errors++;
+            continue;
+        }
+        unpack_token[unpack_token_len++] = response[j];
+        if (!(unpack_token[0] & 0x80))
+        {
+            unpack_literal = unpack_token[0] + 1;
+            unpack_token_len = 0;
+        }
+        else if (unpack_token[0] & 0x40)
+        {
+            /* TDO is not packed with copies */
+            errors++;
+            unpack_token_len = 0;
+        }
+        else if (unpack_token_len == 3)
+        {
+            uint32_t run = (((unpack_token[0] & 0x3F) << 8) | unpack_token[1]) + 1;
+            for (uint32_t k = 0; k < run; k++)
+            {
+                if (packed_checked >= bitstream_length || bitstream[packed_checked++] != unpack_token[2])
+                    errors++;
+            }
+            unpack_token_len = 0;
+        }
+    }
+    return errors;
+}
+
+/* Packs bits, in shift order, MSB first as CMD_XFER expects them */
+static void pack_bits(const uint8_t *bits, uint32_t n, uint8_t *out)
+{
+    memset(out, 0, (n + 7) / 8);
+    for (uint32_t i = 0; i < n; i++)
+        out[i / 8] |= bits[i] << (7 - (i % 8));
+}
+
+static uint32_t put_clk(uint8_t *buf, bool tms, bool tdi, uint8_t count, bool readout)
+{
+    buf[0] = CMD_CLK | (readout ? READOUT : 0);
+    buf[1] = (tms ? SIG_TMS : 0) | (tdi ? SIG_TDI : 0);
+    buf[2] = count;
+    return 3;
+}
+
+/* From anywhere: Test-Logic-Reset, Run-Test/Idle, then Shift-DR or Shift-IR */
+static uint32_t put_goto_shift(uint8_t *buf, bool ir)
+{
+    uint32_t n = 0;
+    n += put_clk(&buf[n], true, false, 5, false);
+    n += put_clk(&buf[n], false, false, 1, false);
+    n += put_clk(&buf[n], true, false, ir ? 2 : 1, false);
+    n += put_clk(&buf[n], false, false, 2, false);
+    return n;
+}
+
+/* From Shift-xR, the last bit shifted on the way: Exit1, Update, Run-Test/Idle */
+static uint32_t put_exit_shift(uint8_t *buf, bool last_tdi, bool readout)
+{
+    uint32_t n = 0;
+    n += put_clk(&buf[n], true, last_tdi, 1, readout);
+    n += put_clk(&buf[n], true, false, 1, false);
+    n += put_clk(&buf[n], false, false, 1, false);
+    return n;
+}
+
+/* CMD_CLK with TMS_VECTOR, tms given one bit per byte */
+static uint32_t put_tms(uint8_t *buf, const uint8_t *tms, uint8_t count, bool tdi, bool readout)
+{
+    buf[0] = CMD_CLK | TMS_VECTOR | (readout ? READOUT : 0);
+    buf[1] = tdi ? SIG_TDI : 0;
+    buf[2] = count;
+    pack_bits(tms, count, &buf[3]);
+    return 3 + (count + 7) / 8;
+}
+
+/* Loads instr in device 0 and BYPASS in the others, ends in Run-Test/Idle */
+static uint32_t put_select(uint8_t *buf, uint8_t instr)
+{
+    uint8_t bits[TAP_IR_LENGTH * 8];
+    uint32_t n_bits = TAP_IR_LENGTH * tap_devices;
+    uint32_t n = put_goto_shift(buf, true);
+
+    for (uint32_t i = 0; i < n_bits; i++)
+        bits[i] = (i < TAP_IR_LENGTH) ? (instr >> i) & 1 : 1;
+    buf[n++] = CMD_XFER | NO_READ;
+    buf[n++] = n_bits - 1;
+    pack_bits(bits, n_bits - 1, &buf[n]);
+    n += (n_bits - 1 + 7) / 8;
+    n += put_exit_shift(&buf[n], bits[n_bits - 1], false);
+    return n;
+}
+
+/*
+ * The status register of device 0 polled with CMD_POLL until its busy bit
+ * clears, which takes a new capture for each scan.
+ */
+static uint32_t build_tap_poll(uint8_t *buf, unsigned i, unsigned n)
+{
+    uint32_t len = put_select(buf, TAP_STATUS_INSTR);
+    uint32_t bits = 8 + tap_devices - 1;
+    uint32_t bytes = (bits + 7) / 8;
+    (void)i;
+    (void)n;
+    /* Select-DR-Scan, Capture-DR, Shift-DR */
+    len += put_clk(&buf[len], true, false, 1, false);
+    len += put_clk(&buf[len], false, false, 2, false);
+    buf[len++] = CMD_POLL;
+    buf[len++] = bits;
+    buf[len++] = 0;
+    buf[len++] = POLL_TRIES;
+    buf[len++] = 0;
+    buf[len++] = 0;
+    memset(&buf[len], 0xFF, bytes);
+    memset(&buf[len + bytes], 0, 2 * bytes);
+    /* the busy bit is the first one out */
+    buf[len + 2 * bytes] = 0x80;
+    len += 3 * bytes;
+    len += put_exit_shift(&buf[len], true, false);
+    return len;
+}
+
+static unsigned check_tap_poll(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    (void)i;
+    (void)n;
+    /* the status register comes first, LSB first, SIM_TAP_STATUS_READY reads the same either way */
+    return (len != 2 + (8 + tap_devices - 1 + 7) / 8) || (((response[0] << 8) | response[1]) != TAP_STATUS_BUSY + 1)
+        || (response[2] != SIM_TAP_STATUS_READY);
+}
+
+/* IDCODE scan of the whole chain after a reset */
+static uint32_t build_tap_idcode(uint8_t *buf, unsigned i, unsigned n)
+{
+    uint32_t len = put_goto_shift(buf, false);
+    uint32_t bits = 32 * tap_devices;
+    (void)i;
+    (void)n;
+    buf[len++] = CMD_XFER;
+    buf[len++] = bits - 1;
+    memset(&buf[len], 0xFF, (bits - 1 + 7) / 8);
+    len += (bits - 1 + 7) / 8;
+    len += put_exit_shift(&buf[len], true, true);
+    buf[len++] = CMD_STOP;
+    return len;
+}
+
+/* Same with the TAP navigation done by TMS vectors */
+static uint32_t build_tap_idcode_tms(uint8_t *buf, unsigned i, unsigned n)
+{
+    /* Test-Logic-Reset, Run-Test/Idle, Select-DR, Capture-DR, Shift-DR */
+    static const uint8_t goto_shift_dr[] = { 1, 1, 1, 1, 1, 0, 1, 0, 0 };
+    /* last bit shifted on the way to Exit1-DR, Update-DR, Run-Test/Idle */
+    static const uint8_t exit_shift[] = { 1, 1, 0 };
+    uint32_t len = put_tms(buf, goto_shift_dr, sizeof(goto_shift_dr), false, false);
+    uint32_t bits = 32 * tap_devices;
+    (void)i;
+    (void)n;
+    buf[len++] = CMD_XFER;
+    buf[len++] = bits - 1;
+    memset(&buf[len], 0xFF, (bits - 1 + 7) / 8);
+    len += (bits - 1 + 7) / 8;
+    len += put_tms(&buf[len], exit_shift, sizeof(exit_shift), true, true);
+    buf[len++] = CMD_STOP;
+    return len;
+}
+
+static unsigned check_tap_idcode(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    uint32_t bits = 32 * tap_devices;
+    unsigned errors = 0;
+    (void)len;
+    (void)i;
+    (void)n;
+    for (uint32_t d = 0; d < tap_devices; d++)
+    {
+        uint32_t idcode = 0;
+        for (uint32_t b = 0; b < 32; b++)
+        {
+            uint32_t k = d * 32 + b;
+            bool bit;
+            if (k == bits - 1)
+                bit = response[(bits - 1 + 7) / 8] & 0x80;
+            else
+                bit = response[k / 8] & (0x80 >> (k % 8));
+            idcode |= (uint32_t)bit << b;
+        }
+        if (idcode != TAP_IDCODE)
+            errors++;
+    }
+    return errors;
+}
+
+/* Stream the user data register of device 0: select it, 62 byte NO_READ XFERs, update */
+static const uint8_t *tap_dr_payload(void)
+{
+    static uint8_t payload[62];
+    for (int j = 0; j < 62; j++)
+        payload[j] = longxfer_byte(j);
+    return payload;
+}
+
+static uint32_t build_tap_dr(uint8_t *buf, unsigned i, unsigned n)
+{
+    uint32_t len = 0;
+    if (i == 0)
+    {
+        len += put_select(&buf[len], TAP_USER_INSTR);
+        len += put_clk(&buf[len], true, false, 1, false);
+        len += put_clk(&buf[len], false, false, 2, false);
+        buf[len++] = CMD_STOP;
+        return len;
+    }
+    if (i == n - 1)
+    {
+        len += put_exit_shift(&buf[len], true, false);
+        buf[len++] = CMD_STOP;
+        return len;
+    }
+    buf[len++] = CMD_XFER | EXTEND_LENGTH | NO_READ;
+    buf[len++] = 62 * 8 - 256;
+    memcpy(&buf[len], tap_dr_payload(), 62);
+    return len + 62;
+}
+
+/* Checks the user DR of device 0 once shifted bits of the payload, then the exit bit, went in */
+static unsigned check_tap_dr_bits(int64_t shifted)
+{
+    const uint8_t *dr = sim_tap_user_dr(tap, 0);
+    const uint8_t *payload = tap_dr_payload();
+    unsigned errors = 0;
+
+    /*
+     * The register holds the last bits that reached device 0, the exit bit (1)
+     * ending the stream. The other devices are in BYPASS and delay it by one
+     * bit each, their bypass register capturing 0.
+     */
+    for (int64_t k = 0; k < TAP_USER_DR_LENGTH && k <= shifted; k++)
+    {
+        int64_t s = shifted - (int64_t)(tap_devices - 1) - k;
+        bool expected;
+        if (s == shifted)
+            expected = true;
+        else if (s < 0)
+            expected = false;
+        else
+            expected = payload[(s % (62 * 8)) / 8] & (0x80 >> (s % 8));
+        if (dr[TAP_USER_DR_LENGTH - 1 - k] != expected)
+            errors++;
+    }
+    return errors;
+}
+
+static unsigned check_tap_dr(unsigned n)
+{
+    if (n < 2)
+        return 1;
+    return check_tap_dr_bits((int64_t)(n - 2) * 62 * 8);
+}
+
+/* Same as tap_dr, a single CMD_LONGXFER from packet 1 to packet n - 2 */
+static uint32_t build_tap_longdr(uint8_t *buf, unsigned i, unsigned n)
+{
+    if (i == 0 || i == n - 1)
+        return build_tap_dr(buf, i, n);
+    return build_longxfer(buf, i - 1, n - 2, false);
+}
+
+static unsigned check_tap_longdr(unsigned n)
+{
+    if (n < 3)
+        return 1;
+    return check_tap_dr_bits((int64_t)longxfer_offset(n - 2) * 8);
+}
+
+/*
+ * A CMD_XSVF spanning all the packets: IDCODE loaded in every device, then as
+ * many XSDRTDO checking the IDCODEs as fit, XCOMPLETE. Its answer comes with
+ * the last packet.
+ */
+#define XSVF_FIRST (PACKET_SIZE - 5)
+
+static uint8_t *xsvf_program;
+static uint32_t xsvf_length;
+static uint32_t xsvf_instructions;
+
+static void xsvf_put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void xsvf_build(unsigned n_packets)
+{
+    uint32_t total = XSVF_FIRST + (n_packets - 1) * PACKET_SIZE;
+    uint32_t sdr_bytes = 4 * tap_devices;
+    uint32_t xsdrtdo = 1 + 2 * sdr_bytes;
+    uint32_t len = 0;
+    uint8_t *p = xsvf_program = realloc(xsvf_program, total);
+
+    /* XSTATE Test-Logic-Reset, XSTATE Run-Test/Idle, XSIR, XSDRSIZE, XTDOMASK */
+    p[len++] = 0x12;
+    p[len++] = 0;
+    p[len++] = 0x12;
+    p[len++] = 1;
+    p[len++] = 0x02;
+    p[len++] = TAP_IR_LENGTH * tap_devices;
+    memset(&p[len], TAP_IDCODE_INSTR, tap_devices);
+    len += tap_devices;
+    p[len++] = 0x08;
+    xsvf_put_u32(&p[len], 32 * tap_devices);
+    len += 4;
+    p[len++] = 0x01;
+    memset(&p[len], 0xFF, sdr_bytes);
+    len += sdr_bytes;
+    xsvf_instructions = 5;
+    /* XSDRTDO, the IDCODE of the device nearest TDO in the last bytes, then an XCOMMENT fills the rest */
+    while (len + xsdrtdo + 1 + 2 <= total || len + xsdrtdo + 1 == total)
+    {
+        p[len++] = 0x09;
+        memset(&p[len], 0, sdr_bytes);
+        len += sdr_bytes;
+        for (uint32_t d = 0; d < tap_devices; d++)
+            xsvf_put_u32(&p[len + sdr_bytes - 4 * (d + 1)], TAP_IDCODE);
+        len += sdr_bytes;
+        xsvf_instructions++;
+    }
+    if (len + 1 < total)
+    {
+        p[len++] = 0x16;
+        memset(&p[len], 'x', total - len - 2);
+        len = total - 1;
+        p[len - 1] = 0;
+        xsvf_instructions++;
+    }
+    p[len++] = 0x00;
+    xsvf_length = len;
+}
+
+static uint32_t build_tap_xsvf(uint8_t *buf, unsigned i, unsigned n)
+{
+    uint32_t len = 0, start, end;
+    if (i == 0)
+    {
+        xsvf_build(n);
+        buf[len++] = CMD_XSVF;
+        xsvf_put_u32(&buf[len], xsvf_length);
+        len += 4;
+    }
+    start = i ? XSVF_FIRST + (i - 1) * PACKET_SIZE : 0;
+    end = MIN(XSVF_FIRST + i * PACKET_SIZE, xsvf_length);
+    memcpy(&buf[len], &xsvf_program[start], end - start);
+    return len + end - start;
+}
+
+static unsigned check_tap_xsvf(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    (void)i;
+    (void)n;
+    if (len != 5 || response[0] != 0)
+        return 1;
+    return ((uint32_t)response[1] << 24 | response[2] << 16 | response[3] << 8 | response[4]) != xsvf_instructions;
+}
+
+/* TCK tuned and saved by packet 0, IDCODE scans at that TCK after it */
+static uint32_t build_tap_tune(uint8_t *buf, unsigned i, unsigned n)
+{
+    if (i != 0)
+        return build_tap_idcode(buf, i, n);
+    buf[0] = CMD_FREQ | AUTOTUNE | SAVE_FREQ;
+    buf[1] = 0;
+    buf[2] = 0;
+    buf[3] = CMD_STOP;
+    return 4;
+}
+
+static unsigned check_tap_tune(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    uint32_t clean_hz, hz;
+    if (i != 0)
+        return check_tap_idcode(response, len, i, n);
+    clean_hz = (uint32_t)response[0] << 24 | response[1] << 16 | response[2] << 8 | response[3];
+    hz = (uint32_t)response[4] << 24 | response[5] << 16 | response[6] << 8 | response[7];
+    if (!csv)
+        printf("    tuned TCK          %u Hz without error, %u Hz set\n", clean_hz, hz);
+    /* within a step of the limit of the chain, the margin below it, the divider rounding down */
+    return (clean_hz == 0) || (tap_max_khz && clean_hz > tap_max_khz * 1000u)
+        || (tap_max_khz && clean_hz * 11 / 10 <= tap_max_khz * 1000u) || (hz > clean_hz * 8 / 10)
+        || (hz < clean_hz * 7 / 10) || (hz != (uint32_t)sim_tck_hz());
+}
+
+/*
+ * Chains 1 and up delay TDI by their number on TDO. The bench sends each chain
+ * the same byte over and over, the delayed bits come from the byte before it:
+ * the byte is rotated, starting from the first one.
+ */
+#define CHAIN_XFER_BYTES 12
+
+typedef struct chain_delay {
+    uint32_t history;
+    unsigned tck;
+} chain_delay;
+
+static chain_delay chain_delays[SIM_CHAIN_MAX];
+static sim_jtag_target_t chain_targets[SIM_CHAIN_MAX];
+
+static uint8_t chain_byte(unsigned c)
+{
+    return (uint8_t)(0x96 + 0x11 * c);
+}
+
+static bool chain_delay_tck(void *ctx, bool tms, bool tdi)
+{
+    chain_delay *d = ctx;
+    bool tdo = (d->history >> (d->tck - 1)) & 1;
+    (void)tms;
+    d->history = (d->history << 1) | tdi;
+    return tdo;
+}
+
+static void chain_targets_set(void)
+{
+    for (unsigned c = 1; c < SIM_CHAIN_MAX; c++)
+    {
+        chain_delays[c] = (chain_delay){ .history = chain_byte(c) * 0x01010101u, .tck = c };
+        chain_targets[c] = (sim_jtag_target_t){ .tck = chain_delay_tck, .ctx = &chain_delays[c] };
+        sim_set_chain_target(c, &chain_targets[c]);
+    }
+}
+
+/* One XFER per chain, chain 0 last for the scenarios after this one */
+static uint32_t build_chain_xfer(uint8_t *buf, unsigned i, unsigned n)
+{
+    uint32_t len = 0;
+    (void)i;
+    (void)n;
+    for (unsigned k = 1; k <= chain_count; k++)
+    {
+        unsigned c = k % chain_count;
+        buf[len++] = CMD_CHAIN;
+        buf[len++] = c;
+        buf[len++] = CMD_XFER;
+        buf[len++] = CHAIN_XFER_BYTES * 8;
+        memset(&buf[len], chain_byte(c), CHAIN_XFER_BYTES);
+        len += CHAIN_XFER_BYTES;
+    }
+    return len;
+}
+
+static unsigned check_chain_xfer(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    unsigned errors = 0;
+    (void)i;
+    (void)n;
+    for (uint32_t j = 0; j < len; j++)
+    {
+        unsigned c = (j / CHAIN_XFER_BYTES + 1) % chain_count;
+        uint8_t b = chain_byte(c);
+        if (response[j] != (uint8_t)((b >> c) | (b << (8 - c))))
+            errors++;
+    }
+    return errors;
+}
+
+/*
+ * Chains 1 and 2 interleaved: a NO_READ XFER on each, its data ending on a
+ * word, left shifting by the firmware while the other chain is selected, then
+ * a read back XFER on each whose first bits are the end of the NO_READ one.
+ */
+#define CHAIN_NOREAD_BYTES 16
+#define CHAIN_READ_BYTES 4
+
+static uint32_t build_chain_interleave(uint8_t *buf, unsigned i, unsigned n)
+{
+    uint32_t len = 0;
+    (void)i;
+    (void)n;
+    for (unsigned c = 1; c <= 2; c++)
+    {
+        buf[len++] = CMD_CHAIN;
+        buf[len++] = c;
+        buf[len++] = CMD_XFER | NO_READ;
+        buf[len++] = CHAIN_NOREAD_BYTES * 8;
+        memset(&buf[len], chain_byte(c), CHAIN_NOREAD_BYTES);
+        len += CHAIN_NOREAD_BYTES;
+    }
+    for (unsigned c = 1; c <= 2; c++)
+    {
+        buf[len++] = CMD_CHAIN;
+        buf[len++] = c;
+        buf[len++] = CMD_XFER;
+        buf[len++] = CHAIN_READ_BYTES * 8;
+        memset(&buf[len], (uint8_t)~chain_byte(c), CHAIN_READ_BYTES);
+        len += CHAIN_READ_BYTES;
+    }
+    buf[len++] = CMD_CHAIN;
+    buf[len++] = 0;
+    return len;
+}
+
+static unsigned check_chain_interleave(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    unsigned errors = len != 2 * CHAIN_READ_BYTES;
+    (void)i;
+    (void)n;
+    for (uint32_t j = 0; j < len; j++)
+    {
+        unsigned c = j / CHAIN_READ_BYTES + 1;
+        uint8_t before = (j % CHAIN_READ_BYTES) ? (uint8_t)~chain_byte(c) : chain_byte(c);
+        uint8_t b = (uint8_t)~chain_byte(c);
+        if (response[j] != (uint8_t)((b >> c) | (before << (8 - c))))
+            errors++;
+    }
+    return errors;
+}
+
+/*
+ * CMD_STATS reset by packet 0, 62 byte XFERs then, read back by the last
+ * packet and checked against what was sent.
+ */
+static uint32_t build_stats(uint8_t *buf, unsigned i, unsigned n)
+{
+    if (i == 0 || i == n - 1)
+    {
+        buf[0] = CMD_STATS | (i == 0 ? STATS_RESET : 0);
+        return 1;
+    }
+    return build_xfer(buf, i & 1);
+}
+
+static uint32_t stats_word(const uint8_t *response, unsigned k)
+{
+    const uint8_t *p = response + 1 + 4 * k;
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static unsigned check_stats(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    unsigned xfers = n - 2;
+    uint32_t bits, dma, polled;
+    if (i == 0 || i != n - 1)
+        return 0;
+    response += len - STATS_SIZE;
+    /* bits_shifted (2 words), commands (16 words), dma_shifts, polled_shifts, dma_wait_us (2 words) */
+    bits = stats_word(response, 1);
+    dma = stats_word(response, 18);
+    polled = stats_word(response, 19);
+    if (!csv)
+        printf("    stats              %u bits, %u DMA / %u polled shifts, %u us waiting on DMA\n",
+               bits, dma, polled, stats_word(response, 21));
+    /* the OUT packets core0 read before the reset was executed are not counted, they are not checked */
+    return (response[0] != STATS_WORDS) + (stats_word(response, 0) != 0) + (bits != xfers * 62 * 8)
+        + (stats_word(response, 2 + CMD_XFER) != xfers) + (stats_word(response, 2 + CMD_STATS) != 1)
+        + (dma + polled < xfers);
+}
+
+/*
+ * Trace started by packet 0, read back by the last packet, one 62 byte XFER
+ * recorded per packet in between. The last packet dumps twice, the second dump
+ * must be empty. With -d the dump is saved, for dirtyjtag-trace.py.
+ */
+static uint32_t build_trace(uint8_t *buf, unsigned i, unsigned n)
+{
+    if (i == 0 || i == n - 1)
+    {
+        buf[0] = CMD_STATS | TRACE;
+        buf[1] = (i == 0) ? TRACE_ON : TRACE_DUMP;
+        buf[2] = CMD_STATS | TRACE;
+        buf[3] = TRACE_DUMP;
+        buf[4] = CMD_STATS | TRACE;
+        buf[5] = TRACE_OFF;
+        trace_expected = (n > 2) ? MIN(n - 2, TRACE_RECORDS) : 0;
+        trace_in_ring = (i == 0) ? 0 : trace_expected;
+        return (i == 0) ? 2 : 6;
+    }
+    return build_xfer(buf, true);
+}
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static unsigned check_trace(const uint8_t *response, uint32_t len, unsigned i, unsigned n)
+{
+    static const uint8_t empty[TRACE_HEADER_SIZE];
+    unsigned errors = 0;
+    uint32_t count, dropped;
+    if (i == 0 || i != n - 1)
+        return 0;
+    /* the second dump, right after the first one */
+    if (memcmp(response + len - TRACE_HEADER_SIZE, empty, TRACE_HEADER_SIZE))
+        return 1;
+    response += len - 2 * TRACE_HEADER_SIZE - TRACE_RECORD_SIZE * trace_expected;
+    count = (response[0] << 8) | response[1];
+    dropped = be32(response + 2);
+    if (count != trace_expected || dropped != (n > 2 ? n - 2 - count : 0))
+        return 1;
+    for (uint32_t k = 0; k < count; k++)
+    {
+        const uint8_t *r = response + TRACE_HEADER_SIZE + TRACE_RECORD_SIZE * k;
+        /* stages in order, the differences taking care of the timer wrapping */
+        int32_t queueing = be32(r + 12) - be32(r + 8);
+        int32_t shifting = be32(r + 16) - be32(r + 12);
+        int32_t flushing = be32(r + 20) - be32(r + 16);
+        errors += (r[0] != (CMD_XFER | EXTEND_LENGTH)) || r[1] || r[2] || (be32(r + 4) != 62 * 8)
+                  || (queueing < 0) || (shifting < 0) || (flushing < 0);
+    }
+    if (trace_file)
+    {
+        FILE *f = fopen(trace_file, "wb");
+        if (!f || fwrite(response, TRACE_HEADER_SIZE + TRACE_RECORD_SIZE * count, 1, f) != 1)
+        {
+            fprintf(stderr, "cannot write %s\n", trace_file);
+            errors++;
+        }
+        if (f)
+            fclose(f);
+    }
+    return errors;
+}
+
+static const scenario scenarios[] = {
+    { "xfer_read", "62 byte XFER per packet, TDO read back", false, build_xfer_read, NULL, NULL },
+    { "xfer_noread", "62 byte XFER per packet, NO_READ", false, build_xfer_noread, NULL, NULL },
+    { "xfer_lsb", "491 bit LSB_FIRST XFER per packet, TDO checked", false, build_xfer_lsb, check_xfer_lsb, NULL },
+    { "setsig_lsb", "CMD_SETSIG TCK pulse after an LSB_FIRST XFER, TDI checked by CMD_GETSIG", false, build_setsig_lsb, check_setsig_lsb, NULL },
+    { "usb_reset", "xfer_lsb after a bus reset during responses not read", false, build_xfer_lsb, check_xfer_lsb, NULL, false, false, true },
+    { "verify", "160 bit CMD_VERIFY per packet, first mismatch checked", false, build_verify, check_verify, NULL },
+    { "poll", "32 bit CMD_POLL per packet, every other one hitting its limit", false, build_poll, check_poll, NULL },
+    { "macro", "7 runs per packet of a macro with a 4 byte parameter, and one of an undefined macro", false, build_macro, check_macro, NULL },
+    { "xfer_short", "21 one-byte XFERs per packet", false, build_xfer_short, NULL, NULL },
+    { "xfer_stream", "one-byte XFERs across packet boundaries", false, build_xfer_stream, NULL, NULL },
+    { "packet_mode", "commands after CMD_STOP in each packet, dropped in packet mode", false, build_packet_mode, check_packet_mode, NULL, false, true },
+    { "clk", "21 CMD_CLK of 255 pulses per packet", false, build_clk, NULL, NULL },
+    { "test4", "dirtyjtag-test4.py TAP navigation and scans", false, build_test4, NULL, NULL },
+    { "longxfer_read", "a CMD_LONGXFER spanning all packets, TDO read back", false, build_longxfer_read, check_longxfer_read, NULL },
+    { "longxfer_noread", "a CMD_LONGXFER spanning all packets, NO_READ", false, build_longxfer_noread, NULL, NULL },
+    { "longxfer_packed", "a PACKED_TDI CMD_LONGXFER of a bitstream, TDO checked", false, build_longxfer_packed_read, check_longxfer_packed, NULL },
+    { "longxfer_packed_noread", "a PACKED_TDI CMD_LONGXFER of a bitstream, NO_READ", false, build_longxfer_packed_noread, NULL, NULL },
+    { "longxfer_packed_tdo", "a CMD_LONGXFER of a bitstream, TDO read back packed and checked", false, build_longxfer_packed_tdo, check_longxfer_packed_tdo, NULL, true },
+    { "stats", "62 byte XFERs between a CMD_STATS reset and a CMD_STATS read", false, build_stats, check_stats, NULL },
+    { "trace", "62 byte XFERs recorded by the trace ring, then dumped and checked", false, build_trace, check_trace, NULL },
+    { "chain_xfer", "a 96 bit XFER on each JTAG chain per packet, TDO checked", false, build_chain_xfer, check_chain_xfer, NULL, true },
+    { "chain_interleave", "NO_READ XFERs on chains 1 and 2 left shifting in turn, then read back", false, build_chain_interleave, check_chain_interleave, NULL },
+    { "tap_idcode", "reset and IDCODE scan of the chain per packet", true, build_tap_idcode, check_tap_idcode, NULL },
+    { "tap_poll", "CMD_POLL of a status register until it reads ready, a capture per scan", true, build_tap_poll, check_tap_poll, NULL },
+    { "tap_idcode_tms", "tap_idcode with the TAP navigation done by TMS vectors", true, build_tap_idcode_tms, check_tap_idcode, NULL },
+    { "tap_dr", "user DR of device 0 streamed with NO_READ XFERs", true, build_tap_dr, NULL, check_tap_dr },
+    { "tap_xsvf", "a CMD_XSVF checking the IDCODEs with XSDRTDO, over all packets", true, build_tap_xsvf, check_tap_xsvf, NULL },
+    { "tap_longdr", "user DR of device 0 streamed with a NO_READ CMD_LONGXFER", true, build_tap_longdr, NULL, check_tap_longdr },
+    { "tap_tune", "TCK tuned through BYPASS and saved, then IDCODE scans", true, build_tap_tune, check_tap_tune, NULL },
+};
+
+#define N_SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static void send_and_wait(const uint8_t *buf, uint32_t len)
+{
+    uint8_t in[PACKET_SIZE];
+    uint32_t expected = expected_response(buf, len);
+    sim_usb_host_write(buf, len);
+    while (expected)
+    {
+        int n = sim_usb_host_read(in, sizeof(in), RESPONSE_TIMEOUT_MS);
+        if (n < 0)
+        {
+            fprintf(stderr, "timeout waiting for %u response bytes\n", expected);
+            exit(1);
+        }
+        expected -= (n > (int)expected) ? expected : n;
+    }
+    sim_wait_idle();
+}
+
+/* Sets TCK, the frequency the firmware answers has to be the one the PIO runs at, 0 for RTCK */
+static void set_freq(unsigned khz)
+{
+    uint8_t buf[] = { CMD_FREQ | REAL_FREQ, khz >> 8, khz & 0xFF, CMD_STOP };
+    uint8_t in[PACKET_SIZE];
+    uint32_t hz;
+
+    expected_response(buf, sizeof(buf));
+    sim_usb_host_write(buf, sizeof(buf));
+    if (sim_usb_host_read(in, sizeof(in), RESPONSE_TIMEOUT_MS) != 4)
+    {
+        fprintf(stderr, "no answer to CMD_FREQ\n");
+        exit(1);
+    }
+    sim_wait_idle();
+    hz = (uint32_t)in[0] << 24 | in[1] << 16 | in[2] << 8 | in[3];
+    if (hz != (khz ? (uint32_t)sim_tck_hz() : 0))
+    {
+        fprintf(stderr, "CMD_FREQ answered %u Hz, TCK is %.0f Hz\n", hz, sim_tck_hz());
+        exit_status = 1;
+    }
+}
+
+/* Asks the firmware how many JTAG chains it drives */
+static void get_chain_count(void)
+{
+    uint8_t buf[] = { CMD_CHAIN | CHAIN_COUNT, 0, CMD_STOP };
+    uint8_t in[PACKET_SIZE];
+
+    expected_response(buf, sizeof(buf));
+    sim_usb_host_write(buf, sizeof(buf));
+    if (sim_usb_host_read(in, sizeof(in), RESPONSE_TIMEOUT_MS) != 1 || in[0] == 0 || in[0] > SIM_CHAIN_MAX)
+    {
+        fprintf(stderr, "no answer to CMD_CHAIN\n");
+        exit(1);
+    }
+    sim_wait_idle();
+    chain_count = in[0];
+}
+
+/* Reads the len bytes of response to one packet, possibly spread over several IN packets.
+ * An IN packet can also hold the start of the response to the next packets, kept for them. */
+static void read_response(const scenario *sc, uint8_t *response, uint32_t len)
+{
+    static uint8_t in[PACKET_SIZE];
+    static uint32_t in_len, in_pos;
+    uint32_t got = 0;
+    while (got < len)
+    {
+        if (in_pos == in_len)
+        {
+            int n = sim_usb_host_read(in, sizeof(in), RESPONSE_TIMEOUT_MS);
+            if (n < 0)
+            {
+                fprintf(stderr, "%s: timeout, %u response bytes missing\n", sc->name, len - got);
+                exit(1);
+            }
+            in_len = n;
+            in_pos = 0;
+        }
+        uint32_t n = MIN(in_len - in_pos, len - got);
+        memcpy(&response[got], &in[in_pos], n);
+        in_pos += n;
+        got += n;
+    }
+}
+
+/*
+ * In packet mode, so that no command is left cut when the reset empties the
+ * FIFOs: n 62 byte XFERs, the bus reset during one of their responses, and
+ * whatever came back after it thrown away. A firmware still waiting for the
+ * IN transfer lost sends nothing more.
+ */
+static void bus_reset_unread(unsigned n_packets)
+{
+    static const uint8_t packet_mode[] = { CMD_STOP | PACKET_MODE };
+    static const uint8_t stream_mode[] = { CMD_STOP | STREAM_MODE };
+    uint8_t buf[PACKET_SIZE];
+    uint32_t len = build_xfer(buf, true);
+
+    send_and_wait(packet_mode, sizeof(packet_mode));
+    sim_usb_host_reset();
+    for (unsigned i = 0; i < n_packets; i++)
+        sim_usb_host_write(buf, len);
+    while (sim_usb_host_read(buf, sizeof(buf), 100) >= 0)
+        ;
+    send_and_wait(stream_mode, sizeof(stream_mode));
+}
+
+static void run(const scenario *sc, unsigned n_packets)
+{
+    static packet packets[1 << 16];
+    static uint8_t response[1 << 16];
+    static const uint8_t packet_mode[] = { CMD_STOP | PACKET_MODE };
+    static const uint8_t stream_mode[] = { CMD_STOP | STREAM_MODE };
+    unsigned errors = 0;
+    sim_stats_t st;
+    sim_tap_stats ts;
+
+    for (unsigned i = 0; i < n_packets; i++)
+        packets[i].len = sc->build(packets[i].data, i, n_packets);
+    if (sc->bus_reset)
+        bus_reset_unread(n_packets);
+    /* alone and once idle, what core0 merged in stream mode would not be cut at the packets */
+    if (sc->packet_mode)
+        send_and_wait(packet_mode, sizeof(packet_mode));
+
+    sim_stats_reset();
+    if (tap)
+        sim_tap_stats_reset(tap);
+    for (unsigned i = 0; i < n_packets; i++)
+        sim_usb_host_write(packets[i].data, packets[i].len);
+    for (unsigned i = 0; i < n_packets; i++)
+    {
+        uint32_t len = expected_response(packets[i].data, packets[i].len);
+        if (len == 0)
+            continue;
+        read_response(sc, response, len);
+        if (sc->check)
+            errors += sc->check(response, len, i, n_packets);
+    }
+    sim_wait_idle();
+    if (sc->check_target)
+        errors += sc->check_target(n_packets);
+    sim_stats_get(&st);
+    if (sc->packet_mode)
+        send_and_wait(stream_mode, sizeof(stream_mode));
+    if (tap)
+        sim_tap_stats_get(tap, &ts);
+
+    double sys_hz = sim_sys_clk_hz();
+    double pkts = st.usb_out_packets ? st.usb_out_packets : 1;
+    double modeled_s = (st.pio_sys_cycles + st.cpu_cycles) / sys_hz;
+    double mbps = modeled_s > 0 ? st.tck_cycles / modeled_s / 1e6 : 0;
+
+    if (csv)
+    {
+        printf("%s,%.0f,%llu,%llu,%llu,%llu,%llu,%llu,%.1f,%.3f,%u", sc->name, sim_tck_hz() / 1000,
+               (unsigned long long)st.usb_out_packets, (unsigned long long)st.usb_in_packets,
+               (unsigned long long)st.tck_cycles, (unsigned long long)st.pio_sys_cycles,
+               (unsigned long long)st.cpu_cycles, (unsigned long long)st.dma_starts,
+               st.core1_busy_ns / pkts, mbps, errors);
+        if (tap)
+            printf(",%llu,%llu,%llu,%llu", (unsigned long long)(ts.ir_bits + ts.dr_bits),
+                   (unsigned long long)ts.state_transitions, (unsigned long long)ts.idle_tck,
+                   (unsigned long long)(ts.ir_updates + ts.dr_updates));
+        printf("\n");
+    }
+    else
+    {
+        printf("%-12s %s\n", sc->name, sc->description);
+        printf("    packets out/in     %llu / %llu\n", (unsigned long long)st.usb_out_packets,
+               (unsigned long long)st.usb_in_packets);
+        printf("    TCK per packet     %.1f\n", st.tck_cycles / pkts);
+        printf("    PIO us per packet  %.2f\n", st.pio_sys_cycles / sys_hz * 1e6 / pkts);
+        printf("    CPU cyc per packet %.1f (fifo %.1f, polls %.1f, dma starts %.1f)\n", st.cpu_cycles / pkts,
+               st.fifo_accesses / pkts, st.fifo_polls / pkts, st.dma_starts / pkts);
+        printf("    DMA beats per pkt  %.1f\n", st.dma_beats / pkts);
+        printf("    host ns per packet %.1f\n", st.core1_busy_ns / pkts);
+        printf("    modelled Mbit/s    %.3f\n", mbps);
+        if (tap)
+        {
+            printf("    TAP bits shifted   %llu (IR %llu, DR %llu)\n", (unsigned long long)(ts.ir_bits + ts.dr_bits),
+                   (unsigned long long)ts.ir_bits, (unsigned long long)ts.dr_bits);
+            printf("    TAP transitions    %llu, idle TCK %llu, updates %llu\n",
+                   (unsigned long long)ts.state_transitions, (unsigned long long)ts.idle_tck,
+                   (unsigned long long)(ts.ir_updates + ts.dr_updates));
+        }
+        if (st.pio_fifo_errors)
+            printf("    PIO FIFO errors    %llu\n", (unsigned long long)st.pio_fifo_errors);
+        if (sc->check || sc->check_target)
+            printf("    check              %s (%u errors)\n", errors ? "FAILED" : "ok", errors);
+    }
+    if (errors)
+        exit_status = 1;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned n_packets = 1000;
+    unsigned freq_khz = 0;
+    bool rtck = false;
+    sim_queue_stats_t qs;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:f:t:m:r:d:c")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n_packets = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            freq_khz = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            tap_devices = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            tap_max_khz = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            sim_set_rtck_delay(strtoul(optarg, NULL, 0));
+            rtck = true;
+            break;
+        case 'd':
+            trace_file = optarg;
+            break;
+        case 'c':
+            csv = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n packets] [-f freq_khz] [-t devices] [-m max_tck_khz] [-r rtck_cycles] [-d trace_file] [-c] [scenario...]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (tap_devices > 8)
+    {
+        fprintf(stderr, "at most 8 devices in the chain\n");
+        return 2;
+    }
+    if (tap_devices)
+    {
+        sim_tap_device_config devices[8];
+        for (unsigned d = 0; d < tap_devices; d++)
+        {
+            devices[d] = (sim_tap_device_config){
+                .ir_length = TAP_IR_LENGTH,
+                .idcode = TAP_IDCODE,
+                .idcode_instr = TAP_IDCODE_INSTR,
+                .user_instr = TAP_USER_INSTR,
+                .user_dr_length = TAP_USER_DR_LENGTH,
+                .status_instr = TAP_STATUS_INSTR,
+                .status_busy = TAP_STATUS_BUSY,
+            };
+        }
+        tap = sim_tap_chain_create(devices, tap_devices);
+        sim_tap_chain_set_max_tck(tap, tap_max_khz * 1000);
+        sim_set_target(sim_tap_chain_target(tap));
+    }
+    if (n_packets == 0 || n_packets > (1 << 16))
+    {
+        fprintf(stderr, "packet count must be between 1 and 65536\n");
+        return 2;
+    }
+
+    chain_targets_set();
+    sim_start();
+    /* wait for core1 to have set up the JTAG state machine */
+    uint8_t info[] = { CMD_INFO, CMD_STOP };
+    send_and_wait(info, sizeof(info));
+    /* the scenarios build a stream, CMD_STOP must not end the packets */
+    uint8_t stream[] = { CMD_STOP | STREAM_MODE };
+    send_and_wait(stream, sizeof(stream));
+    get_chain_count();
+    if (freq_khz || rtck)
+        set_freq(rtck ? 0 : freq_khz);
+
+    if (csv)
+        printf("scenario,tck_khz,out_packets,in_packets,tck_cycles,pio_sys_cycles,cpu_cycles,dma_starts,host_ns_per_packet,modelled_mbps,errors%s\n",
+               tap ? ",tap_bits,tap_transitions,tap_idle_tck,tap_updates" : "");
+    else
+        printf("TCK %.0f kHz%s, clk_sys %u MHz, %u packets per scenario, %s\n", sim_tck_hz() / 1000,
+               rtck ? " (RTCK)" : "", sim_sys_clk_hz() / 1000000, n_packets, tap ? "TAP chain" : "TDI looped back to TDO");
+
+    for (size_t s = 0; s < N_SCENARIOS; s++)
+    {
+        bool selected = optind == argc;
+        for (int a = optind; a < argc; a++)
+            selected |= strcmp(argv[a], scenarios[s].name) == 0;
+        if (selected && (tap ? !scenarios[s].needs_loopback : !scenarios[s].needs_tap))
+            run(&scenarios[s], n_packets);
+    }
+
+    sim_queue_stats_get(&qs);
+    fprintf(csv ? stderr : stdout, "queue high-water: packets %u of %u, responses %u of %u\n",
+            qs.packet_high_water, qs.packet_depth, qs.response_high_water, qs.response_depth);
+
+    sim_stop();
+    if (tap)
+        sim_tap_chain_destroy(tap);
+    return exit_status;
+}
@@ -0,0 +1,194 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * The simulator behind a pipe, for host tools that drive a probe and can be
+ * pointed at the simulated one instead (dirtyjtag-bench.py --sim). Requests
+ * come on stdin, answers go to stdout, little endian:
+ *
+ * 'W' u32 length, data        bulk OUT transfer, no answer
+ * 'R' u32 timeout_ms          one IN packet: i32 length (-1 on timeout), data
+ * 'I'                         wait until everything sent was executed: 'I'
+ * 'S'                         statistics: u32 count, count u64, see put_stats()
+ * 'Z'                         reset the statistics: 'Z'
+ *
+ * -t attaches a chain of ECP5-like TAPs as dirtyjtag_bench does, -m limits
+ * its TCK and -r makes it return TCK on RTCK that many PIO cycles late.
+ *
+ * usage: dirtyjtag_pipe [-t devices] [-m max_tck_khz] [-r rtck_cycles]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "sim_tap.h"
+
+#define PACKET_SIZE 64
+
+static bool get(void *data, size_t len)
+{
+    return fread(data, 1, len, stdin) == len;
+}
+
+static void put(const void *data, size_t len)
+{
+    fwrite(data, 1, len, stdout);
+}
+
+static void put_u32(uint32_t v)
+{
+    uint8_t b[4] = { v, v >> 8, v >> 16, v >> 24 };
+    put(b, sizeof(b));
+}
+
+static void put_u64(uint64_t v)
+{
+    put_u32((uint32_t)v);
+    put_u32(v >> 32);
+}
+
+static uint32_t le32(const uint8_t *b)
+{
+    return b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+/* What dirtyjtag-bench.py reads, in this order */
+static void put_stats(void)
+{
+    sim_stats_t st;
+    sim_stats_get(&st);
+    put_u32(10);
+    put_u64(st.tck_cycles);
+    put_u64(st.pio_cycles);
+    put_u64(st.pio_sys_cycles);
+    put_u64(st.cpu_cycles);
+    put_u64(st.usb_out_packets);
+    put_u64(st.usb_out_bytes);
+    put_u64(st.usb_in_packets);
+    put_u64(st.usb_in_bytes);
+    put_u64(sim_sys_clk_hz());
+    put_u64((uint64_t)(sim_tck_hz() + 0.5));
+}
+
+int main(int argc, char **argv)
+{
+    unsigned tap_devices = 0, tap_max_khz = 0;
+    sim_tap_chain *tap = NULL;
+    static uint8_t data[1 << 16];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:m:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            tap_devices = strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            tap_max_khz = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            sim_set_rtck_delay(strtoul(optarg, NULL, 0));
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t devices] [-m max_tck_khz] [-r rtck_cycles]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (tap_devices > 8)
+    {
+        fprintf(stderr, "at most 8 devices in the chain\n");
+        return 2;
+    }
+    if (tap_devices)
+    {
+        sim_tap_device_config devices[8];
+        for (unsigned d = 0; d < tap_devices; d++)
+        {
+            devices[d] = (sim_tap_device_config){
+                .ir_length = 8,
+                .idcode = 0x41112043,
+                .idcode_instr = 0xE0,
+                .user_instr = 0x32,
+                .user_dr_length = 1u << 20,
+            };
+        }
+        tap = sim_tap_chain_create(devices, tap_devices);
+        sim_tap_chain_set_max_tck(tap, tap_max_khz * 1000);
+        sim_set_target(sim_tap_chain_target(tap));
+    }
+
+    sim_start();
+    for (;;)
+    {
+        uint8_t op, arg[4];
+        if (!get(&op, 1))
+            break;
+        switch (op)
+        {
+        case 'W':
+        {
+            uint32_t len;
+            if (!get(arg, 4) || (len = le32(arg)) > sizeof(data) || !get(data, len))
+                goto done;
+            sim_usb_host_write(data, len);
+            break;
+        }
+        case 'R':
+        {
+            if (!get(arg, 4))
+                goto done;
+            int n = sim_usb_host_read(data, PACKET_SIZE, le32(arg));
+            put_u32((uint32_t)n);
+            if (n > 0)
+                put(data, n);
+            break;
+        }
+        case 'I':
+            sim_wait_idle();
+            put(&op, 1);
+            break;
+        case 'S':
+            put_stats();
+            break;
+        case 'Z':
+            sim_stats_reset();
+            put(&op, 1);
+            break;
+        default:
+            fprintf(stderr, "unknown request %02x\n", op);
+            goto done;
+        }
+        fflush(stdout);
+    }
+done:
+    sim_stop();
+    if (tap)
+        sim_tap_chain_destroy(tap);
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _HOST_HARDWARE_UART_H
+#define _HOST_HARDWARE_UART_H
+
+#include "pico.h"
+
+/* The UART bridges are not simulated, the instances only need distinct addresses */
+typedef struct uart_inst uart_inst_t;
+
+extern struct uart_inst *const sim_uart_instances[2];
+
+#define uart0 (sim_uart_instances[0])
+#define uart1 (sim_uart_instances[1])
+
+/* The PL011 interface of cdc_uart.c, which the host build compiles but does not link */
+typedef struct {
+    io_rw_32 dr;
+    io_rw_32 rsr;
+    io_rw_32 dmacr;
+} uart_hw_t;
+
+#define UART_UARTRSR_BITS 0x0000000f
+#define UART_UARTRSR_OE_BITS 0x00000008
+#define UART_UARTDMACR_TXDMAE_LSB 1
+#define UART_UARTDMACR_TXDMAE_BITS 0x00000002
+#define UART_UARTDMACR_RXDMAE_LSB 0
+#define UART_UARTDMACR_RXDMAE_BITS 0x00000001
+
+typedef enum {
+    UART_PARITY_NONE,
+    UART_PARITY_EVEN,
+    UART_PARITY_ODD
+} uart_parity_t;
+
+uart_hw_t *uart_get_hw(uart_inst_t *uart);
+uint uart_get_dreq(uart_inst_t *uart, bool tx);
+uint uart_init(uart_inst_t *uart, uint baudrate);
+void uart_deinit(uart_inst_t *uart);
+void uart_set_hw_flow(uart_inst_t *uart, bool cts, bool rts);
+void uart_set_format(uart_inst_t *uart, uint data_bits, uint stop_bits, uart_parity_t parity);
+void uart_set_fifo_enabled(uart_inst_t *uart, bool enabled);
+
+#endif
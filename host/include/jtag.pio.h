@@ -0,0 +1,106 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Host stand-in for the header pioasm generates from jtag.pio: the state
+ * machine is configured the same way, but runs the behavioural model of
+ * the program in host/sim_pio.c. Keep the two in sync with jtag.pio.
+ */
+
+#ifndef _HOST_JTAG_PIO_H
+#define _HOST_JTAG_PIO_H
+
+#include "hardware/pio.h"
+#include "sim_internal.h"
+
+static inline uint pio_jtag_add(PIO pio) {
+    (void)pio;
+    return 0;
+}
+
+static inline void pio_jtag_init(PIO pio, uint sm, uint prog_offs,
+        uint16_t clkdiv, uint pin_tck, uint pin_tdi, uint pin_tdo) {
+    sim_pio_sm_config c = {
+        .program = SIM_PIO_DJTAG_TDO,
+        .pin_sideset = pin_tck,
+        .pin_out = pin_tdi,
+        .pin_in = pin_tdo,
+        //(shift to left, auto push/pull, threshold=nbits)
+        .out_shift_right = false,
+        .in_shift_right = false,
+        .pull_threshold = 8,
+        .push_threshold = 8,
+        .clkdiv_int = clkdiv,
+        .clkdiv_frac = 0,
+    };
+    (void)prog_offs;
+    pio_gpio_init(pio, pin_tdi);
+    pio_gpio_init(pio, pin_tck);
+    sim_pio_sm_init(pio, sm, &c);
+    pio_sm_set_enabled(pio, sm, true);
+}
+
+static inline void pio_jtag_tms_init(PIO pio, uint sm, uint prog_offs,
+        uint16_t clkdiv, uint pin_tck, uint pin_tms, uint pin_tdo) {
+    sim_pio_sm_config c = {
+        .program = SIM_PIO_DJTAG_TDO,
+        .pin_sideset = pin_tck,
+        .pin_out = pin_tms,
+        .pin_in = pin_tdo,
+        .out_tms = true,
+        .out_shift_right = false,
+        .in_shift_right = false,
+        .pull_threshold = 8,
+        .push_threshold = 8,
+        .clkdiv_int = clkdiv,
+        .clkdiv_frac = 0,
+    };
+    (void)prog_offs;
+    sim_pio_sm_init(pio, sm, &c);
+    pio_sm_set_enabled(pio, sm, true);
+}
+
+static inline uint pio_jtag_rtck_add(PIO pio, uint pin_rtck) {
+    (void)pio;
+    gpio_init(pin_rtck);
+    gpio_set_pulls(pin_rtck, false, true);
+    /* djtag_tdo takes the first 7 instructions */
+    return 7;
+}
+
+static inline void pio_jtag_set_program(PIO pio, uint sm, uint prog_offs, bool rtck) {
+    (void)prog_offs;
+    sim_pio_sm_set_program(pio, sm, rtck ? SIM_PIO_DJTAG_RTCK : SIM_PIO_DJTAG_TDO);
+}
+
+static inline void pio_jtag_set_shift_right(PIO pio, uint sm, bool right) {
+    sim_pio_sm_set_shift_right(pio, sm, right);
+}
+
+static inline void pio_jtag_set_word_size(PIO pio, uint sm, uint out_bits, uint in_bits) {
+    sim_pio_sm_set_thresholds(pio, sm, out_bits, in_bits);
+}
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Host-native stand-in for the parts of TinyUSB used by the firmware: the
+ * vendor class (bulk OUT/IN pair of the probe interface) backed by the packet
+ * queues in host/sim_usb.c. The CDC bridge is not simulated, only declared.
+ */
+
+#ifndef _HOST_TUSB_H
+#define _HOST_TUSB_H
+
+#include "pico.h"
+#include "tusb_config.h"
+
+typedef struct {
+    uint8_t bmRequestType;
+    uint8_t bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+} tusb_control_request_t;
+
+enum {
+    CONTROL_STAGE_IDLE,
+    CONTROL_STAGE_SETUP,
+    CONTROL_STAGE_DATA,
+    CONTROL_STAGE_ACK
+};
+
+bool tusb_init(void);
+void tud_task(void);
+bool tud_mounted(void);
+bool tud_ready(void);
+
+uint32_t tud_vendor_available(void);
+uint32_t tud_vendor_read(void *buffer, uint32_t bufsize);
+uint32_t tud_vendor_write(const void *buffer, uint32_t bufsize);
+uint32_t tud_vendor_write_flush(void);
+uint32_t tud_vendor_write_available(void);
+
+static inline uint32_t tud_vendor_flush(void)
+{
+    return tud_vendor_write_flush();
+}
+
+/* Called from tud_task() when an IN transfer of the probe interface completes */
+void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes) __attribute__((weak));
+/* Called from tud_task() once an OUT packet of the probe interface is in the RX FIFO */
+void tud_vendor_rx_cb(uint8_t itf, uint8_t const *buffer, uint16_t bufsize) __attribute__((weak));
+/* Called from tud_task() on a bus reset, then once configured again */
+void tud_umount_cb(void) __attribute__((weak));
+void tud_mount_cb(void) __attribute__((weak));
+
+/* The CDC class, for cdc_uart.c, which the host build compiles but does not link */
+typedef struct {
+    uint32_t bit_rate;
+    uint8_t stop_bits;
+    uint8_t parity;
+    uint8_t data_bits;
+} cdc_line_coding_t;
+
+enum {
+    CDC_LINE_CONDING_STOP_BITS_1 = 0,
+    CDC_LINE_CONDING_STOP_BITS_1_5 = 1,
+    CDC_LINE_CONDING_STOP_BITS_2 = 2
+};
+
+enum {
+    CDC_LINE_CODING_PARITY_NONE = 0,
+    CDC_LINE_CODING_PARITY_ODD = 1,
+    CDC_LINE_CODING_PARITY_EVEN = 2
+};
+
+bool tud_cdc_n_connected(uint8_t itf);
+uint32_t tud_cdc_n_available(uint8_t itf);
+uint32_t tud_cdc_n_read(uint8_t itf, void *buffer, uint32_t bufsize);
+void tud_cdc_n_read_flush(uint8_t itf);
+uint32_t tud_cdc_n_write(uint8_t itf, const void *buffer, uint32_t bufsize);
+uint32_t tud_cdc_n_write_flush(uint8_t itf);
+uint32_t tud_cdc_n_write_available(uint8_t itf);
+bool tud_cdc_n_write_clear(uint8_t itf);
+
+#endif
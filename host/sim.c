@@ -0,0 +1,126 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* Simulator life cycle and statistics */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim_internal.h"
+#include "pio_jtag.h"
+#include "cmd.h"
+
+/* the firmware main(), renamed when dirtyJtag.c is built for the host */
+int dirtyjtag_main(void);
+
+sim_stats_t sim_stats;
+
+static pthread_t core0_thread;
+static bool running;
+static bool stopping;
+
+static void *core0_thread_main(void *arg)
+{
+    (void)arg;
+    dirtyjtag_main();
+    return NULL;
+}
+
+void sim_start(void)
+{
+    if (running)
+        return;
+    running = true;
+    __atomic_store_n(&stopping, false, __ATOMIC_RELEASE);
+    pthread_create(&core0_thread, NULL, core0_thread_main, NULL);
+}
+
+void sim_stop(void)
+{
+    if (!running)
+        return;
+    __atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+    pthread_join(core0_thread, NULL);
+    sim_multicore_join();
+    running = false;
+}
+
+bool sim_stopping(void)
+{
+    return __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+}
+
+void sim_thread_exit(void)
+{
+    pthread_exit(NULL);
+}
+
+static bool quiescent(void)
+{
+    return sim_usb_out_drained() && sim_core1_idle();
+}
+
+void sim_wait_idle(void)
+{
+    for (;;)
+    {
+        if (quiescent())
+        {
+            /* core0 may sit between reading a packet and handing it over, let it go around twice */
+            uint64_t t = sim_usb_task_count();
+            while (sim_usb_task_count() < t + 2 && quiescent())
+                usleep(10);
+            if (quiescent())
+                return;
+        }
+        usleep(10);
+    }
+}
+
+void sim_stats_get(sim_stats_t *stats)
+{
+    const uint64_t *src = (const uint64_t *)&sim_stats;
+    uint64_t *dst = (uint64_t *)stats;
+    for (size_t i = 0; i < sizeof(sim_stats_t) / sizeof(uint64_t); i++)
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+}
+
+void sim_stats_reset(void)
+{
+    uint64_t *dst = (uint64_t *)&sim_stats;
+    for (size_t i = 0; i < sizeof(sim_stats_t) / sizeof(uint64_t); i++)
+        __atomic_store_n(&dst[i], 0, __ATOMIC_RELAXED);
+}
+
+void sim_queue_stats_get(sim_queue_stats_t *stats)
+{
+    cmd_queue_info packets, responses;
+    cmd_queue_stats(&packets, &responses);
+    stats->packet_depth = packets.depth;
+    stats->packet_high_water = packets.high_water;
+    stats->response_depth = responses.depth;
+    stats->response_high_water = responses.high_water;
+}
@@ -0,0 +1,138 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Public interface of the host-native simulator. The firmware sources are
+ * compiled unmodified against the shims in host/include; this header is what
+ * a benchmark or test harness uses to boot them, talk to the vendor interface
+ * like a USB host would, and read back what the simulated hardware did.
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Whatever sits at the other end of the JTAG cable. tck() is called once per
+ * TCK period by the PIO model with the TMS and TDI levels presented to the
+ * target and returns TDO as seen by the probe while TCK is high, i.e. before
+ * the target updates it on the falling edge.
+ */
+typedef struct sim_jtag_target {
+    bool (*tck)(void *ctx, bool tms, bool tdi);
+    void *ctx;
+} sim_jtag_target_t;
+
+/* NULL restores the default target: TDI looped back to TDO */
+void sim_set_target(const sim_jtag_target_t *target);
+
+/* Same for each JTAG chain of the probe, chain 0 is the one above */
+#define SIM_CHAIN_MAX 4
+void sim_set_chain_target(unsigned chain, const sim_jtag_target_t *target);
+
+/*
+ * Cycle counts are modelled, not measured: PIO counts are exact for the
+ * programs in jtag.pio, CPU counts are a rough per-access cost of the
+ * peripheral operations the firmware performed (see sim_pio.c).
+ */
+typedef struct sim_stats {
+    uint64_t tck_cycles;          /* TCK periods driven by the PIO */
+    uint64_t pio_cycles;          /* state machine instruction cycles */
+    uint64_t pio_sys_cycles;      /* same, scaled by the clock divider, in clk_sys cycles */
+    uint64_t pio_fifo_errors;     /* put on a full TX FIFO, get on an empty RX FIFO, word size or bit order change mid shift */
+    uint64_t cpu_cycles;          /* estimated clk_sys cycles spent driving peripherals */
+    uint64_t fifo_accesses;       /* CPU reads/writes of PIO FIFOs */
+    uint64_t fifo_polls;          /* CPU FIFO status checks */
+    uint64_t dma_starts;
+    uint64_t dma_beats;
+    uint64_t gpio_writes;
+    uint64_t usb_out_packets;
+    uint64_t usb_out_bytes;
+    uint64_t usb_in_packets;
+    uint64_t usb_in_bytes;
+    uint64_t core1_busy_ns;       /* host CPU time core1 spent out of __wfe(), simulation included */
+} sim_stats_t;
+
+void sim_stats_get(sim_stats_t *stats);
+void sim_stats_reset(void);
+
+/* Depth and high-water mark of the firmware queues between the cores, since start */
+typedef struct sim_queue_stats_t {
+    uint32_t packet_depth;
+    uint32_t packet_high_water;
+    uint32_t response_depth;
+    uint32_t response_high_water;
+} sim_queue_stats_t;
+
+void sim_queue_stats_get(sim_queue_stats_t *stats);
+
+/* clk_sys as reported by clock_get_hz(), SYS_CLK_MHZ at boot then as CMD_FREQ switches it */
+uint32_t sim_sys_clk_hz(void);
+
+/* Current TCK frequency of the JTAG state machine, derived from its divider */
+double sim_tck_hz(void);
+
+/* With adaptive clocking, PIO cycles RTCK takes to follow each TCK edge, 2 by default */
+void sim_set_rtck_delay(unsigned pio_cycles);
+
+/* Boot the firmware: its main() runs on a host thread standing in for core0 */
+void sim_start(void);
+void sim_stop(void);
+
+/* One bulk OUT transfer on the probe interface, split in 64 byte packets */
+void sim_usb_host_write(const void *data, size_t len);
+
+/* Read one IN packet, returns its length or -1 after timeout_ms */
+int sim_usb_host_read(void *data, size_t len, unsigned timeout_ms);
+
+/*
+ * Bus reset and enumeration again, once the next IN transfer has started: it
+ * never completes, and the IN packets not read, the OUT packets not taken and
+ * the vendor FIFOs are lost.
+ */
+void sim_usb_host_reset(void);
+
+/*
+ * Wait up to timeout_ms for an IN packet to read (when in is set) or for the
+ * number of OUT packets the endpoint took, which a real bus would have
+ * acknowledged, to differ from out_seen. Returns that number, counted from start.
+ */
+uint64_t sim_usb_host_wait(bool in, uint64_t out_seen, unsigned timeout_ms);
+
+/* Wait until every OUT packet has been consumed and executed */
+void sim_wait_idle(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
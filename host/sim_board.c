@@ -0,0 +1,295 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* GPIO, clocks, timer and the board level pieces the simulator does not model */
+
+#include <string.h>
+#include <time.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/flash.h"
+#include "pico/flash.h"
+#include "bsp/board.h"
+#include "dirtyJtagConfig.h"
+#include "cdc_uart.h"
+#include "get_serial.h"
+#include "sim_internal.h"
+
+#define SIM_CPU_COST_GPIO 2
+
+#ifdef SYS_CLK_MHZ
+#define SIM_SYS_CLK_HZ (SYS_CLK_MHZ * 1000000u)
+#else
+#define SIM_SYS_CLK_HZ 125000000u
+#endif
+
+static struct {
+    bool out;
+    bool dir_out;
+    bool pull_up;
+    bool pull_down;
+    enum gpio_function fn;
+} sim_gpios[NUM_BANK0_GPIOS];
+
+static struct uart_inst {
+    int index;
+} sim_uarts[2] = { { 0 }, { 1 } };
+
+struct uart_inst *const sim_uart_instances[2] = { &sim_uarts[0], &sim_uarts[1] };
+
+char usb_serial[17] = "0000000000000000";
+
+void gpio_init(uint gpio)
+{
+    sim_gpios[gpio].fn = GPIO_FUNC_SIO;
+    sim_gpios[gpio].dir_out = false;
+    sim_gpios[gpio].out = false;
+}
+
+void gpio_init_mask(uint32_t mask)
+{
+    for (uint i = 0; i < NUM_BANK0_GPIOS; i++)
+    {
+        if (mask & (1u << i))
+            gpio_init(i);
+    }
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn)
+{
+    sim_gpios[gpio].fn = fn;
+}
+
+void gpio_set_pulls(uint gpio, bool up, bool down)
+{
+    sim_gpios[gpio].pull_up = up;
+    sim_gpios[gpio].pull_down = down;
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    SIM_COUNT(gpio_writes, 1);
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_GPIO);
+    sim_gpios[gpio].out = value;
+}
+
+bool gpio_get(uint gpio)
+{
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_GPIO);
+    if (sim_gpios[gpio].dir_out || sim_gpios[gpio].fn != GPIO_FUNC_SIO)
+        return sim_gpios[gpio].out;
+    return sim_gpios[gpio].pull_up;
+}
+
+bool gpio_get_out_level(uint gpio)
+{
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_GPIO);
+    return sim_gpios[gpio].out;
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_GPIO);
+    sim_gpios[gpio].dir_out = out;
+}
+
+void gpio_set_dir_masked(uint32_t mask, uint32_t value)
+{
+    for (uint i = 0; i < NUM_BANK0_GPIOS; i++)
+    {
+        if (mask & (1u << i))
+            sim_gpios[i].dir_out = value & (1u << i);
+    }
+}
+
+void gpio_clr_mask(uint32_t mask)
+{
+    for (uint i = 0; i < NUM_BANK0_GPIOS; i++)
+    {
+        if (mask & (1u << i))
+            sim_gpios[i].out = false;
+    }
+}
+
+void gpio_set_mask(uint32_t mask)
+{
+    for (uint i = 0; i < NUM_BANK0_GPIOS; i++)
+    {
+        if (mask & (1u << i))
+            sim_gpios[i].out = true;
+    }
+}
+
+bool sim_gpio_out_level(uint gpio)
+{
+    return gpio < NUM_BANK0_GPIOS && sim_gpios[gpio].out;
+}
+
+void sim_gpio_drive(uint gpio, bool value)
+{
+    if (gpio < NUM_BANK0_GPIOS)
+        sim_gpios[gpio].out = value;
+}
+
+/* clk_sys and clk_peri as set by clock_configure(), read by both cores */
+static volatile uint32_t sim_clk_sys_hz = SIM_SYS_CLK_HZ;
+static volatile uint32_t sim_clk_peri_hz = SIM_SYS_CLK_HZ;
+
+uint32_t clock_get_hz(enum clock_index clk_index)
+{
+    switch (clk_index)
+    {
+    case clk_sys:
+        return sim_clk_sys_hz;
+    case clk_usb:
+    case clk_adc:
+        return 48000000u;
+    case clk_peri:
+        return sim_clk_peri_hz;
+    default:
+        return 12000000u;
+    }
+}
+
+bool clock_configure(enum clock_index clk_index, uint32_t src, uint32_t auxsrc, uint32_t src_freq, uint32_t freq)
+{
+    (void)src;
+    (void)auxsrc;
+    (void)src_freq;
+    if (clk_index == clk_sys)
+        sim_clk_sys_hz = freq;
+    else if (clk_index == clk_peri)
+        sim_clk_peri_hz = freq;
+    return true;
+}
+
+void pll_init(PLL pll, uint ref_div, uint vco_freq, uint post_div1, uint post_div2)
+{
+    (void)pll;
+    (void)ref_div;
+    (void)vco_freq;
+    (void)post_div1;
+    (void)post_div2;
+}
+
+/* the last sector of the flash, erased at boot: no settings saved */
+uint8_t sim_flash[FLASH_SECTOR_SIZE] = { [0 ... FLASH_SECTOR_SIZE - 1] = 0xFF };
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    memset((uint8_t *)XIP_BASE + flash_offs, 0xFF, count);
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    uint8_t *flash = (uint8_t *)XIP_BASE + flash_offs;
+    for (size_t i = 0; i < count; i++)
+        flash[i] &= data[i];
+}
+
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t enter_exit_timeout_ms)
+{
+    (void)enter_exit_timeout_ms;
+    func(param);
+    return PICO_OK;
+}
+
+bool flash_safe_execute_core_init(void)
+{
+    return true;
+}
+
+uint64_t sim_thread_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+uint32_t sim_sys_clk_hz(void)
+{
+    return clock_get_hz(clk_sys);
+}
+
+uint64_t sim_host_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+uint64_t time_us_64(void)
+{
+    static uint64_t start_ns;
+    if (start_ns == 0)
+        start_ns = sim_host_time_ns();
+    return (sim_host_time_ns() - start_ns) / 1000;
+}
+
+void sleep_us(uint64_t us)
+{
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+void sleep_ms(uint32_t ms)
+{
+    sleep_us((uint64_t)ms * 1000);
+}
+
+void board_init(void)
+{
+}
+
+void usb_serial_init(void)
+{
+}
+
+#if ( CDC_UART_INTF_COUNT > 0 )
+void cdc_uart_init( int index, uart_inst_t *const uart, int uart_rx_pin, int uart_tx_pin )
+{
+    (void)index;
+    (void)uart;
+    (void)uart_rx_pin;
+    (void)uart_tx_pin;
+}
+#endif
+
+#if ( PIO_UART_COUNT > 0 )
+void cdc_pio_uart_init( int index, int uart_rx_pin, int uart_tx_pin )
+{
+    (void)index;
+    (void)uart_rx_pin;
+    (void)uart_tx_pin;
+}
+#endif
+
+#if ( CDC_INTF_COUNT > 0 )
+void cdc_uart_task(void)
+{
+}
+#endif
@@ -0,0 +1,90 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/* Internal interface between the shim headers and the simulator models */
+
+#ifndef _SIM_INTERNAL_H
+#define _SIM_INTERNAL_H
+
+#include "pico.h"
+#include "hardware/pio.h"
+#include "sim.h"
+
+#define SIM_COUNT(field, n) __atomic_fetch_add(&sim_stats.field, (n), __ATOMIC_RELAXED)
+
+extern sim_stats_t sim_stats;
+
+/* Programs from jtag.pio the PIO model knows how to execute */
+enum sim_pio_program {
+    SIM_PIO_NONE,
+    SIM_PIO_DJTAG_TDO,
+    SIM_PIO_DJTAG_RTCK,
+};
+
+typedef struct sim_pio_sm_config {
+    enum sim_pio_program program;
+    uint pin_sideset;
+    uint pin_out;
+    uint pin_in;
+    bool out_tms;           /* the OUT pin is TMS, not TDI */
+    bool out_shift_right;
+    bool in_shift_right;
+    uint pull_threshold;
+    uint push_threshold;
+    uint16_t clkdiv_int;
+    uint8_t clkdiv_frac;
+} sim_pio_sm_config;
+
+void sim_pio_sm_init(PIO pio, uint sm, const sim_pio_sm_config *config);
+/* The real state machine takes the new thresholds right away, so does the model */
+void sim_pio_sm_set_thresholds(PIO pio, uint sm, uint pull_threshold, uint push_threshold);
+void sim_pio_sm_set_shift_right(PIO pio, uint sm, bool right);
+/* Another program, from its start, the configuration kept */
+void sim_pio_sm_set_program(PIO pio, uint sm, enum sim_pio_program program);
+
+/* Level currently driven on a GPIO, by SIO or by a PIO state machine */
+bool sim_gpio_out_level(uint gpio);
+void sim_gpio_drive(uint gpio, bool value);
+
+/* Drive the target of a JTAG chain for one TCK period */
+bool sim_target_tck(uint chain, bool tms, bool tdi);
+
+/* Host monotonic clock, and CPU time consumed by the calling thread */
+uint64_t sim_host_time_ns(void);
+uint64_t sim_thread_cpu_ns(void);
+
+/* Host thread bookkeeping, used to stop the firmware threads */
+bool sim_stopping(void);
+void sim_thread_exit(void);
+
+/* USB state the idle detection needs */
+bool sim_usb_out_drained(void);
+uint64_t sim_usb_task_count(void);
+
+/* Inter-core bookkeeping the idle detection needs */
+bool sim_core1_idle(void);
+void sim_multicore_join(void);
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Inter-core FIFOs and events, with core1 running on its own host thread.
+ * core1 is idle when it waits in __wfe(), the time it spends elsewhere is
+ * accounted as busy.
+ */
+
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+#include "sim_internal.h"
+
+#define SIM_SIO_FIFO_DEPTH 8
+
+typedef struct sim_sio_fifo {
+    uint32_t data[SIM_SIO_FIFO_DEPTH];
+    uint head;
+    uint count;
+} sim_sio_fifo;
+
+static pthread_mutex_t mc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mc_cond = PTHREAD_COND_INITIALIZER;
+static sim_sio_fifo fifo_to_core1;
+static sim_sio_fifo fifo_to_core0;
+
+static __thread uint sim_core_num;
+static pthread_t core1_thread;
+static bool core1_launched;
+static void (*core1_entry_fn)(void);
+
+static bool event[2];
+static bool waiting[2];
+static uint64_t core1_run_ns; /* core1 thread CPU time when it last left __wfe() */
+
+uint get_core_num(void)
+{
+    return sim_core_num;
+}
+
+static void *core1_thread_main(void *arg)
+{
+    (void)arg;
+    sim_core_num = 1;
+    core1_run_ns = sim_thread_cpu_ns();
+    core1_entry_fn();
+    return NULL;
+}
+
+void multicore_launch_core1(void (*entry)(void))
+{
+    core1_entry_fn = entry;
+    core1_launched = true;
+    pthread_create(&core1_thread, NULL, core1_thread_main, NULL);
+}
+
+void sim_multicore_join(void)
+{
+    if (core1_launched)
+    {
+        pthread_join(core1_thread, NULL);
+        core1_launched = false;
+    }
+}
+
+/* called with mc_lock held, gives up the thread when the simulator stops */
+static void wait_locked(void)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += 10 * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&mc_cond, &mc_lock, &deadline);
+    if (sim_stopping())
+    {
+        pthread_mutex_unlock(&mc_lock);
+        sim_thread_exit();
+    }
+}
+
+void multicore_fifo_push_blocking(uint32_t data)
+{
+    sim_sio_fifo *f = sim_core_num == 0 ? &fifo_to_core1 : &fifo_to_core0;
+    pthread_mutex_lock(&mc_lock);
+    while (f->count == SIM_SIO_FIFO_DEPTH)
+        wait_locked();
+    f->data[(f->head + f->count) % SIM_SIO_FIFO_DEPTH] = data;
+    f->count++;
+    pthread_cond_broadcast(&mc_cond);
+    pthread_mutex_unlock(&mc_lock);
+}
+
+uint32_t multicore_fifo_pop_blocking(void)
+{
+    sim_sio_fifo *f = sim_core_num == 0 ? &fifo_to_core0 : &fifo_to_core1;
+    uint32_t data;
+    pthread_mutex_lock(&mc_lock);
+    while (f->count == 0)
+        wait_locked();
+    data = f->data[f->head];
+    f->head = (f->head + 1) % SIM_SIO_FIFO_DEPTH;
+    f->count--;
+    pthread_cond_broadcast(&mc_cond);
+    pthread_mutex_unlock(&mc_lock);
+    return data;
+}
+
+bool multicore_fifo_rvalid(void)
+{
+    sim_sio_fifo *f = sim_core_num == 0 ? &fifo_to_core0 : &fifo_to_core1;
+    pthread_mutex_lock(&mc_lock);
+    bool valid = f->count != 0;
+    pthread_mutex_unlock(&mc_lock);
+    return valid;
+}
+
+bool multicore_fifo_wready(void)
+{
+    sim_sio_fifo *f = sim_core_num == 0 ? &fifo_to_core1 : &fifo_to_core0;
+    pthread_mutex_lock(&mc_lock);
+    bool ready = f->count != SIM_SIO_FIFO_DEPTH;
+    pthread_mutex_unlock(&mc_lock);
+    return ready;
+}
+
+void __wfe(void)
+{
+    uint core = sim_core_num;
+    if (core == 1)
+        SIM_COUNT(core1_busy_ns, sim_thread_cpu_ns() - core1_run_ns);
+    pthread_mutex_lock(&mc_lock);
+    if (!event[core])
+    {
+        waiting[core] = true;
+        wait_locked();
+    }
+    event[core] = false;
+    waiting[core] = false;
+    pthread_mutex_unlock(&mc_lock);
+    if (core == 1)
+        core1_run_ns = sim_thread_cpu_ns();
+}
+
+void __sev(void)
+{
+    uint other = sim_core_num ^ 1;
+    pthread_mutex_lock(&mc_lock);
+    event[other] = true;
+    /* not idle anymore, even before its thread gets to run */
+    waiting[other] = false;
+    pthread_cond_broadcast(&mc_cond);
+    pthread_mutex_unlock(&mc_lock);
+}
+
+bool sim_core1_idle(void)
+{
+    pthread_mutex_lock(&mc_lock);
+    bool idle = !core1_launched || waiting[1];
+    pthread_mutex_unlock(&mc_lock);
+    return idle;
+}
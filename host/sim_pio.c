@@ -0,0 +1,814 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Behavioural model of the PIO state machines and of the DMA channels feeding
+ * them. The model is run lazily: every time the firmware looks at a FIFO or a
+ * DMA channel, the state machines execute until they stall on a FIFO, and the
+ * DMA channels move data until their DREQ deasserts. Nothing runs "in the
+ * background", which keeps the simulation deterministic.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "dirtyJtagConfig.h"
+#include "sim_internal.h"
+
+/* Rough clk_sys cost of the CPU side of peripheral accesses */
+#define SIM_CPU_COST_FIFO_ACCESS 3
+#define SIM_CPU_COST_FIFO_POLL 3
+#define SIM_CPU_COST_DMA_REG 2
+#define SIM_CPU_COST_DMA_POLL 3
+
+#define SIM_PIO_FIFO_DEPTH 4
+
+typedef struct sim_fifo {
+    uint32_t data[SIM_PIO_FIFO_DEPTH];
+    uint head;
+    uint count;
+} sim_fifo;
+
+enum sim_djtag_pc {
+    DJTAG_PULL_LEN,
+    DJTAG_OUT,
+    DJTAG_TCK,
+    DJTAG_IN,
+    DJTAG_JMP,
+    DJTAG_PUSH,
+};
+
+typedef struct sim_sm {
+    sim_pio_sm_config config;
+    bool enabled;
+    sim_fifo tx;
+    sim_fifo rx;
+    uint pc;
+    uint32_t x;
+    uint32_t osr;
+    uint osr_count;
+    uint32_t isr;
+    uint isr_count;
+    bool out_bit;
+    bool tdo;
+    uint chain;
+    /* counted locally while running, published to sim_stats when the state machine stalls */
+    uint32_t run_cycles;
+    uint32_t run_tck;
+} sim_sm;
+
+pio_hw_t sim_pio_hw[2];
+
+static sim_sm sim_sms[NUM_PIOS][NUM_PIO_STATE_MACHINES];
+
+/* JTAG chains, told apart by their TCK pin, numbered in the order they are initialized */
+typedef struct sim_chain {
+    uint pin_tck;
+    uint pin_tdi;
+    uint pin_tms;
+} sim_chain;
+
+static sim_chain sim_chains[SIM_CHAIN_MAX];
+static uint sim_chain_count;
+
+static const sim_jtag_target_t *sim_targets[SIM_CHAIN_MAX];
+
+/* PIO cycles a wait of djtag_rtck takes for RTCK to follow TCK */
+static uint sim_rtck_delay = 2;
+
+static sim_sm *get_sm(PIO pio, uint sm)
+{
+    assert(sm < NUM_PIO_STATE_MACHINES);
+    return &sim_sms[pio_get_index(pio)][sm];
+}
+
+static bool fifo_full(const sim_fifo *f)
+{
+    return f->count == SIM_PIO_FIFO_DEPTH;
+}
+
+static bool fifo_empty(const sim_fifo *f)
+{
+    return f->count == 0;
+}
+
+static void fifo_push(sim_fifo *f, uint32_t v)
+{
+    f->data[(f->head + f->count) % SIM_PIO_FIFO_DEPTH] = v;
+    f->count++;
+}
+
+static uint32_t fifo_pop(sim_fifo *f)
+{
+    uint32_t v = f->data[f->head];
+    f->head = (f->head + 1) % SIM_PIO_FIFO_DEPTH;
+    f->count--;
+    return v;
+}
+
+static uint threshold(uint t)
+{
+    return t == 0 ? 32 : t;
+}
+
+static inline void count_pio_cycles(sim_sm *s, uint cycles)
+{
+    s->run_cycles += cycles;
+}
+
+static void publish_counts(sim_sm *s)
+{
+    if (s->run_cycles)
+    {
+        SIM_COUNT(pio_cycles, s->run_cycles);
+        /* the fractional divider averages to div_int + div_frac / 256 */
+        SIM_COUNT(pio_sys_cycles, ((uint64_t)s->run_cycles * ((uint32_t)s->config.clkdiv_int * 256 + s->config.clkdiv_frac) + 128) / 256);
+        s->run_cycles = 0;
+    }
+    if (s->run_tck)
+    {
+        SIM_COUNT(tck_cycles, s->run_tck);
+        s->run_tck = 0;
+    }
+}
+
+/* out pins, 1 with autopull, returns false on a stall */
+static bool sm_out_bit(sim_sm *s, bool *bit)
+{
+    if (s->osr_count >= threshold(s->config.pull_threshold))
+    {
+        if (fifo_empty(&s->tx))
+            return false;
+        s->osr = fifo_pop(&s->tx);
+        s->osr_count = 0;
+    }
+    if (s->config.out_shift_right)
+    {
+        *bit = s->osr & 1;
+        s->osr >>= 1;
+    }
+    else
+    {
+        *bit = s->osr >> 31;
+        s->osr <<= 1;
+    }
+    s->osr_count++;
+    return true;
+}
+
+/* in pins, 1 with autopush, returns false on a stall */
+static bool sm_in_bit(sim_sm *s, bool bit)
+{
+    if (s->isr_count >= threshold(s->config.push_threshold))
+    {
+        if (fifo_full(&s->rx))
+            return false;
+        fifo_push(&s->rx, s->isr);
+        s->isr = 0;
+        s->isr_count = 0;
+    }
+    if (s->config.in_shift_right)
+        s->isr = (s->isr >> 1) | ((uint32_t)bit << 31);
+    else
+        s->isr = (s->isr << 1) | bit;
+    s->isr_count++;
+    /* autopush happens as soon as the threshold is reached, stalling if the FIFO is full */
+    if (s->isr_count >= threshold(s->config.push_threshold) && !fifo_full(&s->rx))
+    {
+        fifo_push(&s->rx, s->isr);
+        s->isr = 0;
+        s->isr_count = 0;
+    }
+    return true;
+}
+
+/* djtag_tdo, and djtag_rtck which adds a wait for RTCK before each TCK edge:
+ * returns false when the state machine stalls */
+static bool step_djtag_tdo(sim_sm *s)
+{
+    switch (s->pc)
+    {
+    case DJTAG_PULL_LEN:
+        /* pull; out x, 32 */
+        if (fifo_empty(&s->tx))
+            return false;
+        s->x = fifo_pop(&s->tx);
+        s->osr_count = 32;
+        count_pio_cycles(s, 2);
+        s->pc = DJTAG_OUT;
+        return true;
+    case DJTAG_OUT:
+        if (!sm_out_bit(s, &s->out_bit))
+            return false;
+        sim_gpio_drive(s->config.pin_out, s->out_bit);
+        count_pio_cycles(s, (s->config.program == SIM_PIO_DJTAG_RTCK) ? 1 + sim_rtck_delay : 1);
+        s->pc = DJTAG_TCK;
+        return true;
+    case DJTAG_TCK:
+        /* nop side 1; the target sees the rising edge, TDO is sampled by the next instruction.
+         * The OUT pin is TDI or TMS depending on the state machine, the other one holds its level. */
+        s->tdo = sim_target_tck(s->chain, sim_gpio_out_level(sim_chains[s->chain].pin_tms),
+                                sim_gpio_out_level(sim_chains[s->chain].pin_tdi));
+        s->run_tck++;
+        count_pio_cycles(s, (s->config.program == SIM_PIO_DJTAG_RTCK) ? 1 + sim_rtck_delay : 1);
+        s->pc = DJTAG_IN;
+        return true;
+    case DJTAG_IN:
+        if (!sm_in_bit(s, s->tdo))
+            return false;
+        count_pio_cycles(s, 1);
+        s->pc = DJTAG_JMP;
+        return true;
+    case DJTAG_JMP:
+        count_pio_cycles(s, 1);
+        s->pc = (s->x-- != 0) ? DJTAG_OUT : DJTAG_PUSH;
+        return true;
+    case DJTAG_PUSH:
+        /* a pending autopush must drain first */
+        if (s->isr_count >= threshold(s->config.push_threshold))
+        {
+            if (fifo_full(&s->rx))
+                return false;
+            fifo_push(&s->rx, s->isr);
+            s->isr = 0;
+            s->isr_count = 0;
+        }
+        if (fifo_full(&s->rx))
+            return false;
+        fifo_push(&s->rx, s->isr);
+        s->isr = 0;
+        s->isr_count = 0;
+        count_pio_cycles(s, 1);
+        s->pc = DJTAG_PULL_LEN;
+        return true;
+    }
+    return false;
+}
+
+static void sm_run(sim_sm *s)
+{
+    if (!s->enabled)
+        return;
+    switch (s->config.program)
+    {
+    case SIM_PIO_DJTAG_TDO:
+    case SIM_PIO_DJTAG_RTCK:
+        while (step_djtag_tdo(s))
+            ;
+        break;
+    default:
+        break;
+    }
+    publish_counts(s);
+}
+
+void sim_pio_sm_init(PIO pio, uint sm, const sim_pio_sm_config *config)
+{
+    sim_sm *s = get_sm(pio, sm);
+    memset(s, 0, sizeof(*s));
+    s->config = *config;
+    while ((s->chain < sim_chain_count) && (sim_chains[s->chain].pin_tck != config->pin_sideset))
+        s->chain++;
+    if (s->chain == sim_chain_count)
+    {
+        assert(sim_chain_count < SIM_CHAIN_MAX);
+        sim_chains[sim_chain_count++].pin_tck = config->pin_sideset;
+    }
+    if (config->out_tms)
+        sim_chains[s->chain].pin_tms = config->pin_out;
+    else
+        sim_chains[s->chain].pin_tdi = config->pin_out;
+}
+
+void sim_pio_sm_set_program(PIO pio, uint sm, enum sim_pio_program program)
+{
+    sim_sm *s = get_sm(pio, sm);
+    SIM_COUNT(cpu_cycles, 4 * SIM_CPU_COST_DMA_REG);
+    sm_run(s);
+    /* a shift in progress would be cut short */
+    if (s->pc != DJTAG_PULL_LEN)
+        SIM_COUNT(pio_fifo_errors, 1);
+    s->config.program = program;
+    s->pc = DJTAG_PULL_LEN;
+}
+
+void sim_pio_sm_set_shift_right(PIO pio, uint sm, bool right)
+{
+    sim_sm *s = get_sm(pio, sm);
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_DMA_REG);
+    sm_run(s);
+    /* a shift in progress would change bit order midway */
+    if (s->pc != DJTAG_PULL_LEN)
+        SIM_COUNT(pio_fifo_errors, 1);
+    s->config.out_shift_right = right;
+    s->config.in_shift_right = right;
+}
+
+void sim_pio_sm_set_thresholds(PIO pio, uint sm, uint pull_threshold, uint push_threshold)
+{
+    sim_sm *s = get_sm(pio, sm);
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_DMA_REG);
+    sm_run(s);
+    /* a shift in progress would change frame size midway */
+    if (s->pc != DJTAG_PULL_LEN)
+        SIM_COUNT(pio_fifo_errors, 1);
+    s->config.pull_threshold = pull_threshold & 0x1f;
+    s->config.push_threshold = push_threshold & 0x1f;
+}
+
+/*
+ * DMA
+ */
+
+typedef struct sim_dma_channel {
+    bool claimed;
+    bool busy;
+    dma_channel_config config;
+    volatile void *write_addr;
+    const volatile void *read_addr;
+    uint32_t count;
+} sim_dma_channel;
+
+static sim_dma_channel sim_dma[NUM_DMA_CHANNELS];
+
+static void run_all(void);
+
+static sim_sm *dreq_sm(uint dreq, bool *is_tx)
+{
+    if (dreq >= 16)
+        return NULL;
+    *is_tx = (dreq & 4) == 0;
+    return &sim_sms[dreq / 8][dreq & 3];
+}
+
+static uint size_bytes(enum dma_channel_transfer_size size)
+{
+    return 1u << size;
+}
+
+static uint32_t dma_read(sim_dma_channel *ch)
+{
+    uint32_t v;
+    switch (ch->config.size)
+    {
+    case DMA_SIZE_8:
+        v = *(const volatile uint8_t *)ch->read_addr;
+        break;
+    case DMA_SIZE_16:
+        v = *(const volatile uint16_t *)ch->read_addr;
+        if (ch->config.bswap)
+            v = __builtin_bswap16(v);
+        break;
+    default:
+        v = *(const volatile uint32_t *)ch->read_addr;
+        if (ch->config.bswap)
+            v = __builtin_bswap32(v);
+        break;
+    }
+    if (ch->config.read_increment)
+        ch->read_addr = (const volatile uint8_t *)ch->read_addr + size_bytes(ch->config.size);
+    return v;
+}
+
+static void dma_write(sim_dma_channel *ch, uint32_t v)
+{
+    switch (ch->config.size)
+    {
+    case DMA_SIZE_8:
+        *(volatile uint8_t *)ch->write_addr = v;
+        break;
+    case DMA_SIZE_16:
+        *(volatile uint16_t *)ch->write_addr = v;
+        break;
+    default:
+        *(volatile uint32_t *)ch->write_addr = v;
+        break;
+    }
+    if (ch->config.write_increment)
+        ch->write_addr = (volatile uint8_t *)ch->write_addr + size_bytes(ch->config.size);
+}
+
+/* narrow writes to a peripheral register are replicated across the 32 bit bus */
+static uint32_t bus_replicate(uint32_t v, enum dma_channel_transfer_size size)
+{
+    switch (size)
+    {
+    case DMA_SIZE_8:
+        return (v & 0xff) * 0x01010101u;
+    case DMA_SIZE_16:
+        return (v & 0xffff) * 0x00010001u;
+    default:
+        return v;
+    }
+}
+
+static bool dma_step(sim_dma_channel *ch)
+{
+    bool is_tx;
+    sim_sm *s;
+
+    if (!ch->busy)
+        return false;
+    if (ch->count == 0)
+    {
+        ch->busy = false;
+        return true;
+    }
+    s = dreq_sm(ch->config.dreq, &is_tx);
+    if (s)
+    {
+        if (is_tx)
+        {
+            if (fifo_full(&s->tx))
+                return false;
+            fifo_push(&s->tx, bus_replicate(dma_read(ch), ch->config.size));
+        }
+        else
+        {
+            if (fifo_empty(&s->rx))
+                return false;
+            uint32_t v = fifo_pop(&s->rx);
+            if (ch->config.bswap && ch->config.size == DMA_SIZE_32)
+                v = __builtin_bswap32(v);
+            /* a narrow read gets the byte lane of its address */
+            if (ch->config.size != DMA_SIZE_32)
+                v >>= 8 * ((uintptr_t)ch->read_addr & 3);
+            dma_write(ch, v);
+        }
+    }
+    else
+    {
+        dma_write(ch, dma_read(ch));
+    }
+    SIM_COUNT(dma_beats, 1);
+    if (--ch->count == 0)
+        ch->busy = false;
+    return true;
+}
+
+static void run_all(void)
+{
+    bool progress;
+    do
+    {
+        progress = false;
+        for (uint p = 0; p < NUM_PIOS; p++)
+        {
+            for (uint i = 0; i < NUM_PIO_STATE_MACHINES; i++)
+            {
+                sim_sm *s = &sim_sms[p][i];
+                uint before = s->tx.count + s->rx.count;
+                uint pc = s->pc;
+                sm_run(s);
+                progress |= (pc != s->pc) || (before != s->tx.count + s->rx.count);
+            }
+        }
+        for (uint c = 0; c < NUM_DMA_CHANNELS; c++)
+        {
+            while (dma_step(&sim_dma[c]))
+                progress = true;
+        }
+    } while (progress);
+}
+
+int dma_claim_unused_channel(bool required)
+{
+    for (uint c = 0; c < NUM_DMA_CHANNELS; c++)
+    {
+        if (!sim_dma[c].claimed)
+        {
+            sim_dma[c].claimed = true;
+            return c;
+        }
+    }
+    if (required)
+    {
+        fprintf(stderr, "sim: no free DMA channel\n");
+        abort();
+    }
+    return -1;
+}
+
+void dma_channel_unclaim(uint channel)
+{
+    sim_dma[channel].claimed = false;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    dma_channel_config c = {
+        .size = DMA_SIZE_32,
+        .read_increment = true,
+        .write_increment = false,
+        .bswap = false,
+        .enable = true,
+        .dreq = DREQ_FORCE,
+        .chain_to = channel,
+    };
+    return c;
+}
+
+static void dma_trigger(uint channel)
+{
+    sim_dma_channel *ch = &sim_dma[channel];
+    SIM_COUNT(dma_starts, 1);
+    ch->busy = ch->config.enable && ch->count != 0;
+    run_all();
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger)
+{
+    sim_dma_channel *ch = &sim_dma[channel];
+    SIM_COUNT(cpu_cycles, 4 * SIM_CPU_COST_DMA_REG);
+    ch->config = *config;
+    ch->write_addr = write_addr;
+    ch->read_addr = read_addr;
+    ch->count = transfer_count;
+    if (trigger)
+        dma_trigger(channel);
+}
+
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger)
+{
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_DMA_REG);
+    sim_dma[channel].config = *config;
+    if (trigger)
+        dma_trigger(channel);
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger)
+{
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_DMA_REG);
+    sim_dma[channel].read_addr = read_addr;
+    if (trigger)
+        dma_trigger(channel);
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger)
+{
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_DMA_REG);
+    sim_dma[channel].write_addr = write_addr;
+    if (trigger)
+        dma_trigger(channel);
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger)
+{
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_DMA_REG);
+    sim_dma[channel].count = trans_count;
+    if (trigger)
+        dma_trigger(channel);
+}
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count)
+{
+    SIM_COUNT(cpu_cycles, 2 * SIM_CPU_COST_DMA_REG);
+    sim_dma[channel].read_addr = read_addr;
+    sim_dma[channel].count = transfer_count;
+    dma_trigger(channel);
+}
+
+void dma_channel_transfer_to_buffer_now(uint channel, volatile void *write_addr, uint32_t transfer_count)
+{
+    SIM_COUNT(cpu_cycles, 2 * SIM_CPU_COST_DMA_REG);
+    sim_dma[channel].write_addr = write_addr;
+    sim_dma[channel].count = transfer_count;
+    dma_trigger(channel);
+}
+
+void dma_channel_abort(uint channel)
+{
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_DMA_REG);
+    sim_dma[channel].busy = false;
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_DMA_POLL);
+    run_all();
+    return sim_dma[channel].busy;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel)
+{
+    while (dma_channel_is_busy(channel))
+    {
+        if (sim_stopping())
+            sim_thread_exit();
+    }
+}
+
+/*
+ * PIO, CPU side
+ */
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm)
+{
+    SIM_COUNT(fifo_polls, 1);
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_FIFO_POLL);
+    run_all();
+    return fifo_full(&get_sm(pio, sm)->tx);
+}
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm)
+{
+    SIM_COUNT(fifo_polls, 1);
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_FIFO_POLL);
+    run_all();
+    return fifo_empty(&get_sm(pio, sm)->tx);
+}
+
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm)
+{
+    SIM_COUNT(fifo_polls, 1);
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_FIFO_POLL);
+    run_all();
+    return fifo_full(&get_sm(pio, sm)->rx);
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm)
+{
+    SIM_COUNT(fifo_polls, 1);
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_FIFO_POLL);
+    run_all();
+    return fifo_empty(&get_sm(pio, sm)->rx);
+}
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm)
+{
+    SIM_COUNT(fifo_polls, 1);
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_FIFO_POLL);
+    run_all();
+    return get_sm(pio, sm)->tx.count;
+}
+
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm)
+{
+    SIM_COUNT(fifo_polls, 1);
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_FIFO_POLL);
+    run_all();
+    return get_sm(pio, sm)->rx.count;
+}
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data)
+{
+    sim_sm *s = get_sm(pio, sm);
+    SIM_COUNT(fifo_accesses, 1);
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_FIFO_ACCESS);
+    if (fifo_full(&s->tx))
+        SIM_COUNT(pio_fifo_errors, 1); /* TXOVER, the write is lost */
+    else
+        fifo_push(&s->tx, data);
+    run_all();
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm)
+{
+    sim_sm *s = get_sm(pio, sm);
+    SIM_COUNT(fifo_accesses, 1);
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_FIFO_ACCESS);
+    run_all();
+    if (fifo_empty(&s->rx))
+    {
+        SIM_COUNT(pio_fifo_errors, 1); /* RXUNDER, reads as zero */
+        return 0;
+    }
+    uint32_t v = fifo_pop(&s->rx);
+    run_all();
+    return v;
+}
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data)
+{
+    while (pio_sm_is_tx_fifo_full(pio, sm))
+    {
+        if (sim_stopping())
+            sim_thread_exit();
+    }
+    pio_sm_put(pio, sm, data);
+}
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm)
+{
+    while (pio_sm_is_rx_fifo_empty(pio, sm))
+    {
+        if (sim_stopping())
+            sim_thread_exit();
+    }
+    return pio_sm_get(pio, sm);
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm)
+{
+    sim_sm *s = get_sm(pio, sm);
+    s->tx.count = 0;
+    s->rx.count = 0;
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled)
+{
+    get_sm(pio, sm)->enabled = enabled;
+    run_all();
+}
+
+void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac)
+{
+    sim_sm *s = get_sm(pio, sm);
+    publish_counts(s);
+    s->config.clkdiv_int = div_int;
+    s->config.clkdiv_frac = div_frac;
+}
+
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask)
+{
+    (void)pio;
+    (void)sm;
+    SIM_COUNT(cpu_cycles, SIM_CPU_COST_FIFO_ACCESS);
+    for (uint i = 0; i < NUM_BANK0_GPIOS; i++)
+    {
+        if (pin_mask & (1u << i))
+            sim_gpio_drive(i, pin_values & (1u << i));
+    }
+}
+
+void pio_gpio_init(PIO pio, uint pin)
+{
+    gpio_set_function(pin, pio == pio0 ? GPIO_FUNC_PIO0 : GPIO_FUNC_PIO1);
+}
+
+/*
+ * Target
+ */
+
+static bool loopback_tck(void *ctx, bool tms, bool tdi)
+{
+    (void)ctx;
+    (void)tms;
+    return tdi;
+}
+
+static const sim_jtag_target_t loopback_target = {
+    .tck = loopback_tck,
+    .ctx = NULL,
+};
+
+void sim_set_target(const sim_jtag_target_t *target)
+{
+    sim_set_chain_target(0, target);
+}
+
+void sim_set_chain_target(unsigned chain, const sim_jtag_target_t *target)
+{
+    assert(chain < SIM_CHAIN_MAX);
+    sim_targets[chain] = target;
+}
+
+bool sim_target_tck(uint chain, bool tms, bool tdi)
+{
+    const sim_jtag_target_t *t = sim_targets[chain] ? sim_targets[chain] : &loopback_target;
+    return t->tck(t->ctx, tms, tdi);
+}
+
+double sim_tck_hz(void)
+{
+    const sim_sm *s = &sim_sms[0][0];
+    double div = s->config.clkdiv_int + s->config.clkdiv_frac / 256.0;
+    if (div == 0)
+        div = 65536;
+    /* djtag_tdo spends 4 cycles per bit, djtag_rtck waits for RTCK twice more */
+    if (s->config.program == SIM_PIO_DJTAG_RTCK)
+        return clock_get_hz(clk_sys) / (div * (4 + 2 * sim_rtck_delay));
+    return clock_get_hz(clk_sys) / (div * 4);
+}
+
+void sim_set_rtck_delay(unsigned pio_cycles)
+{
+    sim_rtck_delay = pio_cycles;
+}
@@ -0,0 +1,350 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_tap.h"
+
+/*
+ * Shift registers are rings: the bit at head is the one presented on TDO, a
+ * shift replaces it with the incoming TDI bit and advances head. This keeps a
+ * shift O(1) whatever the register length.
+ */
+typedef struct shift_reg {
+    uint32_t length;
+    uint32_t head;
+    uint8_t *bits;
+} shift_reg;
+
+typedef struct tap_device {
+    sim_tap_device_config config;
+    uint32_t instruction;
+    shift_reg ir;
+    shift_reg idcode;
+    shift_reg bypass;
+    shift_reg user;
+    uint8_t *user_value;        /* committed by Update-DR, captured by Capture-DR */
+    shift_reg status;
+    uint32_t status_captures;   /* since the status instruction was loaded */
+    shift_reg *dr;              /* data register selected by the instruction */
+} tap_device;
+
+struct sim_tap_chain {
+    sim_jtag_target_t target;
+    tap_device *devices;
+    uint32_t count;
+    sim_tap_state state;
+    bool tdo;
+    uint32_t max_tck_hz;
+    sim_tap_stats stats;
+};
+
+static const sim_tap_state next_state[TAP_N_STATES][2] = {
+    [TAP_RESET]     = { TAP_IDLE,      TAP_RESET },
+    [TAP_IDLE]      = { TAP_IDLE,      TAP_DRSELECT },
+    [TAP_DRSELECT]  = { TAP_DRCAPTURE, TAP_IRSELECT },
+    [TAP_DRCAPTURE] = { TAP_DRSHIFT,   TAP_DREXIT1 },
+    [TAP_DRSHIFT]   = { TAP_DRSHIFT,   TAP_DREXIT1 },
+    [TAP_DREXIT1]   = { TAP_DRPAUSE,   TAP_DRUPDATE },
+    [TAP_DRPAUSE]   = { TAP_DRPAUSE,   TAP_DREXIT2 },
+    [TAP_DREXIT2]   = { TAP_DRSHIFT,   TAP_DRUPDATE },
+    [TAP_DRUPDATE]  = { TAP_IDLE,      TAP_DRSELECT },
+    [TAP_IRSELECT]  = { TAP_IRCAPTURE, TAP_RESET },
+    [TAP_IRCAPTURE] = { TAP_IRSHIFT,   TAP_IREXIT1 },
+    [TAP_IRSHIFT]   = { TAP_IRSHIFT,   TAP_IREXIT1 },
+    [TAP_IREXIT1]   = { TAP_IRPAUSE,   TAP_IRUPDATE },
+    [TAP_IRPAUSE]   = { TAP_IRPAUSE,   TAP_IREXIT2 },
+    [TAP_IREXIT2]   = { TAP_IRSHIFT,   TAP_IRUPDATE },
+    [TAP_IRUPDATE]  = { TAP_IDLE,      TAP_DRSELECT },
+};
+
+static const char *const state_names[TAP_N_STATES] = {
+    "Test-Logic-Reset", "Run-Test/Idle",
+    "Select-DR-Scan", "Capture-DR", "Shift-DR", "Exit1-DR", "Pause-DR", "Exit2-DR", "Update-DR",
+    "Select-IR-Scan", "Capture-IR", "Shift-IR", "Exit1-IR", "Pause-IR", "Exit2-IR", "Update-IR",
+};
+
+static void reg_init(shift_reg *r, uint32_t length)
+{
+    r->length = length;
+    r->head = 0;
+    r->bits = length ? calloc(length, 1) : NULL;
+}
+
+static void reg_free(shift_reg *r)
+{
+    free(r->bits);
+}
+
+/* load value (LSB first) into the register, bit 0 ends up on TDO */
+static void reg_load_u32(shift_reg *r, uint32_t value)
+{
+    r->head = 0;
+    for (uint32_t i = 0; i < r->length; i++)
+        r->bits[i] = (i < 32) ? (value >> i) & 1 : 0;
+}
+
+static uint32_t reg_value_u32(const shift_reg *r)
+{
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < r->length && i < 32; i++)
+        value |= (uint32_t)r->bits[(r->head + i) % r->length] << i;
+    return value;
+}
+
+static inline bool reg_out(const shift_reg *r)
+{
+    return r->bits[r->head];
+}
+
+static inline void reg_shift(shift_reg *r, bool in)
+{
+    r->bits[r->head] = in;
+    if (++r->head == r->length)
+        r->head = 0;
+}
+
+static uint32_t all_ones(uint32_t bits)
+{
+    return bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1;
+}
+
+static void select_dr(tap_device *d)
+{
+    const sim_tap_device_config *c = &d->config;
+    if (c->idcode && d->instruction == c->idcode_instr)
+        d->dr = &d->idcode;
+    else if (c->user_dr_length && d->instruction == c->user_instr)
+        d->dr = &d->user;
+    else if (c->status_busy && d->instruction == c->status_instr)
+        d->dr = &d->status;
+    else
+        d->dr = &d->bypass;
+}
+
+static void device_reset(tap_device *d)
+{
+    d->instruction = d->config.idcode ? d->config.idcode_instr : all_ones(d->config.ir_length);
+    select_dr(d);
+    d->status_captures = 0;
+}
+
+static void device_capture_dr(tap_device *d)
+{
+    if (d->dr == &d->idcode)
+        reg_load_u32(&d->idcode, d->config.idcode);
+    else if (d->dr == &d->user)
+    {
+        d->user.head = 0;
+        memcpy(d->user.bits, d->user_value, d->user.length);
+    }
+    else if (d->dr == &d->status)
+    {
+        bool busy = d->status_captures++ < d->config.status_busy;
+        reg_load_u32(&d->status, SIM_TAP_STATUS_READY | busy);
+    }
+    else
+        reg_load_u32(&d->bypass, 0);
+}
+
+static void device_update_dr(tap_device *d)
+{
+    if (d->dr == &d->user)
+    {
+        for (uint32_t i = 0; i < d->user.length; i++)
+            d->user_value[i] = d->user.bits[(d->user.head + i) % d->user.length];
+    }
+}
+
+static bool chain_out(sim_tap_chain *c, bool ir)
+{
+    tap_device *d = &c->devices[0];
+    return reg_out(ir ? &d->ir : d->dr);
+}
+
+static void chain_shift(sim_tap_chain *c, bool ir, bool tdi)
+{
+    /* device k shifts in what device k + 1 presents, the last one takes TDI */
+    for (uint32_t k = 0; k < c->count; k++)
+    {
+        tap_device *d = &c->devices[k];
+        bool in = tdi;
+        if (k + 1 < c->count)
+        {
+            tap_device *n = &c->devices[k + 1];
+            in = reg_out(ir ? &n->ir : n->dr);
+        }
+        reg_shift(ir ? &d->ir : d->dr, in);
+    }
+}
+
+static bool chain_tck(void *ctx, bool tms, bool tdi)
+{
+    sim_tap_chain *c = ctx;
+    bool tdo = c->tdo;
+    sim_tap_state state = c->state;
+    sim_tap_state next = next_state[state][tms];
+
+    c->stats.tck++;
+
+    /* rising edge: shift in the current state, then act on entering the next one */
+    if (state == TAP_DRSHIFT || state == TAP_IRSHIFT)
+    {
+        chain_shift(c, state == TAP_IRSHIFT, tdi);
+        if (state == TAP_IRSHIFT)
+            c->stats.ir_bits++;
+        else
+            c->stats.dr_bits++;
+    }
+    else if (next == state)
+    {
+        c->stats.idle_tck++;
+    }
+    if (next != state)
+        c->stats.state_transitions++;
+
+    for (uint32_t k = 0; k < c->count; k++)
+    {
+        tap_device *d = &c->devices[k];
+        switch (next)
+        {
+        case TAP_RESET:
+            device_reset(d);
+            break;
+        case TAP_IRCAPTURE:
+            if (state != TAP_IRCAPTURE)
+                reg_load_u32(&d->ir, 1);
+            break;
+        case TAP_IRUPDATE:
+            d->instruction = reg_value_u32(&d->ir) & all_ones(d->config.ir_length);
+            select_dr(d);
+            d->status_captures = 0;
+            break;
+        case TAP_DRCAPTURE:
+            device_capture_dr(d);
+            break;
+        case TAP_DRUPDATE:
+            device_update_dr(d);
+            break;
+        default:
+            break;
+        }
+    }
+    if (next == TAP_IRUPDATE)
+        c->stats.ir_updates++;
+    else if (next == TAP_DRUPDATE)
+        c->stats.dr_updates++;
+    c->state = next;
+
+    /* falling edge: TDO is only driven in the shift states, the probe pulls it down otherwise */
+    if (next == TAP_DRSHIFT || next == TAP_IRSHIFT)
+        c->tdo = chain_out(c, next == TAP_IRSHIFT);
+    else
+        c->tdo = false;
+    /* too fast for the chain: TDO misses its setup time now and then */
+    if (c->max_tck_hz && (c->stats.tck % 7 == 0) && (sim_tck_hz() > c->max_tck_hz))
+        tdo = !tdo;
+    return tdo;
+}
+
+sim_tap_chain *sim_tap_chain_create(const sim_tap_device_config *devices, uint32_t count)
+{
+    sim_tap_chain *c = calloc(1, sizeof(*c));
+    c->devices = calloc(count, sizeof(tap_device));
+    c->count = count;
+    for (uint32_t k = 0; k < count; k++)
+    {
+        tap_device *d = &c->devices[k];
+        d->config = devices[k];
+        reg_init(&d->ir, d->config.ir_length);
+        reg_init(&d->idcode, 32);
+        reg_init(&d->bypass, 1);
+        reg_init(&d->user, d->config.user_dr_length);
+        reg_init(&d->status, 8);
+        d->user_value = d->config.user_dr_length ? calloc(d->config.user_dr_length, 1) : NULL;
+        device_reset(d);
+    }
+    c->state = TAP_RESET;
+    c->target.tck = chain_tck;
+    c->target.ctx = c;
+    return c;
+}
+
+void sim_tap_chain_destroy(sim_tap_chain *c)
+{
+    for (uint32_t k = 0; k < c->count; k++)
+    {
+        tap_device *d = &c->devices[k];
+        reg_free(&d->ir);
+        reg_free(&d->idcode);
+        reg_free(&d->bypass);
+        reg_free(&d->user);
+        reg_free(&d->status);
+        free(d->user_value);
+    }
+    free(c->devices);
+    free(c);
+}
+
+const sim_jtag_target_t *sim_tap_chain_target(sim_tap_chain *c)
+{
+    return &c->target;
+}
+
+void sim_tap_chain_set_max_tck(sim_tap_chain *c, uint32_t hz)
+{
+    c->max_tck_hz = hz;
+}
+
+sim_tap_state sim_tap_chain_state(const sim_tap_chain *c)
+{
+    return c->state;
+}
+
+const char *sim_tap_state_name(sim_tap_state state)
+{
+    return state < TAP_N_STATES ? state_names[state] : "?";
+}
+
+uint32_t sim_tap_instruction(const sim_tap_chain *c, uint32_t device)
+{
+    return c->devices[device].instruction;
+}
+
+const uint8_t *sim_tap_user_dr(const sim_tap_chain *c, uint32_t device)
+{
+    return c->devices[device].user_value;
+}
+
+void sim_tap_stats_get(const sim_tap_chain *c, sim_tap_stats *stats)
+{
+    *stats = c->stats;
+}
+
+void sim_tap_stats_reset(sim_tap_chain *c)
+{
+    memset(&c->stats, 0, sizeof(c->stats));
+}
@@ -0,0 +1,116 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Software model of a JTAG scan chain (IEEE 1149.1 TAP controllers) that can
+ * be attached to the simulator as its target. Each device has an instruction
+ * register, BYPASS, an optional IDCODE and an optional user data register of
+ * arbitrary length, which keeps its contents between scans like a memory. An
+ * optional 8 bit status register reads busy for a number of captures after its
+ * instruction is loaded, like the status of an operation in progress.
+ */
+
+#ifndef _SIM_TAP_H
+#define _SIM_TAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sim.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum sim_tap_state {
+    TAP_RESET,
+    TAP_IDLE,
+    TAP_DRSELECT,
+    TAP_DRCAPTURE,
+    TAP_DRSHIFT,
+    TAP_DREXIT1,
+    TAP_DRPAUSE,
+    TAP_DREXIT2,
+    TAP_DRUPDATE,
+    TAP_IRSELECT,
+    TAP_IRCAPTURE,
+    TAP_IRSHIFT,
+    TAP_IREXIT1,
+    TAP_IRPAUSE,
+    TAP_IREXIT2,
+    TAP_IRUPDATE,
+    TAP_N_STATES
+} sim_tap_state;
+
+typedef struct sim_tap_device_config {
+    uint32_t ir_length;
+    uint32_t idcode;            /* 0: no IDCODE register, BYPASS is selected at reset */
+    uint32_t idcode_instr;
+    uint32_t user_instr;
+    uint32_t user_dr_length;    /* 0: no user data register */
+    uint32_t status_instr;
+    uint32_t status_busy;       /* 0: no status register, else the captures that read busy */
+} sim_tap_device_config;
+
+/* What the status register captures once ready, busy sets bit 0 */
+#define SIM_TAP_STATUS_READY 0x5A
+
+typedef struct sim_tap_stats {
+    uint64_t tck;
+    uint64_t state_transitions;
+    uint64_t ir_bits;           /* TCKs spent shifting the instruction registers */
+    uint64_t dr_bits;           /* TCKs spent shifting the data registers */
+    uint64_t idle_tck;          /* TCKs that neither moved the TAP nor shifted: RTI, TLR or Pause loops */
+    uint64_t ir_updates;
+    uint64_t dr_updates;
+} sim_tap_stats;
+
+typedef struct sim_tap_chain sim_tap_chain;
+
+/* devices[0] drives the probe TDO, devices[count - 1] is fed by the probe TDI */
+sim_tap_chain *sim_tap_chain_create(const sim_tap_device_config *devices, uint32_t count);
+void sim_tap_chain_destroy(sim_tap_chain *chain);
+
+/* Target to pass to sim_set_target(), valid as long as the chain */
+const sim_jtag_target_t *sim_tap_chain_target(sim_tap_chain *chain);
+
+/* Above hz of TCK, every 7th TDO bit comes back flipped; 0, the default, for no limit */
+void sim_tap_chain_set_max_tck(sim_tap_chain *chain, uint32_t hz);
+
+sim_tap_state sim_tap_chain_state(const sim_tap_chain *chain);
+const char *sim_tap_state_name(sim_tap_state state);
+uint32_t sim_tap_instruction(const sim_tap_chain *chain, uint32_t device);
+
+/* Last value written to a user data register by Update-DR, one bit per byte, LSB first */
+const uint8_t *sim_tap_user_dr(const sim_tap_chain *chain, uint32_t device);
+
+void sim_tap_stats_get(const sim_tap_chain *chain, sim_tap_stats *stats);
+void sim_tap_stats_reset(sim_tap_chain *chain);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
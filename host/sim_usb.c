@@ -0,0 +1,448 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Vendor class of the probe interface. OUT packets queued by the host side
+ * land in the RX FIFO one per tud_task() call, the way TinyUSB re-arms the
+ * endpoint after each transaction, so the FIFO merging behaviour the firmware
+ * has to cope with is reproduced, and tud_vendor_rx_cb() is called for each
+ * one. The IN endpoint carries one transfer at a
+ * time, started from the TX FIFO or directly with usbd_edpt_xfer(), and
+ * completes on the next tud_task() call, where it is queued for the host side
+ * to read and tud_vendor_tx_cb() is called. A bus reset asked for by the host
+ * side is done by tud_task() too, with tud_umount_cb() and tud_mount_cb().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <time.h>
+
+#include "tusb.h"
+#include "device/usbd_pvt.h"
+#include "sim_internal.h"
+
+#define SIM_USB_PACKET_SIZE 64
+
+typedef struct sim_packet {
+    struct sim_packet *next;
+    uint32_t len;
+    uint8_t data[SIM_USB_PACKET_SIZE];
+} sim_packet;
+
+typedef struct sim_packet_queue {
+    sim_packet *head;
+    sim_packet *tail;
+} sim_packet_queue;
+
+typedef struct sim_byte_fifo {
+    uint8_t *data;
+    uint32_t size;
+    uint32_t head;
+    uint32_t count;
+} sim_byte_fifo;
+
+static pthread_mutex_t usb_lock = PTHREAD_MUTEX_INITIALIZER;
+/* an IN packet was queued for the host or an OUT packet taken from it */
+static pthread_cond_t usb_host_cond = PTHREAD_COND_INITIALIZER;
+
+static sim_packet_queue out_queue;
+static sim_packet_queue in_queue;
+/* OUT packets taken by the endpoint, i.e. acknowledged on a real bus */
+static uint64_t out_taken;
+
+static uint8_t rx_ff_data[CFG_TUD_VENDOR_RX_BUFSIZE];
+static uint8_t tx_ff_data[CFG_TUD_VENDOR_TX_BUFSIZE];
+static sim_byte_fifo rx_ff = { rx_ff_data, sizeof(rx_ff_data), 0, 0 };
+static sim_byte_fifo tx_ff = { tx_ff_data, sizeof(tx_ff_data), 0, 0 };
+
+static uint64_t task_count;
+
+/* IN endpoint */
+static bool in_claimed;
+static sim_packet *in_flight;
+
+static bool mounted = true;
+/* a bus reset is due during the next IN transfer */
+static bool reset_pending;
+
+static void queue_put(sim_packet_queue *q, sim_packet *p)
+{
+    p->next = NULL;
+    if (q->tail)
+        q->tail->next = p;
+    else
+        q->head = p;
+    q->tail = p;
+}
+
+static sim_packet *queue_get(sim_packet_queue *q)
+{
+    sim_packet *p = q->head;
+    if (p)
+    {
+        q->head = p->next;
+        if (!q->head)
+            q->tail = NULL;
+    }
+    return p;
+}
+
+static uint32_t ff_write(sim_byte_fifo *f, const uint8_t *src, uint32_t len)
+{
+    len = MIN(len, f->size - f->count);
+    for (uint32_t i = 0; i < len; i++)
+        f->data[(f->head + f->count + i) % f->size] = src[i];
+    f->count += len;
+    return len;
+}
+
+static uint32_t ff_read(sim_byte_fifo *f, uint8_t *dst, uint32_t len)
+{
+    len = MIN(len, f->count);
+    for (uint32_t i = 0; i < len; i++)
+        dst[i] = f->data[(f->head + i) % f->size];
+    f->head = (f->head + len) % f->size;
+    f->count -= len;
+    return len;
+}
+
+/* called with usb_lock held */
+static bool edpt_xfer_locked(const uint8_t *buffer, uint32_t len)
+{
+    if (in_flight)
+        return false;
+    /* like the DCD copying to the endpoint buffer in USB RAM */
+    in_flight = malloc(sizeof(*in_flight));
+    in_flight->len = MIN(len, SIM_USB_PACKET_SIZE);
+    memcpy(in_flight->data, buffer, in_flight->len);
+    in_claimed = true;
+    return true;
+}
+
+/* called with usb_lock held */
+static uint32_t flush_locked(void)
+{
+    uint8_t data[SIM_USB_PACKET_SIZE];
+    uint32_t len;
+    if (!tx_ff.count || in_flight || in_claimed)
+        return 0;
+    len = ff_read(&tx_ff, data, SIM_USB_PACKET_SIZE);
+    edpt_xfer_locked(data, len);
+    return len;
+}
+
+/* called with usb_lock held, returns the length of the completed transfer or -1 */
+static int complete_in_locked(void)
+{
+    sim_packet *p = in_flight;
+    if (!p)
+        return -1;
+    in_flight = NULL;
+    in_claimed = false;
+    SIM_COUNT(usb_in_packets, 1);
+    SIM_COUNT(usb_in_bytes, p->len);
+    queue_put(&in_queue, p);
+    pthread_cond_broadcast(&usb_host_cond);
+    return p->len;
+}
+
+bool tusb_init(void)
+{
+    return true;
+}
+
+bool tud_mounted(void)
+{
+    pthread_mutex_lock(&usb_lock);
+    bool m = mounted;
+    pthread_mutex_unlock(&usb_lock);
+    return m;
+}
+
+bool tud_ready(void)
+{
+    return tud_mounted();
+}
+
+static void queue_free(sim_packet_queue *q)
+{
+    sim_packet *p;
+    while ((p = queue_get(q)))
+        free(p);
+}
+
+/* called with usb_lock held, like usbd_reset() and the vendor class reset */
+static void bus_reset_locked(void)
+{
+    free(in_flight);
+    in_flight = NULL;
+    in_claimed = false;
+    queue_free(&in_queue);
+    queue_free(&out_queue);
+    rx_ff.head = rx_ff.count = 0;
+    tx_ff.head = tx_ff.count = 0;
+    reset_pending = false;
+    mounted = false;
+    pthread_cond_broadcast(&usb_host_cond);
+}
+
+static void bus_reset(void)
+{
+    if (tud_umount_cb)
+        tud_umount_cb();
+    pthread_mutex_lock(&usb_lock);
+    mounted = true;
+    pthread_mutex_unlock(&usb_lock);
+    if (tud_mount_cb)
+        tud_mount_cb();
+}
+
+bool usbd_edpt_claim(uint8_t rhport, uint8_t ep_addr)
+{
+    (void)rhport;
+    (void)ep_addr;
+    pthread_mutex_lock(&usb_lock);
+    bool claimed = !in_claimed && !in_flight;
+    if (claimed)
+        in_claimed = true;
+    pthread_mutex_unlock(&usb_lock);
+    return claimed;
+}
+
+bool usbd_edpt_release(uint8_t rhport, uint8_t ep_addr)
+{
+    (void)rhport;
+    (void)ep_addr;
+    pthread_mutex_lock(&usb_lock);
+    bool released = in_claimed && !in_flight;
+    if (released)
+        in_claimed = false;
+    pthread_mutex_unlock(&usb_lock);
+    return released;
+}
+
+bool usbd_edpt_busy(uint8_t rhport, uint8_t ep_addr)
+{
+    (void)rhport;
+    (void)ep_addr;
+    pthread_mutex_lock(&usb_lock);
+    bool busy = in_flight != NULL;
+    pthread_mutex_unlock(&usb_lock);
+    return busy;
+}
+
+bool usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t *buffer, uint16_t total_bytes)
+{
+    (void)rhport;
+    (void)ep_addr;
+    pthread_mutex_lock(&usb_lock);
+    bool started = edpt_xfer_locked(buffer, total_bytes);
+    pthread_mutex_unlock(&usb_lock);
+    return started;
+}
+
+void tud_task(void)
+{
+    if (sim_stopping())
+        sim_thread_exit();
+    bool event = false;
+    int sent;
+    bool reset = false;
+    pthread_mutex_lock(&usb_lock);
+    task_count++;
+    if (reset_pending && in_flight)
+    {
+        bus_reset_locked();
+        reset = true;
+    }
+    sent = complete_in_locked();
+    pthread_mutex_unlock(&usb_lock);
+    if (reset)
+    {
+        event = true;
+        bus_reset();
+    }
+    if (sent >= 0)
+    {
+        event = true;
+        if (tud_vendor_tx_cb)
+            tud_vendor_tx_cb(0, sent);
+        /* the vendor class then sends what is left in its TX FIFO */
+        tud_vendor_write_flush();
+    }
+    pthread_mutex_lock(&usb_lock);
+    /* the OUT endpoint is only re-armed when a full packet fits in the FIFO */
+    sim_packet *received = NULL;
+    if (out_queue.head && (rx_ff.size - rx_ff.count) >= SIM_USB_PACKET_SIZE)
+    {
+        received = queue_get(&out_queue);
+        ff_write(&rx_ff, received->data, received->len);
+        out_taken++;
+        pthread_cond_broadcast(&usb_host_cond);
+        event = true;
+    }
+    pthread_mutex_unlock(&usb_lock);
+    if (received)
+    {
+        if (tud_vendor_rx_cb)
+            tud_vendor_rx_cb(0, received->data, received->len);
+        free(received);
+    }
+    /* nothing happened, don't starve core1 when the host has few CPUs */
+    if (!event)
+        sched_yield();
+}
+
+uint32_t tud_vendor_available(void)
+{
+    pthread_mutex_lock(&usb_lock);
+    uint32_t n = rx_ff.count;
+    pthread_mutex_unlock(&usb_lock);
+    return n;
+}
+
+uint32_t tud_vendor_read(void *buffer, uint32_t bufsize)
+{
+    pthread_mutex_lock(&usb_lock);
+    uint32_t n = ff_read(&rx_ff, buffer, bufsize);
+    pthread_mutex_unlock(&usb_lock);
+    return n;
+}
+
+uint32_t tud_vendor_write(const void *buffer, uint32_t bufsize)
+{
+    pthread_mutex_lock(&usb_lock);
+    uint32_t n = ff_write(&tx_ff, buffer, bufsize);
+    if (tx_ff.count >= SIM_USB_PACKET_SIZE)
+        flush_locked();
+    pthread_mutex_unlock(&usb_lock);
+    return n;
+}
+
+uint32_t tud_vendor_write_flush(void)
+{
+    pthread_mutex_lock(&usb_lock);
+    uint32_t n = flush_locked();
+    pthread_mutex_unlock(&usb_lock);
+    return n;
+}
+
+uint32_t tud_vendor_write_available(void)
+{
+    pthread_mutex_lock(&usb_lock);
+    uint32_t n = tx_ff.size - tx_ff.count;
+    pthread_mutex_unlock(&usb_lock);
+    return n;
+}
+
+void sim_usb_host_write(const void *data, size_t len)
+{
+    const uint8_t *src = data;
+    pthread_mutex_lock(&usb_lock);
+    while (len)
+    {
+        sim_packet *p = malloc(sizeof(*p));
+        p->len = MIN(len, SIM_USB_PACKET_SIZE);
+        memcpy(p->data, src, p->len);
+        src += p->len;
+        len -= p->len;
+        SIM_COUNT(usb_out_packets, 1);
+        SIM_COUNT(usb_out_bytes, p->len);
+        queue_put(&out_queue, p);
+    }
+    pthread_mutex_unlock(&usb_lock);
+}
+
+void sim_usb_host_reset(void)
+{
+    pthread_mutex_lock(&usb_lock);
+    reset_pending = true;
+    pthread_mutex_unlock(&usb_lock);
+}
+
+static void deadline_in(struct timespec *deadline, unsigned timeout_ms)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+int sim_usb_host_read(void *data, size_t len, unsigned timeout_ms)
+{
+    struct timespec deadline;
+    sim_packet *p;
+    int rc = 0;
+
+    deadline_in(&deadline, timeout_ms);
+    pthread_mutex_lock(&usb_lock);
+    while (!in_queue.head && rc != ETIMEDOUT)
+        rc = pthread_cond_timedwait(&usb_host_cond, &usb_lock, &deadline);
+    p = queue_get(&in_queue);
+    pthread_mutex_unlock(&usb_lock);
+    if (!p)
+        return -1;
+    int n = MIN(len, p->len);
+    memcpy(data, p->data, n);
+    free(p);
+    return n;
+}
+
+uint64_t sim_usb_host_wait(bool in, uint64_t out_seen, unsigned timeout_ms)
+{
+    struct timespec deadline;
+    int rc = 0;
+
+    deadline_in(&deadline, timeout_ms);
+    pthread_mutex_lock(&usb_lock);
+    while (!(in && in_queue.head) && out_taken == out_seen && rc != ETIMEDOUT)
+        rc = pthread_cond_timedwait(&usb_host_cond, &usb_lock, &deadline);
+    uint64_t taken = out_taken;
+    pthread_mutex_unlock(&usb_lock);
+    return taken;
+}
+
+bool sim_usb_out_drained(void)
+{
+    pthread_mutex_lock(&usb_lock);
+    bool drained = !out_queue.head && rx_ff.count == 0 && !in_flight && tx_ff.count == 0;
+    pthread_mutex_unlock(&usb_lock);
+    return drained;
+}
+
+uint64_t sim_usb_task_count(void)
+{
+    pthread_mutex_lock(&usb_lock);
+    uint64_t n = task_count;
+    pthread_mutex_unlock(&usb_lock);
+    return n;
+}
@@ -0,0 +1,216 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020-2022 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * Decoder of the packed TDI of CMD_LONGXFER and encoder of its packed TDO
+ * (format in pack.h). Long runs of 0x00 or 0xFF and repeated frames of FPGA
+ * bitstreams, or sparse data read back, then take a few bytes of the USB
+ * stream instead of all of them.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <pico/stdlib.h>
+
+#include "dirtyJtagConfig.h"
+#include "pack.h"
+
+#define WINDOW_MASK (PACK_WINDOW_SIZE - 1)
+
+enum token_kind {
+    TOKEN_LITERAL,
+    TOKEN_REPEAT,
+    TOKEN_COPY,
+};
+
+// Bytes of the header and operands of a token, without its literal bytes
+static const uint8_t token_length[] = { 1, 3, 3 };
+
+static struct {
+    uint32_t remaining;     // bytes still to produce
+    uint32_t position;      // bytes produced, their window index is position & WINDOW_MASK
+    uint8_t token[3];       // token being received
+    uint8_t token_count;
+    enum token_kind kind;   // of the token being produced
+    uint32_t run;           // bytes it still produces
+    uint8_t value;
+    uint32_t distance;
+} unpack_state;
+
+// Last bytes produced, the back references point in there and the bytes ready are taken from it
+static uint8_t window[PACK_WINDOW_SIZE];
+
+void unpack_begin(uint32_t length)
+{
+    memset(&unpack_state, 0, sizeof(unpack_state));
+    unpack_state.remaining = length;
+    memset(window, 0, sizeof(window));
+}
+
+uint32_t __time_critical_func(unpack)(const uint8_t *data, uint32_t count, uint32_t max, const uint8_t **out, uint32_t *ready)
+{
+    uint32_t start = unpack_state.position & WINDOW_MASK;
+    uint32_t used = 0, produced = 0;
+
+    // at most half the window, the previous bytes ready stay in the other half
+    max = MIN(max, PACK_WINDOW_SIZE / 2);
+    max = MIN(max, PACK_WINDOW_SIZE - start);
+    max = MIN(max, unpack_state.remaining);
+    while (produced < max)
+    {
+        if (unpack_state.run)
+        {
+            uint8_t *dst = window + start + produced;
+            uint32_t n = MIN(unpack_state.run, max - produced);
+            if (unpack_state.kind == TOKEN_LITERAL)
+            {
+                n = MIN(n, count - used);
+                if (!n)
+                    break;
+                memcpy(dst, data + used, n);
+                used += n;
+            }
+            else if (unpack_state.kind == TOKEN_REPEAT)
+            {
+                memset(dst, unpack_state.value, n);
+            }
+            else
+            {
+                uint32_t from = unpack_state.position + produced - unpack_state.distance;
+                for (uint32_t i = 0; i < n; i++)
+                    dst[i] = window[(from + i) & WINDOW_MASK];
+            }
+            unpack_state.run -= n;
+            produced += n;
+            continue;
+        }
+        if (used == count)
+            break;
+
+        uint8_t *token = unpack_state.token;
+        token[unpack_state.token_count++] = data[used++];
+        enum token_kind kind = (token[0] & 0x80) ? ((token[0] & 0x40) ? TOKEN_COPY : TOKEN_REPEAT) : TOKEN_LITERAL;
+        if (unpack_state.token_count < token_length[kind])
+            continue;
+        unpack_state.token_count = 0;
+        unpack_state.kind = kind;
+        switch (kind)
+        {
+        case TOKEN_LITERAL:
+            unpack_state.run = token[0] + 1;
+            break;
+        case TOKEN_REPEAT:
+            unpack_state.run = (((token[0] & 0x3F) << 8) | token[1]) + 1;
+            unpack_state.value = token[2];
+            break;
+        case TOKEN_COPY:
+            unpack_state.run = (token[0] & 0x3F) + 4;
+            unpack_state.distance = (((token[1] << 8) | token[2]) & WINDOW_MASK) + 1;
+            break;
+        }
+    }
+    unpack_state.position += produced;
+    unpack_state.remaining -= produced;
+    *out = window + start;
+    *ready = produced;
+    return used;
+}
+
+// Shortest run packed as a repeat, a literal of fewer bytes is no longer
+#define PACK_MIN_REPEAT 4
+
+static struct {
+    uint8_t literal[128];   // bytes of the literal token being gathered
+    uint32_t literal_count;
+    uint8_t value;          // of the run in progress
+    uint32_t run;
+} pack_state;
+
+void pack_begin(void)
+{
+    pack_state.literal_count = 0;
+    pack_state.run = 0;
+}
+
+static uint32_t pack_literal(uint8_t *out)
+{
+    uint32_t n = pack_state.literal_count;
+    if (!n)
+        return 0;
+    out[0] = n - 1;
+    memcpy(out + 1, pack_state.literal, n);
+    pack_state.literal_count = 0;
+    return n + 1;
+}
+
+// Ends the run in progress
+static uint32_t pack_run(uint8_t *out)
+{
+    uint32_t written = 0;
+    if (pack_state.run >= PACK_MIN_REPEAT)
+    {
+        written = pack_literal(out);
+        out[written++] = 0x80 | ((pack_state.run - 1) >> 8);
+        out[written++] = pack_state.run - 1;
+        out[written++] = pack_state.value;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < pack_state.run; i++)
+        {
+            if (pack_state.literal_count == sizeof(pack_state.literal))
+                written += pack_literal(out + written);
+            pack_state.literal[pack_state.literal_count++] = pack_state.value;
+        }
+    }
+    pack_state.run = 0;
+    return written;
+}
+
+uint32_t __time_critical_func(pack)(const uint8_t *data, uint32_t count, uint8_t *out)
+{
+    uint32_t written = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (pack_state.run && (data[i] == pack_state.value) && (pack_state.run < (1 << 14)))
+        {
+            pack_state.run++;
+            continue;
+        }
+        written += pack_run(out + written);
+        pack_state.value = data[i];
+        pack_state.run = 1;
+    }
+    return written;
+}
+
+uint32_t pack_end(uint8_t *out)
+{
+    uint32_t written = pack_run(out);
+    return written + pack_literal(out + written);
+}
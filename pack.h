@@ -0,0 +1,67 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020-2022 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _PACK_H
+#define _PACK_H
+
+#include <stdint.h>
+
+/*
+ * Packed TDI of CMD_LONGXFER: a sequence of tokens, each one a header byte
+ * followed by its operands.
+ *
+ * 0nnnnnnn, n+1 bytes                      n+1 literal bytes
+ * 10nnnnnn nnnnnnnn, value                 n+1 copies of value (14 bit n)
+ * 11nnnnnn dddddddd dddddddd               n+4 bytes copied from d+1 bytes back
+ *                                          (d big endian, below PACK_WINDOW_SIZE)
+ *
+ * The stream ends with the token completing the transfer. A copy may overlap
+ * the bytes it produces; from before the start of the transfer it reads zeros.
+ *
+ * Packed TDO uses the literal and repeat tokens only.
+ */
+
+// Bytes pack() and pack_end() may write on top of the count bytes given to pack()
+#define PACK_MARGIN 140
+
+// Starts decoding a packed stream of length bytes once unpacked
+void unpack_begin(uint32_t length);
+
+// Decodes from the count bytes of data until max bytes are ready or data is used up, tokens may
+// be split anywhere. Returns the number of bytes of data used, the bytes ready are in *out. They
+// are not overwritten by the next call, so they may still be shifting while it runs.
+uint32_t unpack(const uint8_t *data, uint32_t count, uint32_t max, const uint8_t **out, uint32_t *ready);
+
+// Starts packing a stream
+void pack_begin(void);
+
+// Packs the next count bytes of the stream into out, returns the number of bytes written. The
+// last bytes may be kept for the next call, runs are not cut between calls.
+uint32_t pack(const uint8_t *data, uint32_t count, uint8_t *out);
+
+// Ends the stream, writes what was kept into out and returns its length
+uint32_t pack_end(uint8_t *out);
+
+#endif
@@ -24,16 +24,77 @@
  */
 
 #include <hardware/clocks.h>
+#include <pico/time.h>
 #include "hardware/dma.h"
 #include "dirtyJtagConfig.h"
 #include "pio_jtag.h"
 #include "jtag.pio.h"
+#include "sys_clock.h"
+#include "stats.h"
+#include "trace.h"
 
 void jtag_task();//to process USB OUT packets while waiting for DMA to finish
 
 #define DMA
 
-static bool last_tdo = false;
+// State of a chain, each pio_jtag_inst_t gets its own from init_jtag()
+struct pio_jtag_state {
+    bool last_tdo;
+    bool lsb_first; // bit order of the djtag_tdo state machine, see jtag_set_bit_order()
+#ifdef DMA
+    int tx_dma_chan; // -1 until dma_init()
+    int rx_dma_chan;
+    dma_channel_config tx_c;
+    dma_channel_config rx_c;
+    // Same channels moving 32 bit FIFO words, byte swapped so the bytes in memory stay MSB first
+    dma_channel_config tx_c32;
+    dma_channel_config rx_c32;
+    bool words_pending; // a NO_READ run of pio_jtag_write_words is left finishing, see jtag_sync()
+    uint32_t word_scratch; // receives the discarded TDO words of that run
+#endif
+    // State of the shift started by pio_jtag_stream_begin(), its data comes in pieces
+    struct {
+        uint32_t len_remain;
+        bool read;
+    } stream;
+    uint tck_khz; // last asked of jtag_set_clk_freq()
+    uint rtck_offset; // djtag_rtck waiting on pin_rtck in the instruction memory
+    bool rtck; // djtag_rtck running, see jtag_set_clk_freq()
+};
+
+static pio_jtag_state chain_states[JTAG_CHAIN_MAX];
+static uint chain_count;
+
+// djtag_tdo in the instruction memory of each PIO, loaded with its first chain
+static uint tdo_offsets[NUM_PIOS];
+static uint tdo_loaded; // a bit per PIO
+
+// MSB first, the OSR shifts left so a byte has to sit in the top lane of the FIFO word,
+// LSB first it shifts right from the bottom lane.
+// A byte wide write (as done by the DMA) gets both through bus lane replication.
+static inline uint32_t tx_word(const pio_jtag_inst_t *jtag, uint8_t byte)
+{
+    return jtag->state->lsb_first ? byte : (uint32_t)byte << 24;
+}
+
+// MSB first, the ISR shifts left and a pushed byte is in the bottom lane of the FIFO word,
+// LSB first it shifts right and the byte is in the top lane.
+static inline uint8_t rx_byte(const pio_jtag_inst_t *jtag, uint32_t word)
+{
+    return jtag->state->lsb_first ? (uint8_t)(word >> 24) : (uint8_t)word;
+}
+
+// Last TDO bit of a byte as pushed by the state machine
+static inline bool rx_last_bit(const pio_jtag_inst_t *jtag, uint8_t byte)
+{
+    return jtag->state->lsb_first ? !!(byte & 0x80) : !!(byte & 1);
+}
+
+// Moves the bits of a partial last byte to where the host expects them: first bit in bit 7 (MSB first) or 0 (LSB first)
+static inline uint8_t rx_fix_last_byte(const pio_jtag_inst_t *jtag, uint8_t byte, size_t last_shift)
+{
+    return jtag->state->lsb_first ? byte >> last_shift : byte << last_shift;
+}
 
 #if 0
 static bool pins_source = false; //false: PIO, true: GPIO
@@ -64,216 +125,436 @@ static void switch_pins_source(const pio_jtag_inst_t *jtag, bool gpio)
 
 #ifdef DMA
 
-static int tx_dma_chan = -1;
-static int rx_dma_chan;
-static dma_channel_config tx_c;
-static dma_channel_config rx_c;
+// Where the RX channel reads the FIFO from: the lane of the bytes for byte transfers
+static inline const volatile void* rx_fifo_addr(const pio_jtag_inst_t *jtag, bool bytes)
+{
+    return (const volatile uint8_t*)&jtag->pio->rxf[jtag->sm] + ((bytes && jtag->state->lsb_first) ? 3 : 0);
+}
 #endif
 
-void dma_init()
+static void dma_init(const pio_jtag_inst_t *jtag)
 {
 #ifdef DMA
-    if (tx_dma_chan == -1)
+    pio_jtag_state *state = jtag->state;
+    if (state->tx_dma_chan == -1)
     {
-        // Configure a channel to write a buffer to PIO0
-        // SM0's TX FIFO, paced by the data request signal from that peripheral.
-        tx_dma_chan = dma_claim_unused_channel(true);
-        tx_c = dma_channel_get_default_config(tx_dma_chan);
-        channel_config_set_transfer_data_size(&tx_c, DMA_SIZE_8);
-        channel_config_set_read_increment(&tx_c, true);
-        channel_config_set_dreq(&tx_c, DREQ_PIO0_TX0);
+        // Configure a channel to write a buffer to the
+        // SM's TX FIFO, paced by the data request signal from that peripheral.
+        state->tx_dma_chan = dma_claim_unused_channel(true);
+        state->tx_c = dma_channel_get_default_config(state->tx_dma_chan);
+        channel_config_set_transfer_data_size(&state->tx_c, DMA_SIZE_8);
+        channel_config_set_read_increment(&state->tx_c, true);
+        channel_config_set_dreq(&state->tx_c, pio_get_dreq(jtag->pio, jtag->sm, true));
             dma_channel_configure(
-            tx_dma_chan,
-            &tx_c,
-            &pio0_hw->txf[0], // Write address (only need to set this once)
+            state->tx_dma_chan,
+            &state->tx_c,
+            &jtag->pio->txf[jtag->sm], // Write address (only need to set this once)
             NULL,             // Don't provide a read address yet
             0,                // Don't provide the count yet
             false             // Don't start yet
         );
-        // Configure a channel to read a buffer from PIO0
-        // SM0's RX FIFO, paced by the data request signal from that peripheral.
-        rx_dma_chan = dma_claim_unused_channel(true);
-        rx_c = dma_channel_get_default_config(rx_dma_chan);
-        channel_config_set_transfer_data_size(&rx_c, DMA_SIZE_8);
-        channel_config_set_write_increment(&rx_c, false);
-        channel_config_set_read_increment(&rx_c, false);
-        channel_config_set_dreq(&rx_c, DREQ_PIO0_RX0);
+        // Configure a channel to read a buffer from the
+        // SM's RX FIFO, paced by the data request signal from that peripheral.
+        state->rx_dma_chan = dma_claim_unused_channel(true);
+        state->rx_c = dma_channel_get_default_config(state->rx_dma_chan);
+        channel_config_set_transfer_data_size(&state->rx_c, DMA_SIZE_8);
+        channel_config_set_write_increment(&state->rx_c, false);
+        channel_config_set_read_increment(&state->rx_c, false);
+        channel_config_set_dreq(&state->rx_c, pio_get_dreq(jtag->pio, jtag->sm, false));
         dma_channel_configure(
-            rx_dma_chan,
-            &rx_c,
+            state->rx_dma_chan,
+            &state->rx_c,
             NULL,             // Dont provide a write address yet
-            &pio0_hw->rxf[0], // Read address (only need to set this once)
+            &jtag->pio->rxf[jtag->sm], // Read address (only need to set this once)
             0,                // Don't provide the count yet
             false             // Don't start yet
             );
+        state->tx_c32 = state->tx_c;
+        channel_config_set_transfer_data_size(&state->tx_c32, DMA_SIZE_32);
+        channel_config_set_bswap(&state->tx_c32, true);
+        state->rx_c32 = state->rx_c;
+        channel_config_set_transfer_data_size(&state->rx_c32, DMA_SIZE_32);
     }
 #endif
 
 }
 
 
-void __time_critical_func(pio_jtag_write_blocking)(const pio_jtag_inst_t *jtag, const uint8_t *bsrc, size_t len) 
+#ifdef DMA
+// Keeps the USB going while a channel completes
+static void __time_critical_func(dma_wait)(int chan)
+{
+    uint32_t start = time_us_32();
+    uint32_t end;
+    while (dma_channel_is_busy(chan))
+    {
+        jtag_task();
+        tight_loop_contents();
+    }
+    end = time_us_32();
+    stats.dma_wait_us += end - start;
+    trace_shifted(end);
+    // stop the compiler hoisting a non volatile buffer access above the DMA completion.
+    __compiler_memory_barrier();
+}
+#endif
+
+static void __time_critical_func(pio_jtag_write_bytes)(const pio_jtag_inst_t *jtag, const uint8_t *bsrc, size_t len)
 {
     size_t byte_length = (len+7 >> 3);
     size_t last_shift = ((byte_length << 3) - len);
-    size_t tx_remain = byte_length, rx_remain = last_shift ? byte_length : byte_length+1;
-    io_rw_8 *txfifo = (io_rw_8 *) &jtag->pio->txf[jtag->sm];
-    io_rw_8 *rxfifo = (io_rw_8 *) &jtag->pio->rxf[jtag->sm];
+    // the empty word pushed at the end when len is a multiple of 8 is read separately, x keeps the last TDO
+    size_t tx_remain = byte_length, rx_remain = byte_length;
     uint8_t x; // scratch local to receive data
     //kick off the process by sending the len to the tx pipeline
-    *(io_rw_32*)txfifo = len-1;
+    pio_sm_put(jtag->pio, jtag->sm, len-1);
+    stats.bits_shifted += len;
 #ifdef DMA
     if (byte_length > 4)
     {
-        dma_init();
-        channel_config_set_read_increment(&tx_c, true);
-        channel_config_set_write_increment(&rx_c, false);
-        dma_channel_set_config(rx_dma_chan, &rx_c, false);
-        dma_channel_set_config(tx_dma_chan, &tx_c, false);
-        dma_channel_transfer_to_buffer_now(rx_dma_chan, (void*)&x, rx_remain);
-        dma_channel_transfer_from_buffer_now(tx_dma_chan, (void*)bsrc, tx_remain);
-        while (dma_channel_is_busy(rx_dma_chan))
-        {
-            jtag_task();
-            tight_loop_contents();
-        }
-        // stop the compiler hoisting a non volatile buffer access above the DMA completion.
-        __compiler_memory_barrier();
+        stats.dma_shifts++;
+        dma_init(jtag);
+        channel_config_set_read_increment(&jtag->state->tx_c, true);
+        channel_config_set_write_increment(&jtag->state->rx_c, false);
+        dma_channel_set_config(jtag->state->rx_dma_chan, &jtag->state->rx_c, false);
+        dma_channel_set_read_addr(jtag->state->rx_dma_chan, rx_fifo_addr(jtag, true), false);
+        dma_channel_set_config(jtag->state->tx_dma_chan, &jtag->state->tx_c, false);
+        dma_channel_transfer_to_buffer_now(jtag->state->rx_dma_chan, (void*)&x, rx_remain);
+        dma_channel_transfer_from_buffer_now(jtag->state->tx_dma_chan, (void*)bsrc, tx_remain);
+        dma_wait(jtag->state->rx_dma_chan);
     }
     else
 #endif
     {
+        stats.polled_shifts++;
         while (tx_remain || rx_remain) 
         {
             if (tx_remain && !pio_sm_is_tx_fifo_full(jtag->pio, jtag->sm))
             {
-                *txfifo = *bsrc++;
+                pio_sm_put(jtag->pio, jtag->sm, tx_word(jtag, *bsrc++));
                 --tx_remain;
             }
             if (rx_remain && !pio_sm_is_rx_fifo_empty(jtag->pio, jtag->sm))
             {
-                x = *rxfifo;
+                x = rx_byte(jtag, pio_sm_get(jtag->pio, jtag->sm));
                 --rx_remain;
             }
         }
     }
-    last_tdo = !!(x & 1);
+    if (!last_shift)
+        (void)pio_sm_get_blocking(jtag->pio, jtag->sm);
+    jtag->state->last_tdo = rx_last_bit(jtag, x);
 }
 
-void __time_critical_func(pio_jtag_write_read_blocking)(const pio_jtag_inst_t *jtag, const uint8_t *bsrc, uint8_t *bdst,
-                                                         size_t len) 
+static void __time_critical_func(pio_jtag_write_read_bytes)(const pio_jtag_inst_t *jtag, const uint8_t *bsrc, uint8_t *bdst,
+                                                            size_t len)
 {
     size_t byte_length = (len+7 >> 3);
     size_t last_shift = ((byte_length << 3) - len);
-    size_t tx_remain = byte_length, rx_remain = last_shift ? byte_length : byte_length+1;
+    // bdst may be an endpoint buffer with no room past byte_length,
+    // the empty word pushed at the end when len is a multiple of 8 is read separately
+    size_t tx_remain = byte_length, rx_remain = byte_length;
     uint8_t* rx_last_byte_p = &bdst[byte_length-1];
-    io_rw_8 *txfifo = (io_rw_8 *) &jtag->pio->txf[jtag->sm];
-    io_rw_8 *rxfifo = (io_rw_8 *) &jtag->pio->rxf[jtag->sm];
     //kick off the process by sending the len to the tx pipeline
-    *(io_rw_32*)txfifo = len-1;
+    pio_sm_put(jtag->pio, jtag->sm, len-1);
+    stats.bits_shifted += len;
 #ifdef DMA
     if (byte_length > 4)
     {
-        dma_init();
-        channel_config_set_read_increment(&tx_c, true);
-        channel_config_set_write_increment(&rx_c, true);
-        dma_channel_set_config(rx_dma_chan, &rx_c, false);
-        dma_channel_set_config(tx_dma_chan, &tx_c, false);
-        dma_channel_transfer_to_buffer_now(rx_dma_chan, (void*)bdst, rx_remain);
-        dma_channel_transfer_from_buffer_now(tx_dma_chan, (void*)bsrc, tx_remain);
-        while (dma_channel_is_busy(rx_dma_chan))
-        {
-            jtag_task();
-            tight_loop_contents();
-        }
-        // stop the compiler hoisting a non volatile buffer access above the DMA completion.
-        __compiler_memory_barrier();
+        stats.dma_shifts++;
+        dma_init(jtag);
+        channel_config_set_read_increment(&jtag->state->tx_c, true);
+        channel_config_set_write_increment(&jtag->state->rx_c, true);
+        dma_channel_set_config(jtag->state->rx_dma_chan, &jtag->state->rx_c, false);
+        dma_channel_set_read_addr(jtag->state->rx_dma_chan, rx_fifo_addr(jtag, true), false);
+        dma_channel_set_config(jtag->state->tx_dma_chan, &jtag->state->tx_c, false);
+        dma_channel_transfer_to_buffer_now(jtag->state->rx_dma_chan, (void*)bdst, rx_remain);
+        dma_channel_transfer_from_buffer_now(jtag->state->tx_dma_chan, (void*)bsrc, tx_remain);
+        dma_wait(jtag->state->rx_dma_chan);
     }
     else
 #endif
     {
+        stats.polled_shifts++;
         while (tx_remain || rx_remain) 
         {
             if (tx_remain && !pio_sm_is_tx_fifo_full(jtag->pio, jtag->sm))
             {
-                *txfifo = *bsrc++;
+                pio_sm_put(jtag->pio, jtag->sm, tx_word(jtag, *bsrc++));
                 --tx_remain;
             }
             if (rx_remain && !pio_sm_is_rx_fifo_empty(jtag->pio, jtag->sm))
             {
-                *bdst++ = *rxfifo;
+                *bdst++ = rx_byte(jtag, pio_sm_get(jtag->pio, jtag->sm));
                 --rx_remain;
             }
         }
     }
-    last_tdo = !!(*rx_last_byte_p & 1);
+    if (!last_shift)
+        (void)pio_sm_get_blocking(jtag->pio, jtag->sm);
+    jtag->state->last_tdo = rx_last_bit(jtag, *rx_last_byte_p);
     // fix the last byte
     if (last_shift)
     {
-        *rx_last_byte_p = *rx_last_byte_p << last_shift;
+        *rx_last_byte_p = rx_fix_last_byte(jtag, *rx_last_byte_p, last_shift);
+    }
+}
+
+#ifdef DMA
+// Shifts below this many bytes are not worth changing the FIFO word size
+#define WORD_SHIFT_MIN 16
+
+// Completes the run pio_jtag_write_words left finishing on its own
+static void __time_critical_func(pio_jtag_words_end)(const pio_jtag_inst_t *jtag)
+{
+    dma_wait(jtag->state->rx_dma_chan);
+    // the final push of the program brings an empty word
+    (void)pio_sm_get_blocking(jtag->pio, jtag->sm);
+    jtag->state->last_tdo = jtag->state->lsb_first ? !!(jtag->state->word_scratch >> 31) : !!(jtag->state->word_scratch & 1);
+    pio_jtag_set_word_size(jtag->pio, jtag->sm, 8, 8);
+    jtag->state->words_pending = false;
+}
+
+// Shifts words 32 bit words as one run of the program, a TX FIFO word and a DMA beat each.
+// src must be word aligned, so must dst for the TDO to come back 32 bits at a time too, else it comes
+// a byte at a time. Without wait, a NO_READ run returns once its data is in the TX FIFO,
+// jtag_sync() must then be called before the chain is used again.
+static void __time_critical_func(pio_jtag_write_words)(const pio_jtag_inst_t *jtag, const uint8_t *src, uint8_t *dst,
+                                                       size_t words, bool wait)
+{
+    bool rx_words = !dst || !((uintptr_t)dst & 3);
+    pio_jtag_set_word_size(jtag->pio, jtag->sm, 32, rx_words ? 32 : 8);
+    pio_sm_put(jtag->pio, jtag->sm, words * 32 - 1);
+    stats.bits_shifted += words * 32;
+    stats.dma_shifts++;
+    dma_init(jtag);
+    if (rx_words)
+    {
+        channel_config_set_write_increment(&jtag->state->rx_c32, dst != NULL);
+        // LSB first, the words are already in memory order
+        channel_config_set_bswap(&jtag->state->rx_c32, dst != NULL && !jtag->state->lsb_first);
+        dma_channel_set_config(jtag->state->rx_dma_chan, &jtag->state->rx_c32, false);
+        dma_channel_set_read_addr(jtag->state->rx_dma_chan, rx_fifo_addr(jtag, false), false);
+        dma_channel_transfer_to_buffer_now(jtag->state->rx_dma_chan, dst ? (void*)dst : (void*)&jtag->state->word_scratch, words);
     }
+    else
+    {
+        channel_config_set_write_increment(&jtag->state->rx_c, true);
+        dma_channel_set_config(jtag->state->rx_dma_chan, &jtag->state->rx_c, false);
+        dma_channel_set_read_addr(jtag->state->rx_dma_chan, rx_fifo_addr(jtag, true), false);
+        dma_channel_transfer_to_buffer_now(jtag->state->rx_dma_chan, (void*)dst, words * 4);
+    }
+    channel_config_set_bswap(&jtag->state->tx_c32, !jtag->state->lsb_first);
+    dma_channel_set_config(jtag->state->tx_dma_chan, &jtag->state->tx_c32, false);
+    dma_channel_transfer_from_buffer_now(jtag->state->tx_dma_chan, (void*)src, words);
+    jtag->state->words_pending = true;
+    if (!wait && !dst)
+    {
+        dma_wait(jtag->state->tx_dma_chan);
+        return;
+    }
+    pio_jtag_words_end(jtag);
+    if (dst)
+        jtag->state->last_tdo = rx_last_bit(jtag, dst[words * 4 - 1]);
+}
+
+// Number of 32 bit words in the middle of a shift of byte_length bytes, after head bytes to align src.
+// When the shift ends in the middle of a byte, that byte is left to the 8 bit path which fixes it.
+static size_t shift_words(const uint8_t *src, size_t byte_length, size_t len, size_t *head)
+{
+    *head = (4 - ((uintptr_t)src & 3)) & 3;
+    if (byte_length < WORD_SHIFT_MIN)
+        return 0;
+    return (byte_length - *head - ((len & 7) ? 1 : 0)) / 4;
+}
+#endif
+
+void __time_critical_func(jtag_sync)(const pio_jtag_inst_t *jtag)
+{
+#ifdef DMA
+    if (jtag->state->words_pending)
+        pio_jtag_words_end(jtag);
+#endif
+}
+
+void __time_critical_func(pio_jtag_write_blocking)(const pio_jtag_inst_t *jtag, const uint8_t *bsrc, size_t len)
+{
+    jtag_sync(jtag);
+#ifdef DMA
+    size_t head;
+    size_t words = shift_words(bsrc, (len + 7) >> 3, len, &head);
+    if (words)
+    {
+        if (head)
+            pio_jtag_write_bytes(jtag, bsrc, head * 8);
+        // a shift ending with whole words keeps going while the CPU moves on, to another chain too
+        pio_jtag_write_words(jtag, bsrc + head, NULL, words, len != (head + words * 4) * 8);
+        bsrc += head + words * 4;
+        len -= (head + words * 4) * 8;
+        if (len == 0)
+            return;
+    }
+#endif
+    pio_jtag_write_bytes(jtag, bsrc, len);
+}
+
+void __time_critical_func(pio_jtag_write_read_blocking)(const pio_jtag_inst_t *jtag, const uint8_t *bsrc, uint8_t *bdst,
+                                                         size_t len)
+{
+    jtag_sync(jtag);
+#ifdef DMA
+    size_t head;
+    size_t words = shift_words(bsrc, (len + 7) >> 3, len, &head);
+    if (words)
+    {
+        if (head)
+            pio_jtag_write_read_bytes(jtag, bsrc, bdst, head * 8);
+        pio_jtag_write_words(jtag, bsrc + head, bdst + head, words, true);
+        bsrc += head + words * 4;
+        bdst += head + words * 4;
+        len -= (head + words * 4) * 8;
+        if (len == 0)
+            return;
+    }
+#endif
+    pio_jtag_write_read_bytes(jtag, bsrc, bdst, len);
 }
 
 uint8_t __time_critical_func(pio_jtag_write_tms_blocking)(const pio_jtag_inst_t *jtag, bool tdi, bool tms, size_t len)
 {
     size_t byte_length = (len+7 >> 3);
     size_t last_shift = ((byte_length << 3) - len);
-    size_t tx_remain = byte_length, rx_remain = last_shift ? byte_length : byte_length+1;
-    io_rw_8 *txfifo = (io_rw_8 *) &jtag->pio->txf[jtag->sm];
-    io_rw_8 *rxfifo = (io_rw_8 *) &jtag->pio->rxf[jtag->sm];
+    // the empty word pushed at the end when len is a multiple of 8 is read separately, x keeps the last TDO
+    size_t tx_remain = byte_length, rx_remain = byte_length;
     uint8_t x; // scratch local to receive data
     uint8_t tdi_word = tdi ? 0xFF : 0x0;
+    jtag_sync(jtag);
     gpio_put(jtag->pin_tms, tms);
     //kick off the process by sending the len to the tx pipeline
-    *(io_rw_32*)txfifo = len-1;
+    pio_sm_put(jtag->pio, jtag->sm, len-1);
+    stats.bits_shifted += len;
 #ifdef DMA
     if (byte_length > 4)
     {   
-        dma_init();
-        channel_config_set_read_increment(&tx_c, false);
-        channel_config_set_write_increment(&rx_c, false);
-        dma_channel_set_config(rx_dma_chan, &rx_c, false);
-        dma_channel_set_config(tx_dma_chan, &tx_c, false);
-        dma_channel_transfer_to_buffer_now(rx_dma_chan, (void*)&x, rx_remain);
-        dma_channel_transfer_from_buffer_now(tx_dma_chan, (void*)&tdi_word, tx_remain);
-        while (dma_channel_is_busy(rx_dma_chan))
-        {
-            jtag_task();
-            tight_loop_contents();
-        }
-        // stop the compiler hoisting a non volatile buffer access above the DMA completion.
-        __compiler_memory_barrier();
+        stats.dma_shifts++;
+        dma_init(jtag);
+        channel_config_set_read_increment(&jtag->state->tx_c, false);
+        channel_config_set_write_increment(&jtag->state->rx_c, false);
+        dma_channel_set_config(jtag->state->rx_dma_chan, &jtag->state->rx_c, false);
+        dma_channel_set_read_addr(jtag->state->rx_dma_chan, rx_fifo_addr(jtag, true), false);
+        dma_channel_set_config(jtag->state->tx_dma_chan, &jtag->state->tx_c, false);
+        dma_channel_transfer_to_buffer_now(jtag->state->rx_dma_chan, (void*)&x, rx_remain);
+        dma_channel_transfer_from_buffer_now(jtag->state->tx_dma_chan, (void*)&tdi_word, tx_remain);
+        dma_wait(jtag->state->rx_dma_chan);
     }
     else
 #endif
     {
+        stats.polled_shifts++;
         while (tx_remain || rx_remain) 
         {
             if (tx_remain && !pio_sm_is_tx_fifo_full(jtag->pio, jtag->sm)) 
             {
-                *txfifo = tdi_word;
+                pio_sm_put(jtag->pio, jtag->sm, tx_word(jtag, tdi_word));
                 --tx_remain;
             }
             if (rx_remain && !pio_sm_is_rx_fifo_empty(jtag->pio, jtag->sm)) 
             {
-                x = *rxfifo;
+                x = rx_byte(jtag, pio_sm_get(jtag->pio, jtag->sm));
                 --rx_remain;
             }
         }
     }
-    last_tdo = !!(x & 1);
-    return last_tdo ? 0xFF : 0x00;
+    if (!last_shift)
+        (void)pio_sm_get_blocking(jtag->pio, jtag->sm);
+    jtag->state->last_tdo = rx_last_bit(jtag, x);
+    return jtag->state->last_tdo ? 0xFF : 0x00;
+}
+
+void __time_critical_func(pio_jtag_write_tms_sequence_blocking)(const pio_jtag_inst_t *jtag, const uint8_t *tms, uint8_t *bdst,
+                                                                 bool tdi, size_t len)
+{
+    size_t byte_length = (len+7 >> 3);
+    size_t last_shift = ((byte_length << 3) - len);
+    size_t tx_remain = byte_length, rx_remain = byte_length;
+    uint8_t x = 0; // scratch local to receive data
+    uint8_t* rx_last_byte_p = bdst ? &bdst[byte_length-1] : &x;
+    bool last_tms = (tms[(len - 1) >> 3] >> (7 - ((len - 1) & 7))) & 1;
+    PIO pio = jtag->pio;
+    uint sm = jtag->sm_tms;
+    jtag_sync(jtag);
+    // the PIO takes TMS over at its current level, TDI holds the requested one
+    pio_sm_set_pins_with_mask(pio, sm,
+                              (gpio_get_out_level(jtag->pin_tms) ? 1u << jtag->pin_tms : 0) | (tdi ? 1u << jtag->pin_tdi : 0),
+                              (1u << jtag->pin_tms) | (1u << jtag->pin_tdi));
+    pio_gpio_init(pio, jtag->pin_tms);
+    //kick off the process by sending the len to the tx pipeline
+    pio_sm_put(pio, sm, len-1);
+    stats.bits_shifted += len;
+    stats.polled_shifts++;
+    // at most 32 bytes, and the DMA channels are paced by the other state machine
+    while (tx_remain || rx_remain)
+    {
+        if (tx_remain && !pio_sm_is_tx_fifo_full(pio, sm))
+        {
+            pio_sm_put(pio, sm, (uint32_t)*tms++ << 24); // always MSB first, unlike djtag_tdo
+            --tx_remain;
+        }
+        if (rx_remain && !pio_sm_is_rx_fifo_empty(pio, sm))
+        {
+            x = (uint8_t)pio_sm_get(pio, sm);
+            if (bdst)
+                *bdst++ = x;
+            --rx_remain;
+        }
+    }
+    if (!last_shift)
+        (void)pio_sm_get_blocking(pio, sm);
+    // back to SIO, at the level the sequence ends with
+    gpio_put(jtag->pin_tms, last_tms);
+    gpio_set_function(jtag->pin_tms, GPIO_FUNC_SIO);
+    jtag->state->last_tdo = !!(*rx_last_byte_p & 1);
+    // fix the last byte
+    if (last_shift)
+    {
+        *rx_last_byte_p = *rx_last_byte_p << last_shift;
+    }
+}
+
+void __time_critical_func(pio_jtag_stream_begin)(const pio_jtag_inst_t *jtag, uint32_t len, bool read)
+{
+    jtag->state->stream.len_remain = len;
+    jtag->state->stream.read = read;
+}
+
+void __time_critical_func(pio_jtag_stream)(const pio_jtag_inst_t *jtag, const uint8_t *bsrc, uint8_t *bdst, size_t byte_count)
+{
+    // each piece is shifted by its own runs of the program, TMS does not change in between
+    bool last = ((size_t)(jtag->state->stream.len_remain >> 3) + ((jtag->state->stream.len_remain & 7) ? 1 : 0) == byte_count);
+    size_t len = last ? jtag->state->stream.len_remain : byte_count * 8;
+    jtag->state->stream.len_remain -= len;
+    // a NO_READ piece ending with whole words keeps the state machine shifting while the next one is fetched
+    if (jtag->state->stream.read)
+        pio_jtag_write_read_blocking(jtag, bsrc, bdst, len);
+    else
+        pio_jtag_write_blocking(jtag, bsrc, len);
 }
 
 static void init_pins(uint pin_tck, uint pin_tdi, uint pin_tdo, uint pin_tms, uint pin_rst, uint pin_trst)
 {
     #if !( BOARD_TYPE == BOARD_QMTECH_RP2040_DAUGHTERBOARD )
-    // emulate open drain with pull up and direction
-    gpio_pull_up(pin_rst);
-    gpio_clr_mask((1u << pin_tms) | (1u << pin_rst) | (1u << pin_trst));
-    gpio_init_mask((1u << pin_tms) | (1u << pin_rst) | (1u << pin_trst));
-    gpio_set_dir_masked( (1u << pin_tms) | (1u << pin_trst), 0xffffffffu);
-    gpio_set_dir(pin_rst, false);
+    // RST and TRST are 255 on chains without them
+    uint32_t rst_mask = (pin_rst != 255) ? 1u << pin_rst : 0;
+    uint32_t trst_mask = (pin_trst != 255) ? 1u << pin_trst : 0;
+    gpio_clr_mask((1u << pin_tms) | rst_mask | trst_mask);
+    gpio_init_mask((1u << pin_tms) | rst_mask | trst_mask);
+    gpio_set_dir_masked( (1u << pin_tms) | trst_mask, 0xffffffffu);
+    if (rst_mask)
+    {
+        // emulate open drain with pull up and direction
+        gpio_pull_up(pin_rst);
+        gpio_set_dir(pin_rst, false);
+    }
     #else
     gpio_clr_mask((1u << pin_tms));
     gpio_init_mask((1u << pin_tms));
@@ -283,8 +564,27 @@ static void init_pins(uint pin_tck, uint pin_tdi, uint pin_tdo, uint pin_tms, ui
     gpio_set_dir(pin_tdo, false);
 }
 
+// Both state machines to djtag_rtck or back to djtag_tdo
+static void set_rtck(const pio_jtag_inst_t *jtag, bool enable)
+{
+    if (enable == jtag->state->rtck)
+        return;
+    jtag_sync(jtag);
+    uint offset = enable ? jtag->state->rtck_offset : tdo_offsets[pio_get_index(jtag->pio)];
+    pio_jtag_set_program(jtag->pio, jtag->sm, offset, enable);
+    pio_jtag_set_program(jtag->pio, jtag->sm_tms, offset, enable);
+    jtag->state->rtck = enable;
+}
+
 void init_jtag(pio_jtag_inst_t* jtag, uint freq, uint pin_tck, uint pin_tdi, uint pin_tdo, uint pin_tms, uint pin_rst, uint pin_trst)
 {
+    uint pio_index = pio_get_index(jtag->pio);
+
+    assert(chain_count < JTAG_CHAIN_MAX);
+    jtag->state = &chain_states[chain_count++];
+#ifdef DMA
+    jtag->state->tx_dma_chan = -1;
+#endif
     init_pins(pin_tck, pin_tdi, pin_tdo, pin_tms, pin_rst, pin_trst);
     jtag->pin_tdi = pin_tdi;
     jtag->pin_tdo = pin_tdo;
@@ -295,22 +595,107 @@ void init_jtag(pio_jtag_inst_t* jtag, uint freq, uint pin_tck, uint pin_tdi, uin
     jtag->pin_trst = pin_trst;
     #endif
     uint16_t clkdiv = 31;  // around 1 MHz @ 125MHz clk_sys
+    if (!(tdo_loaded & (1u << pio_index)))
+    {
+        tdo_offsets[pio_index] = pio_jtag_add(jtag->pio);
+        tdo_loaded |= 1u << pio_index;
+    }
     pio_jtag_init(jtag->pio, jtag->sm,
+                    tdo_offsets[pio_index],
                     clkdiv,
                     pin_tck,
                     pin_tdi,
                     pin_tdo
                  );
+    pio_jtag_tms_init(jtag->pio, jtag->sm_tms, tdo_offsets[pio_index], clkdiv, pin_tck, pin_tms, pin_tdo);
+    if (jtag->pin_rtck != 255)
+        jtag->state->rtck_offset = pio_jtag_rtck_add(jtag->pio, jtag->pin_rtck);
 
     jtag_set_clk_freq(jtag, freq);
 }
 
-void jtag_set_clk_freq(const pio_jtag_inst_t *jtag, uint freq_khz) {
-    uint clk_sys_freq_khz = clock_get_hz(clk_sys) / 1000;
-    float divf = (float)clk_sys_freq_khz / (freq_khz * 4);
-    uint16_t divider = (divf > (int)divf) ? (int)divf + 1 : (int)divf;
-    divider = (divider < 2) ? 2 : divider; //max reliable freq 
-    pio_sm_set_clkdiv_int_frac(pio0, jtag->sm, divider, 0);
+// Divider of the state machines in 1/256, 4 cycles per TCK
+#define DIVIDER_MIN (2 * 256) // max reliable freq
+#define DIVIDER_MAX (0xFFFF * 256 + 0xFF)
+
+// TCK setting found so far by jtag_set_clk_freq()
+typedef struct {
+    uint32_t tck_hz;    // asked for
+    sys_pll pll;        // vco_hz 0 for the current clk_sys
+    uint32_t divider;
+    uint32_t best_hz;
+} tck_search;
+
+// Smallest divider not giving more than tck_hz
+static uint32_t tck_divider(uint32_t sys_hz, uint32_t tck_hz)
+{
+    uint64_t divider = tck_hz ? ((uint64_t)sys_hz * 256 + 4 * (uint64_t)tck_hz - 1) / (4 * (uint64_t)tck_hz) : DIVIDER_MAX;
+    return MIN(MAX(divider, DIVIDER_MIN), DIVIDER_MAX);
+}
+
+static uint32_t tck_hz(uint32_t sys_hz, uint32_t divider)
+{
+    return (uint32_t)((uint64_t)sys_hz * 256 / (4 * (uint64_t)divider));
+}
+
+// Keeps the clk_sys giving the closest TCK, a whole divider (no jitter) when they are as close
+static void tck_consider(const sys_pll *pll, void *context)
+{
+    tck_search *search = context;
+    uint32_t sys_hz = pll->vco_hz / (pll->post_div1 * pll->post_div2);
+    uint32_t divider = tck_divider(sys_hz, search->tck_hz);
+    uint32_t hz = tck_hz(sys_hz, divider);
+
+    if (hz > search->tck_hz)
+        return;
+    if ((hz > search->best_hz) || ((hz == search->best_hz) && (search->divider & 0xFF) && !(divider & 0xFF)))
+    {
+        search->pll = *pll;
+        search->divider = divider;
+        search->best_hz = hz;
+    }
+}
+
+uint32_t jtag_set_clk_freq(const pio_jtag_inst_t *jtag, uint freq_khz) {
+    tck_search search = { .tck_hz = freq_khz * 1000 };
+    uint32_t sys_hz = clock_get_hz(clk_sys);
+
+    jtag_sync(jtag);
+    jtag->state->tck_khz = freq_khz;
+    // adaptive clocking, as fast as the state machines go, the target sets the pace
+    set_rtck(jtag, (freq_khz == 0) && (jtag->pin_rtck != 255));
+    if (jtag->state->rtck)
+    {
+        pio_sm_set_clkdiv_int_frac(jtag->pio, jtag->sm, 1, 0);
+        pio_sm_set_clkdiv_int_frac(jtag->pio, jtag->sm_tms, 1, 0);
+        return 0;
+    }
+    // the current clk_sys first, kept unless another one does better
+    search.divider = tck_divider(sys_hz, search.tck_hz);
+    search.best_hz = tck_hz(sys_hz, search.divider);
+    // moving clk_sys would change the TCK of the other chains
+    if (chain_count == 1)
+        sys_clock_each(tck_consider, &search);
+    if (search.pll.vco_hz)
+        sys_clock_set(&search.pll);
+    pio_sm_set_clkdiv_int_frac(jtag->pio, jtag->sm, search.divider >> 8, search.divider & 0xFF);
+    pio_sm_set_clkdiv_int_frac(jtag->pio, jtag->sm_tms, search.divider >> 8, search.divider & 0xFF);
+    return search.best_hz;
+}
+
+uint jtag_get_clk_freq(const pio_jtag_inst_t *jtag)
+{
+    return jtag->state->tck_khz;
+}
+
+void jtag_set_bit_order(const pio_jtag_inst_t *jtag, bool lsb)
+{
+    if (lsb != jtag->state->lsb_first)
+    {
+        jtag_sync(jtag);
+        pio_jtag_set_shift_right(jtag->pio, jtag->sm, lsb);
+        jtag->state->lsb_first = lsb;
+    }
 }
 
 void jtag_transfer(const pio_jtag_inst_t *jtag, uint32_t length, const uint8_t* in, uint8_t* out)
@@ -325,6 +710,19 @@ void jtag_transfer(const pio_jtag_inst_t *jtag, uint32_t length, const uint8_t*
 
 }
 
+void jtag_transfer_begin(const pio_jtag_inst_t *jtag, uint32_t length, bool read)
+{
+    /* set tms to low */
+    jtag_set_tms(jtag, false);
+
+    pio_jtag_stream_begin(jtag, length, read);
+}
+
+void jtag_transfer_continue(const pio_jtag_inst_t *jtag, const uint8_t* in, uint8_t* out, uint32_t byte_count)
+{
+    pio_jtag_stream(jtag, in, out, byte_count);
+}
+
 uint8_t jtag_strobe(const pio_jtag_inst_t *jtag, uint32_t length, bool tms, bool tdi)
 {
     if (length == 0)
@@ -335,12 +733,19 @@ uint8_t jtag_strobe(const pio_jtag_inst_t *jtag, uint32_t length, bool tms, bool
 
 
 
+void jtag_tms_sequence(const pio_jtag_inst_t *jtag, uint32_t length, const uint8_t* tms, bool tdi, uint8_t* out)
+{
+    if (length != 0)
+        pio_jtag_write_tms_sequence_blocking(jtag, tms, out, tdi, length);
+}
+
 static uint8_t toggle_bits_out_buffer[4];
 static uint8_t toggle_bits_in_buffer[4];
 
 void jtag_set_tdi(const pio_jtag_inst_t *jtag, bool value)
 {
-    toggle_bits_out_buffer[0] = value ? 1u << 7 : 0;
+    // the one bit shifted is bit 7 MSB first and bit 0 LSB first, set them all
+    toggle_bits_out_buffer[0] = value ? 0xFF : 0;
 }
 
 void jtag_set_clk(const pio_jtag_inst_t *jtag, bool value)
@@ -353,7 +758,8 @@ void jtag_set_clk(const pio_jtag_inst_t *jtag, bool value)
 
 bool jtag_get_tdo(const pio_jtag_inst_t *jtag)
 {
-    return last_tdo;
+    jtag_sync(jtag);
+    return jtag->state->last_tdo;
 }
 
 
@@ -28,45 +28,94 @@
 
 #include "hardware/pio.h"
 
+// Chains the probe can drive, each on two state machines of its own
+#define JTAG_CHAIN_MAX 4
+
+typedef struct pio_jtag_state pio_jtag_state; // private to pio_jtag.c
+
 typedef struct pio_jtag_inst {
     PIO pio;
     uint sm;
+    uint sm_tms; // shifts TMS sequences, see pio_jtag_tms_init()
     uint pin_tdi;
     uint pin_tdo;
     uint pin_tck;
     uint pin_tms;
     uint pin_rst;
     uint pin_trst;
+    uint pin_rtck; // adaptive clocking input, 255 for none, set before init_jtag()
+    pio_jtag_state *state; // set by init_jtag()
 } pio_jtag_inst_t;
 
 
 void init_jtag(pio_jtag_inst_t* jtag, uint freq, uint pin_tck, uint pin_tdi, uint pin_tdo, uint pin_tms, uint pin_rst, uint pin_trst);
 
+// Without TDO read back, a shift ending with whole 32 bit words is left finishing on its own once
+// its data is in the TX FIFO, until the chain is used again (see jtag_sync).
 void pio_jtag_write_blocking(const pio_jtag_inst_t *jtag, const uint8_t *src, size_t len);
 
 void pio_jtag_write_read_blocking(const pio_jtag_inst_t *jtag, const uint8_t *src, uint8_t *dst, size_t len);
 
 uint8_t pio_jtag_write_tms_blocking(const pio_jtag_inst_t *jtag, bool tdi, bool tms, size_t len);
 
-void jtag_set_clk_freq(const pio_jtag_inst_t *jtag, uint freq_khz);
+// Shifts len TMS bits from tms, MSB first, with TDI held at tdi. dst, if not NULL, receives TDO like
+// for pio_jtag_write_read_blocking. TMS is left at the last bit of the sequence.
+void pio_jtag_write_tms_sequence_blocking(const pio_jtag_inst_t *jtag, const uint8_t *tms, uint8_t *dst, bool tdi, size_t len);
+
+// Shift of len bits whose data is given in pieces, TCK pauses between pieces but TMS stays put.
+// pio_jtag_stream must be called until len bits are given, with dst NULL if read is false.
+void pio_jtag_stream_begin(const pio_jtag_inst_t *jtag, uint32_t len, bool read);
+
+void pio_jtag_stream(const pio_jtag_inst_t *jtag, const uint8_t *src, uint8_t *dst, size_t byte_count);
+
+// Sets the fastest TCK not above freq_khz, with a fractional PIO divider or by moving clk_sys
+// within its profile (see SYS_CLK_MAX_MHZ) when it is the only chain, whichever comes closer.
+// Returns the TCK in Hz.
+// 0 kHz selects adaptive clocking when there is an RTCK pin: each TCK edge waits for the target
+// to return the previous one, 0 is returned then.
+uint32_t jtag_set_clk_freq(const pio_jtag_inst_t *jtag, uint freq_khz);
+
+// Last freq_khz given to jtag_set_clk_freq
+uint jtag_get_clk_freq(const pio_jtag_inst_t *jtag);
+
+// Bit order of the following transfers: MSB first (the default) or LSB first in each byte,
+// the first bit of a partial last byte being bit 7 or bit 0. It stays set for every shift but
+// the TMS sequences, jtag_strobe and jtag_set_clk put TDI in every bit so it does not matter to them.
+void jtag_set_bit_order(const pio_jtag_inst_t *jtag, bool lsb_first);
 
 void jtag_transfer(const pio_jtag_inst_t *jtag, uint32_t length, const uint8_t* in, uint8_t* out);
 
+// jtag_transfer for data that does not fit in memory: after jtag_transfer_begin, successive
+// jtag_transfer_continue calls give the data byte_count bytes at a time, until length bits are given.
+void jtag_transfer_begin(const pio_jtag_inst_t *jtag, uint32_t length, bool read);
+
+void jtag_transfer_continue(const pio_jtag_inst_t *jtag, const uint8_t* in, uint8_t* out, uint32_t byte_count);
+
 uint8_t jtag_strobe(const pio_jtag_inst_t *jtag, uint32_t length, bool tms, bool tdi);
 
+void jtag_tms_sequence(const pio_jtag_inst_t *jtag, uint32_t length, const uint8_t* tms, bool tdi, uint8_t* out);
+
+// Waits for the shift the chain has left finishing, if any. Everything touching the chain's
+// state machines, pins or TDO calls it first, so other chains work while it completes.
+void jtag_sync(const pio_jtag_inst_t *jtag);
 
 static inline void jtag_set_tms(const pio_jtag_inst_t *jtag, bool value)
 {
+    jtag_sync(jtag);
     gpio_put(jtag->pin_tms, value);
 }
 static inline void jtag_set_rst(const pio_jtag_inst_t *jtag, bool value)
 {
     /* Change the direction to out to drive pin to 0 or to in to emulate open drain */
-    gpio_set_dir(jtag->pin_rst, !value);
+    jtag_sync(jtag);
+    if (jtag->pin_rst != 255)
+        gpio_set_dir(jtag->pin_rst, !value);
 }
 static inline void jtag_set_trst(const pio_jtag_inst_t *jtag, bool value)
 {
-    gpio_put(jtag->pin_trst, value);
+    jtag_sync(jtag);
+    if (jtag->pin_trst != 255)
+        gpio_put(jtag->pin_trst, value);
 }
 
 // The following APIs assume that they are called in the following order:
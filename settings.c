@@ -0,0 +1,79 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020-2022 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <pico/stdlib.h>
+#include <pico/flash.h>
+#include <hardware/flash.h>
+
+#include "settings.h"
+
+#define SETTINGS_MAGIC 0x4A544447u // "DJTG"
+#define SETTINGS_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t tck_khz;
+    uint16_t tck_khz_check; // ~tck_khz, an erased or half written sector has no valid settings
+} settings;
+
+static const settings *saved_settings(void)
+{
+    const settings *saved = (const settings *)(XIP_BASE + SETTINGS_OFFSET);
+    if ((saved->magic != SETTINGS_MAGIC) || (saved->tck_khz_check != (uint16_t)~saved->tck_khz))
+        return NULL;
+    return saved;
+}
+
+uint16_t settings_tck_khz(uint16_t default_khz)
+{
+    const settings *saved = saved_settings();
+    return saved ? saved->tck_khz : default_khz;
+}
+
+// Runs with the other core paused and the interrupts off
+static void settings_write(void *param)
+{
+    static uint8_t page[FLASH_PAGE_SIZE];
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, param, sizeof(settings));
+    flash_range_erase(SETTINGS_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(SETTINGS_OFFSET, page, sizeof(page));
+}
+
+bool settings_save_tck(uint16_t khz)
+{
+    settings new_settings = { .magic = SETTINGS_MAGIC, .tck_khz = khz, .tck_khz_check = ~khz };
+    const settings *saved = saved_settings();
+
+    if (saved && (saved->tck_khz == khz))
+        return true;
+    return (flash_safe_execute(settings_write, &new_settings, 100) == PICO_OK)
+        && (settings_tck_khz(0) == khz);
+}
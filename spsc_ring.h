@@ -0,0 +1,97 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _SPSC_RING_H
+#define _SPSC_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Single producer, single consumer ring of slots shared by the two cores.
+// The ring only manages the indices, the slots are an array of depth elements owned by the user:
+// the producer fills the slot at spsc_ring_head_slot() in place then publishes it with spsc_ring_push(),
+// the consumer uses the slot at spsc_ring_tail_slot() in place then gives it back with spsc_ring_pop().
+// head and tail run freely and are each written by one side only, so no lock is needed.
+typedef struct spsc_ring {
+    uint32_t head;       // written by the producer
+    uint32_t tail;       // written by the consumer
+    uint32_t mask;       // depth - 1, depth being a power of 2
+    uint32_t high_water; // most slots ever in use, written by the producer
+} spsc_ring;
+
+static inline void spsc_ring_init(spsc_ring *ring, uint32_t depth)
+{
+    ring->head = 0;
+    ring->tail = 0;
+    ring->mask = depth - 1;
+    ring->high_water = 0;
+}
+
+static inline uint32_t spsc_ring_count(const spsc_ring *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+// producer side
+
+static inline bool spsc_ring_full(const spsc_ring *ring)
+{
+    return (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) > ring->mask;
+}
+
+static inline uint32_t spsc_ring_head_slot(const spsc_ring *ring)
+{
+    return ring->head & ring->mask;
+}
+
+static inline void spsc_ring_push(spsc_ring *ring)
+{
+    uint32_t head = ring->head + 1;
+    uint32_t count = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (count > ring->high_water)
+        ring->high_water = count;
+    // the slot contents are visible before the new head
+    __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+}
+
+// consumer side
+
+static inline bool spsc_ring_empty(const spsc_ring *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail;
+}
+
+static inline uint32_t spsc_ring_tail_slot(const spsc_ring *ring)
+{
+    return ring->tail & ring->mask;
+}
+
+static inline void spsc_ring_pop(spsc_ring *ring)
+{
+    // the slot is not touched anymore once the producer sees the new tail
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+#endif
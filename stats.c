@@ -0,0 +1,70 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "stats.h"
+
+djtag_stats stats;
+
+static uint8_t *put_u64(uint8_t *out, uint64_t value)
+{
+    return put_u32(put_u32(out, value >> 32), (uint32_t)value);
+}
+
+static uint8_t *put_array(uint8_t *out, const uint32_t *values, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+        out = put_u32(out, values[i]);
+    return out;
+}
+
+void stats_encode(uint8_t *out)
+{
+    uint8_t *p = out;
+    *p++ = STATS_WORDS;
+    p = put_u64(p, stats.bits_shifted);
+    p = put_array(p, stats.commands, 16);
+    p = put_u32(p, stats.dma_shifts);
+    p = put_u32(p, stats.polled_shifts);
+    p = put_u64(p, stats.dma_wait_us);
+    p = put_u64(p, stats.response_wait_us);
+    p = put_u64(p, stats.packet_full_us);
+    p = put_u32(p, stats.usb_out_packets);
+    p = put_u32(p, stats.usb_out_bytes);
+    p = put_u32(p, stats.usb_in_packets);
+    p = put_u32(p, stats.usb_in_bytes);
+    p = put_array(p, stats.uart_rx_bytes, STATS_UARTS);
+    p = put_array(p, stats.uart_tx_bytes, STATS_UARTS);
+    p = put_array(p, stats.uart_overruns, STATS_UARTS);
+    assert(p == out + STATS_ENCODED_SIZE);
+    (void)p;
+}
+
+void stats_reset(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
@@ -0,0 +1,78 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+
+// UART bridges counted, the most CDC_INTF_COUNT may be
+#define STATS_UARTS 4
+
+// Counters of where the time and the data go on the probe, read and reset with CMD_STATS.
+// Each one is only written by one core, the first ones by core1, the others by core0: a
+// reset done by core1 may lose an increment core0 makes at the same time.
+typedef struct djtag_stats {
+    // core1
+    uint64_t bits_shifted;       // TCK cycles of the shifts, CMD_CLK strobes included
+    uint32_t commands[16];       // commands executed, by opcode
+    uint32_t dma_shifts;         // pio_jtag_write_* runs moved by DMA
+    uint32_t polled_shifts;      // and by polling the FIFOs
+    uint64_t dma_wait_us;        // core1 waiting for the DMA to complete
+    uint64_t response_wait_us;   // core1 waiting for a free response buffer
+    // core0
+    uint64_t packet_full_us;     // OUT data waiting with the packet queue to core1 full
+    uint32_t usb_out_packets;    // reads of the vendor RX FIFO, packets merged or split
+    uint32_t usb_out_bytes;
+    uint32_t usb_in_packets;     // IN transfers
+    uint32_t usb_in_bytes;
+    uint32_t uart_rx_bytes[STATS_UARTS];   // UART to USB, by CDC interface
+    uint32_t uart_tx_bytes[STATS_UARTS];   // USB to UART
+    uint32_t uart_overruns[STATS_UARTS];   // UART receive FIFO overruns
+} djtag_stats;
+
+extern djtag_stats stats;
+
+// What CMD_STATS answers: the number of 32 bit words, then the counters in the order of
+// djtag_stats, big endian, the 64 bit ones as two words, high word first
+#define STATS_WORDS 42
+#define STATS_ENCODED_SIZE (1 + 4 * STATS_WORDS)
+
+// Writes the counters to out, STATS_ENCODED_SIZE bytes
+void stats_encode(uint8_t *out);
+
+void stats_reset(void);
+
+// Writes value big endian, as the responses carry 32 bit values, returns the byte after it
+static inline uint8_t *put_u32(uint8_t *out, uint32_t value)
+{
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+    return out + 4;
+}
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020-2022 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * clk_sys, from the system PLL. Besides the boot setting, CMD_FREQ may move it
+ * within the profile of dirtyJtagConfig.h to the frequency giving the TCK
+ * asked for with a whole PIO divider.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <pico/stdlib.h>
+#include <hardware/clocks.h>
+#include <hardware/pll.h>
+
+#include "dirtyJtagConfig.h"
+#include "sys_clock.h"
+
+// clk_sys the SDK boots with
+#ifndef SYS_CLK_KHZ
+#define SYS_CLK_KHZ 125000
+#endif
+
+// Feedback divider limits of the PLL, the reference being the crystal
+#define PLL_FBDIV_MIN 16
+#define PLL_FBDIV_MAX 320
+
+// Keeps the first setting
+static void sys_clock_find(const sys_pll *pll, void *context)
+{
+    sys_pll *found = context;
+    if (!found->vco_hz)
+        *found = *pll;
+}
+
+static void sys_clock_range(uint32_t min_hz, uint32_t max_hz, void (*fn)(const sys_pll *pll, void *context), void *context)
+{
+    for (uint32_t fbdiv = PLL_FBDIV_MIN; fbdiv <= PLL_FBDIV_MAX; fbdiv++)
+    {
+        sys_pll pll = { .vco_hz = fbdiv * XOSC_HZ };
+        if ((pll.vco_hz < PICO_PLL_VCO_MIN_FREQ_HZ) || (pll.vco_hz > PICO_PLL_VCO_MAX_FREQ_HZ))
+            continue;
+        // post_div2 no larger than post_div1, as the SDK has it
+        for (pll.post_div1 = 1; pll.post_div1 <= 7; pll.post_div1++)
+        {
+            for (pll.post_div2 = 1; pll.post_div2 <= pll.post_div1; pll.post_div2++)
+            {
+                uint32_t hz = pll.vco_hz / (pll.post_div1 * pll.post_div2);
+                if ((hz >= min_hz) && (hz <= max_hz) && (pll.vco_hz % (pll.post_div1 * pll.post_div2) == 0))
+                    fn(&pll, context);
+            }
+        }
+    }
+}
+
+void sys_clock_init(void)
+{
+    sys_pll pll = { 0 };
+    sys_clock_range(SYS_CLK_MHZ * MHZ, SYS_CLK_MHZ * MHZ, sys_clock_find, &pll);
+    if (pll.vco_hz)
+        sys_clock_set(&pll);
+    // clk_peri follows clk_sys unless clk_sys may leave the boot setting, then the USB PLL
+    // keeps the UART baud rates
+    if (SYS_CLK_MAX_MHZ > SYS_CLK_MHZ || SYS_CLK_MHZ * 1000 != SYS_CLK_KHZ)
+        clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, 48 * MHZ, 48 * MHZ);
+}
+
+void sys_clock_each(void (*fn)(const sys_pll *pll, void *context), void *context)
+{
+    if (SYS_CLK_MAX_MHZ > SYS_CLK_MHZ)
+        sys_clock_range(SYS_CLK_MHZ * MHZ, SYS_CLK_MAX_MHZ * MHZ, fn, context);
+}
+
+uint32_t sys_clock_set(const sys_pll *pll)
+{
+    uint32_t hz = pll->vco_hz / (pll->post_div1 * pll->post_div2);
+    if (hz == clock_get_hz(clk_sys))
+        return hz;
+    // on the USB PLL while the system PLL locks, unlike set_sys_clock_pll() this leaves clk_peri alone
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                    CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, 48 * MHZ, 48 * MHZ);
+    pll_init(pll_sys, 1, pll->vco_hz, pll->post_div1, pll->post_div2);
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+                    CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS, hz, hz);
+    return hz;
+}
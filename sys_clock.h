@@ -0,0 +1,49 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020-2022 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _SYS_CLOCK_H
+#define _SYS_CLOCK_H
+
+#include <stdint.h>
+
+// Settings of the system PLL, clk_sys being vco_hz / (post_div1 * post_div2)
+typedef struct {
+    uint32_t vco_hz;
+    uint8_t post_div1;
+    uint8_t post_div2;
+} sys_pll;
+
+// Sets clk_sys to SYS_CLK_MHZ, and clk_peri to the 48 MHz of the USB PLL so that the UART
+// baud rates do not move with clk_sys. To be called before the UARTs are set up.
+void sys_clock_init(void);
+
+// Calls fn with each setting of the system PLL giving a clk_sys from SYS_CLK_MHZ to
+// SYS_CLK_MAX_MHZ, none when they are the same
+void sys_clock_each(void (*fn)(const sys_pll *pll, void *context), void *context);
+
+// Switches clk_sys to the given settings, returns its frequency
+uint32_t sys_clock_set(const sys_pll *pll);
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020-2022 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * TCK tuning for CMD_FREQ: every instruction register is filled with ones,
+ * which is BYPASS, and pseudo-random patterns shifted through the data
+ * registers then come back delayed by one bit per device. The first speed
+ * with a bit error ends the sweep.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <pico/stdlib.h>
+
+#include "dirtyJtagConfig.h"
+#include "pio_jtag.h"
+#include "tck_tune.h"
+
+// Bits of a pattern, several patterns at each speed
+#define TUNE_BITS 1024
+#define TUNE_PASSES 4
+// Ones shifted into the instruction registers, enough for any chain we have seen
+#define TUNE_IR_BITS 1024
+// Most devices in the chain, bits of delay looked for
+#define TUNE_MAX_DEVICES 64
+
+static uint8_t pattern[TUNE_BITS / 8];
+static uint8_t tdo[TUNE_BITS / 8];
+
+static inline bool bit_at(const uint8_t *bits, uint32_t i)
+{
+    return bits[i / 8] & (0x80 >> (i % 8));
+}
+
+// Fills the pattern from a 32 bit Galois LFSR
+static void tune_pattern(uint32_t seed)
+{
+    uint32_t lfsr = seed;
+    for (uint32_t i = 0; i < sizeof(pattern); i++)
+    {
+        uint8_t byte = 0;
+        for (int b = 0; b < 8; b++)
+        {
+            lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xA3000000u);
+            byte = (byte << 1) | (lfsr & 1);
+        }
+        pattern[i] = byte;
+    }
+}
+
+// Whether TDO is the pattern delayed by delay bits, the first ones being what was in the chain
+static bool tune_match(uint32_t delay)
+{
+    for (uint32_t i = delay; i < TUNE_BITS; i++)
+    {
+        if (bit_at(tdo, i) != bit_at(pattern, i - delay))
+            return false;
+    }
+    return true;
+}
+
+// Shifts the patterns at the current speed, from Shift-DR
+static bool tune_pass(const pio_jtag_inst_t *jtag, uint32_t delay)
+{
+    for (uint32_t pass = 0; pass < TUNE_PASSES; pass++)
+    {
+        tune_pattern(0x1D872B41u * (pass + 1));
+        jtag_transfer(jtag, TUNE_BITS, pattern, tdo);
+        if (!tune_match(delay))
+            return false;
+    }
+    return true;
+}
+
+// From any state to Shift-DR with BYPASS in every device
+static void tune_bypass(const pio_jtag_inst_t *jtag)
+{
+    // Test-Logic-Reset, Run-Test/Idle, Select-DR-Scan, Select-IR-Scan, Capture-IR, Shift-IR
+    static const uint8_t to_shift_ir[] = { 0xFB, 0x00 };
+    // Exit1-IR, Update-IR, Select-DR-Scan, Capture-DR, Shift-DR
+    static const uint8_t to_shift_dr[] = { 0xE0 };
+
+    jtag_tms_sequence(jtag, 10, to_shift_ir, true, NULL);
+    jtag_strobe(jtag, TUNE_IR_BITS - 1, false, true);
+    jtag_tms_sequence(jtag, 5, to_shift_dr, true, NULL);
+}
+
+uint32_t tck_tune(const pio_jtag_inst_t *jtag, uint max_khz, uint32_t *clean_hz)
+{
+    // Exit1-DR, Update-DR, then Test-Logic-Reset
+    static const uint8_t to_reset[] = { 0xFE };
+    uint previous_khz = jtag_get_clk_freq(jtag);
+    uint32_t delay;
+    uint khz = TCK_TUNE_MIN_KHZ;
+    uint32_t hz = jtag_set_clk_freq(jtag, khz);
+
+    *clean_hz = 0;
+    jtag_set_bit_order(jtag, false);
+    tune_bypass(jtag);
+    // flush the chain, then look for the delay
+    tune_pattern(0x1D872B41u);
+    jtag_transfer(jtag, TUNE_BITS, pattern, tdo);
+    jtag_transfer(jtag, TUNE_BITS, pattern, tdo);
+    for (delay = 0; (delay <= TUNE_MAX_DEVICES) && !tune_match(delay); delay++)
+        ;
+    if ((delay > TUNE_MAX_DEVICES) || !tune_pass(jtag, delay))
+    {
+        jtag_tms_sequence(jtag, 7, to_reset, false, NULL);
+        jtag_set_clk_freq(jtag, previous_khz);
+        return 0;
+    }
+    *clean_hz = hz;
+    while (khz < max_khz)
+    {
+        khz = MIN(max_khz, khz + MAX(1, khz * TCK_TUNE_STEP / 100));
+        hz = jtag_set_clk_freq(jtag, khz);
+        // past the fastest TCK of the probe nothing changes
+        if (hz <= *clean_hz)
+            continue;
+        if (!tune_pass(jtag, delay))
+            break;
+        *clean_hz = hz;
+    }
+    jtag_set_clk_freq(jtag, TCK_TUNE_MIN_KHZ);
+    jtag_tms_sequence(jtag, 7, to_reset, false, NULL);
+    return jtag_set_clk_freq(jtag, MAX(1, (uint32_t)((uint64_t)*clean_hz * (100 - TCK_TUNE_MARGIN) / 100000)));
+}
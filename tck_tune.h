@@ -0,0 +1,39 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020-2022 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _TCK_TUNE_H
+#define _TCK_TUNE_H
+
+#include <stdint.h>
+#include "pio_jtag.h"
+
+// Finds the fastest TCK up to max_khz at which a pattern goes through the BYPASS registers of
+// the chain without a bit error, starting from TCK_TUNE_MIN_KHZ and TCK_TUNE_STEP percent
+// faster each time, then sets TCK TCK_TUNE_MARGIN percent below it. The TAP ends in
+// Test-Logic-Reset. Returns the TCK set in Hz and in clean_hz the fastest one without error,
+// both 0 when no BYPASS path is found at TCK_TUNE_MIN_KHZ, TCK being left as it was then.
+uint32_t tck_tune(const pio_jtag_inst_t *jtag, uint max_khz, uint32_t *clean_hz);
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#include <pico/time.h>
+
+#include "trace.h"
+#include "stats.h"
+
+#if (TRACE_RECORDS & (TRACE_RECORDS - 1)) || (TRACE_RECORDS > 32768)
+#error "TRACE_RECORDS must be a power of 2, 32768 at most"
+#endif
+
+bool trace_enabled;
+
+static trace_record ring[TRACE_RECORDS];
+static uint32_t head;      // records ever committed
+static uint32_t tail;      // oldest one kept
+static uint32_t unqueued;  // oldest one without queued_us
+static uint32_t dropped;   // overwritten since the last dump
+
+// The command in progress, committed to the ring by trace_record_end()
+static trace_record open;
+static bool open_valid;
+static uint32_t open_bits; // stats.bits_shifted when it started
+static uint32_t packet_received_us;
+
+static void clear(void)
+{
+    head = tail = unqueued = dropped = 0;
+}
+
+void trace_start(void)
+{
+    clear();
+    open_valid = false;
+    trace_enabled = true;
+}
+
+void trace_stop(void)
+{
+    trace_enabled = false;
+}
+
+void trace_packet(uint32_t received_us)
+{
+    packet_received_us = received_us;
+}
+
+void trace_record_begin(uint8_t cmd, uint8_t flags, uint8_t chain)
+{
+    open = (trace_record){
+        .cmd = cmd,
+        .flags = flags,
+        .chain = chain,
+        .received_us = packet_received_us,
+        .start_us = time_us_32(),
+    };
+    open_bits = (uint32_t)stats.bits_shifted;
+    open_valid = true;
+}
+
+void trace_record_shifted(uint32_t now_us)
+{
+    open.shifted_us = now_us;
+}
+
+void trace_record_end(void)
+{
+    // started with the trace off
+    if (!open_valid)
+        return;
+    open_valid = false;
+    open.bits = (uint32_t)stats.bits_shifted - open_bits;
+    if (!open.shifted_us)
+        open.shifted_us = time_us_32();
+    if (head - tail == TRACE_RECORDS)
+    {
+        if (unqueued == tail)
+            unqueued++;
+        tail++;
+        dropped++;
+    }
+    ring[head++ & (TRACE_RECORDS - 1)] = open;
+}
+
+void trace_record_queued(void)
+{
+    uint32_t now = time_us_32();
+    for (; unqueued != head; unqueued++)
+        ring[unqueued & (TRACE_RECORDS - 1)].queued_us = now;
+}
+
+void trace_dump(void (*write)(const uint8_t *data, uint32_t count))
+{
+    uint8_t buffer[TRACE_RECORD_SIZE];
+    uint32_t count = head - tail;
+
+    buffer[0] = count >> 8;
+    buffer[1] = count;
+    put_u32(buffer + 2, dropped);
+    write(buffer, TRACE_HEADER_SIZE);
+    for (uint32_t i = tail; i != head; i++)
+    {
+        const trace_record *r = &ring[i & (TRACE_RECORDS - 1)];
+        uint8_t *p = buffer;
+        *p++ = r->cmd;
+        *p++ = r->flags;
+        *p++ = r->chain;
+        *p++ = 0;
+        p = put_u32(p, r->bits);
+        p = put_u32(p, r->received_us);
+        p = put_u32(p, r->start_us);
+        p = put_u32(p, r->shifted_us);
+        put_u32(p, r->queued_us);
+        write(buffer, TRACE_RECORD_SIZE);
+    }
+    clear();
+    // nor is the dump itself recorded, like TRACE_ON
+    open_valid = false;
+}
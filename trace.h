@@ -0,0 +1,101 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2025 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Records kept by the trace ring, the oldest ones overwritten, a power of 2
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS 256
+#endif
+
+// One command as cmd_handle() executed it, times from the hardware timer in us
+typedef struct trace_record {
+    uint8_t cmd;          // command byte, modifiers included
+    uint8_t flags;        // TRACE_DATA
+    uint8_t chain;        // chain selected by CMD_CHAIN
+    uint32_t bits;        // TCK cycles it shifted
+    uint32_t received_us; // core0 read the OUT data completing it
+    uint32_t start_us;    // core1 started executing it
+    uint32_t shifted_us;  // its last DMA transfer completed, else its execution ended
+    uint32_t queued_us;   // the responses up to it were handed to the IN queue, 0 if not yet
+} trace_record;
+
+// cmd is the opcode of a CMD_LONGXFER, CMD_XSVF or macro definition whose data this is
+#define TRACE_DATA 0x01
+
+// What a dump answers: the number of records and the number overwritten since the last
+// dump, then the records oldest first, all big endian
+#define TRACE_HEADER_SIZE 6
+#define TRACE_RECORD_SIZE 24
+
+extern bool trace_enabled;
+
+// Empties the ring and starts recording
+void trace_start(void);
+void trace_stop(void);
+
+// Writes the ring out with write(), then empties it, the command dumping is not recorded
+void trace_dump(void (*write)(const uint8_t *data, uint32_t count));
+
+// Called by core1 before cmd_handle() with when core0 read the OUT data
+void trace_packet(uint32_t received_us);
+
+void trace_record_begin(uint8_t cmd, uint8_t flags, uint8_t chain);
+void trace_record_end(void);
+void trace_record_shifted(uint32_t now_us);
+void trace_record_queued(void);
+
+// Around each command executed, cheap while the trace is off
+static inline void trace_begin(uint8_t cmd, uint8_t flags, uint8_t chain)
+{
+    if (trace_enabled)
+        trace_record_begin(cmd, flags, chain);
+}
+
+static inline void trace_end(void)
+{
+    if (trace_enabled)
+        trace_record_end();
+}
+
+// A DMA transfer of the command completed
+static inline void trace_shifted(uint32_t now_us)
+{
+    if (trace_enabled)
+        trace_record_shifted(now_us);
+}
+
+// Responses handed to the IN queue
+static inline void trace_queued(void)
+{
+    if (trace_enabled)
+        trace_record_queued();
+}
+
+#endif
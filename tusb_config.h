@@ -67,19 +67,26 @@
 //------------- CLASS -------------//
 #define CFG_TUD_HID             0
 
-#define CFG_TUD_CDC CDC_UART_INTF_COUNT
+#define CFG_TUD_CDC CDC_INTF_COUNT
 #define CFG_TUD_MSC             0
 #define CFG_TUD_MIDI            0
 #define CFG_TUD_VENDOR          1
 
-#if ( CDC_UART_INTF_COUNT > 0 )
+#if ( CDC_INTF_COUNT > 0 )
 #define CFG_TUD_CDC_RX_BUFSIZE    256
 #define CFG_TUD_CDC_TX_BUFSIZE    256
 #endif
 
-#define CFG_TUD_VENDOR_RX_BUFSIZE 128
+// The FIFO can hold several packets: core0 keeps their lengths to take them one at a time, or in
+// stream mode (see cmd_handle) drains it PACKET_BUFFER_SIZE bytes at a time regardless of them.
+#define CFG_TUD_VENDOR_RX_BUFSIZE 512
+// The responses do not go through the TX FIFO, dirtyJtag.c hands its own buffers
+// to the IN endpoint (see tud_vendor_tx_cb)
 #define CFG_TUD_VENDOR_TX_BUFSIZE 64
 
+#define PROBE_OUT_EP_NUM 0x01
+#define PROBE_IN_EP_NUM  0x82
+
 #ifdef __cplusplus
  }
 #endif
@@ -65,29 +65,45 @@ uint8_t const * tud_descriptor_device_cb(void)
 enum
 {
   ITF_NUM_PROBE = 0,
-#if ( CDC_UART_INTF_COUNT > 0 )
+#if ( CDC_INTF_COUNT > 0 )
   ITF_NUM_CDC_1 = 1,
   ITF_NUM_CDC_1_DATA,
 #endif
-#if (CDC_UART_INTF_COUNT > 1)
+#if (CDC_INTF_COUNT > 1)
   ITF_NUM_CDC_2 = 3,
   ITF_NUM_CDC_2_DATA,
 #endif 
+#if (CDC_INTF_COUNT > 2)
+  ITF_NUM_CDC_3 = 5,
+  ITF_NUM_CDC_3_DATA,
+#endif
+#if (CDC_INTF_COUNT > 3)
+  ITF_NUM_CDC_4 = 7,
+  ITF_NUM_CDC_4_DATA,
+#endif
   ITF_NUM_TOTAL
 };
 
-#define PROBE_OUT_EP_NUM 0x01
-#define PROBE_IN_EP_NUM  0x82
-#if ( CDC_UART_INTF_COUNT > 0 )
+#if ( CDC_INTF_COUNT > 0 )
 #define CDC_NOTIF_EP1_NUM 0x83
 #define CDC_OUT_EP1_NUM   0x03
 #define CDC_IN_EP1_NUM    0x84
 #endif
-#if (CDC_UART_INTF_COUNT > 1)
+#if (CDC_INTF_COUNT > 1)
 #define CDC_NOTIF_EP2_NUM 0x85
 #define CDC_OUT_EP2_NUM   0x05
 #define CDC_IN_EP2_NUM    0x86
 #endif 
+#if (CDC_INTF_COUNT > 2)
+#define CDC_NOTIF_EP3_NUM 0x87
+#define CDC_OUT_EP3_NUM   0x07
+#define CDC_IN_EP3_NUM    0x88
+#endif
+#if (CDC_INTF_COUNT > 3)
+#define CDC_NOTIF_EP4_NUM 0x89
+#define CDC_OUT_EP4_NUM   0x09
+#define CDC_IN_EP4_NUM    0x8A
+#endif
 
 #define CONFIG_TOTAL_LEN  (TUD_CONFIG_DESC_LEN + TUD_VENDOR_DESC_LEN + (TUD_CDC_DESC_LEN * (CFG_TUD_CDC)))
 
@@ -98,13 +114,19 @@ uint8_t const desc_configuration[CONFIG_TOTAL_LEN] =
 
   // Interface 2 : Interface number, string index, EP Out & IN address, EP size
   TUD_VENDOR_DESCRIPTOR(ITF_NUM_PROBE, 0, PROBE_OUT_EP_NUM, PROBE_IN_EP_NUM, 64),
-#if ( CDC_UART_INTF_COUNT > 0 )
+#if ( CDC_INTF_COUNT > 0 )
   // Interface 3 : Interface number, string index, EP notification address and size, EP data address (out, in) and size.
   TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_1, 4, CDC_NOTIF_EP1_NUM, 8, CDC_OUT_EP1_NUM, CDC_IN_EP1_NUM, 64),
 #endif
-#if ( CDC_UART_INTF_COUNT > 1 )
+#if ( CDC_INTF_COUNT > 1 )
   TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_2, 5, CDC_NOTIF_EP2_NUM, 8, CDC_OUT_EP2_NUM, CDC_IN_EP2_NUM, 64),
 #endif
+#if ( CDC_INTF_COUNT > 2 )
+  TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_3, 6, CDC_NOTIF_EP3_NUM, 8, CDC_OUT_EP3_NUM, CDC_IN_EP3_NUM, 64),
+#endif
+#if ( CDC_INTF_COUNT > 3 )
+  TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_4, 7, CDC_NOTIF_EP4_NUM, 8, CDC_OUT_EP4_NUM, CDC_IN_EP4_NUM, 64),
+#endif
 };
 
 // Invoked when received GET CONFIGURATION DESCRIPTOR
@@ -127,11 +149,17 @@ char const *string_desc_arr[] =
     "Jean THOMAS",              // 1: Manufacturer
     "DirtyJTAG",                // 2: Product
     usb_serial,                 // 3: Serial, uses flash unique ID
-#if ( CDC_UART_INTF_COUNT > 0 )
+#if ( CDC_INTF_COUNT > 0 )
     "DirtyJTAG CDC 0", // 4: CDC Interface 0
 #endif
-#if ( CDC_UART_INTF_COUNT > 1 )
-    "DirtyJTAG CDC 1"  // 5: CDC Interface 1
+#if ( CDC_INTF_COUNT > 1 )
+    "DirtyJTAG CDC 1", // 5: CDC Interface 1
+#endif
+#if ( CDC_INTF_COUNT > 2 )
+    "DirtyJTAG CDC 2", // 6: CDC Interface 2
+#endif
+#if ( CDC_INTF_COUNT > 3 )
+    "DirtyJTAG CDC 3", // 7: CDC Interface 3
 #endif
 };
 
@@ -0,0 +1,532 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020-2022 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+/*
+ * XSVF player (Xilinx XAPP503) for CMD_XSVF. The stream is played as it comes
+ * in, each instruction once it is whole, so that an XSDRTDO and its retries
+ * run at the probe instead of a USB round trip each.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <pico/stdlib.h>
+
+#include "dirtyJtagConfig.h"
+#include "pio_jtag.h"
+#include "xsvf.h"
+
+enum xsvf_instruction {
+    XCOMPLETE = 0x00,
+    XTDOMASK = 0x01,
+    XSIR = 0x02,
+    XSDR = 0x03,
+    XRUNTEST = 0x04,
+    XREPEAT = 0x07,
+    XSDRSIZE = 0x08,
+    XSDRTDO = 0x09,
+    XSETSDRMASKS = 0x0A,
+    XSDRINC = 0x0B,
+    XSDRB = 0x0C,
+    XSDRC = 0x0D,
+    XSDRE = 0x0E,
+    XSDRTDOB = 0x0F,
+    XSDRTDOC = 0x10,
+    XSDRTDOE = 0x11,
+    XSTATE = 0x12,
+    XENDIR = 0x13,
+    XENDDR = 0x14,
+    XSIR2 = 0x15,
+    XCOMMENT = 0x16,
+    XWAIT = 0x17,
+};
+
+// TAP states as XSTATE and XWAIT number them, each IR state 7 after its DR state
+enum tap_state {
+    TAP_RESET,
+    TAP_IDLE,
+    TAP_DRSELECT,
+    TAP_DRCAPTURE,
+    TAP_DRSHIFT,
+    TAP_DREXIT1,
+    TAP_DRPAUSE,
+    TAP_DREXIT2,
+    TAP_DRUPDATE,
+    TAP_IRSELECT,
+    TAP_IRCAPTURE,
+    TAP_IRSHIFT,
+    TAP_IREXIT1,
+    TAP_IRPAUSE,
+    TAP_IREXIT2,
+    TAP_IRUPDATE,
+};
+#define TAP_IR_OFFSET (TAP_IRSELECT - TAP_DRSELECT)
+
+// TCK pulses between two looks at the time while waiting
+#define XSVF_WAIT_TCK 16
+
+static struct {
+    enum xsvf_status status;
+    bool done;          // XCOMPLETE or an error, the rest of the stream is ignored
+    bool comment;       // in the text of an XCOMMENT
+    uint32_t index;     // of the current instruction
+    uint32_t count;     // bytes of it in instruction
+    uint8_t state;      // of the TAP
+    uint32_t sdr_size;  // XSDRSIZE, in bits
+    uint32_t runtest;   // XRUNTEST, in us
+    uint8_t repeat;     // XREPEAT
+    uint8_t end_ir;     // XENDIR, as a TAP state
+    uint8_t end_dr;     // XENDDR, as a TAP state
+} xsvf;
+
+// The current instruction, its vectors as in the stream: big endian, the last bit shifted first
+static uint8_t instruction[1 + 2 * XSVF_VECTOR_SIZE];
+// Vectors in shift order, as jtag_transfer() takes them LSB first
+static uint8_t tdo_expected[XSVF_VECTOR_SIZE];
+static uint8_t tdo_mask[XSVF_VECTOR_SIZE];
+static uint8_t tdo[XSVF_VECTOR_SIZE];
+
+static inline uint32_t vector_bytes(uint32_t bits)
+{
+    return (bits + 7) / 8;
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Reverses the byte order of a vector of bits bits into shift order
+static void vector_to_shift_order(uint8_t *dst, const uint8_t *src, uint32_t bits)
+{
+    uint32_t n = vector_bytes(bits);
+    for (uint32_t i = 0; i < n / 2; i++)
+    {
+        uint8_t x = src[i];
+        dst[i] = src[n - 1 - i];
+        dst[n - 1 - i] = x;
+    }
+    if (n & 1)
+        dst[n / 2] = src[n / 2];
+}
+
+// Length of the instruction, or more than count when the bytes telling it are still to come
+static uint32_t xsvf_length(uint32_t count)
+{
+    uint32_t sdr_bytes = vector_bytes(xsvf.sdr_size);
+    switch (instruction[0])
+    {
+    case XTDOMASK:
+    case XSDR:
+    case XSDRB:
+    case XSDRC:
+    case XSDRE:
+        return 1 + sdr_bytes;
+    case XSDRTDO:
+    case XSDRTDOB:
+    case XSDRTDOC:
+    case XSDRTDOE:
+        return 1 + 2 * sdr_bytes;
+    case XSIR:
+        return (count < 2) ? 2 : 2 + vector_bytes(instruction[1]);
+    case XSIR2:
+        return (count < 3) ? 3 : 3 + vector_bytes((instruction[1] << 8) | instruction[2]);
+    case XRUNTEST:
+    case XSDRSIZE:
+        return 5;
+    case XREPEAT:
+    case XSTATE:
+    case XENDIR:
+    case XENDDR:
+        return 2;
+    case XWAIT:
+        return 7;
+    default:
+        return 1;
+    }
+}
+
+// Appends to tms, MSB first from bit n, the path of the TAP to target, returns the new bit count
+static uint32_t tap_path(uint8_t *tms, uint32_t n, uint8_t target)
+{
+    if (target == TAP_RESET)
+    {
+        // whatever the state
+        for (int i = 0; i < 5; i++, n++)
+            tms[n / 8] |= 0x80 >> (n % 8);
+        xsvf.state = TAP_RESET;
+        return n;
+    }
+    while (xsvf.state != target)
+    {
+        bool bit;
+        uint8_t state = xsvf.state;
+        // the DR and IR columns are walked alike
+        uint8_t offset = (state >= TAP_IRSELECT) ? TAP_IR_OFFSET : 0;
+        bool ir_target = target >= TAP_IRSELECT;
+        bool same_column = (target >= TAP_DRSELECT) && (ir_target == !!offset);
+        uint8_t column_target = target - offset;
+
+        switch (state - offset)
+        {
+        case TAP_RESET:
+            bit = 0;
+            state = TAP_IDLE;
+            break;
+        case TAP_IDLE:
+            bit = 1;
+            state = TAP_DRSELECT;
+            break;
+        case TAP_DRSELECT:
+            if (offset)
+            {
+                // Select-IR: on to Capture-IR, or back to Test-Logic-Reset for the rest
+                bit = !same_column;
+                state = bit ? TAP_RESET : TAP_IRCAPTURE;
+            }
+            else
+            {
+                bit = ir_target;
+                state = bit ? TAP_IRSELECT : TAP_DRCAPTURE;
+            }
+            break;
+        case TAP_DRCAPTURE:
+            bit = !(same_column && (column_target == TAP_DRSHIFT));
+            state = (bit ? TAP_DREXIT1 : TAP_DRSHIFT) + offset;
+            break;
+        case TAP_DRSHIFT:
+            bit = 1;
+            state = TAP_DREXIT1 + offset;
+            break;
+        case TAP_DREXIT1:
+            bit = !(same_column && ((column_target == TAP_DRPAUSE) || (column_target == TAP_DREXIT2) || (column_target == TAP_DRSHIFT)));
+            state = (bit ? TAP_DRUPDATE : TAP_DRPAUSE) + offset;
+            break;
+        case TAP_DRPAUSE:
+            bit = 1;
+            state = TAP_DREXIT2 + offset;
+            break;
+        case TAP_DREXIT2:
+            bit = !(same_column && (column_target == TAP_DRSHIFT));
+            state = (bit ? TAP_DRUPDATE : TAP_DRSHIFT) + offset;
+            break;
+        default: // Update-DR/IR
+            bit = (target != TAP_IDLE);
+            state = bit ? TAP_DRSELECT : TAP_IDLE;
+            break;
+        }
+        if (bit)
+            tms[n / 8] |= 0x80 >> (n % 8);
+        n++;
+        xsvf.state = state;
+    }
+    return n;
+}
+
+static void tap_goto(const pio_jtag_inst_t *jtag, uint8_t target)
+{
+    uint8_t tms[4] = { 0 };
+    uint32_t n = tap_path(tms, 0, target);
+    jtag_tms_sequence(jtag, n, tms, false, NULL);
+}
+
+// Stays us microseconds in the current state, clocking TCK but in Shift-DR/IR
+static void xsvf_wait(const pio_jtag_inst_t *jtag, uint32_t us)
+{
+    uint32_t start = time_us_32();
+    if ((xsvf.state == TAP_DRSHIFT) || (xsvf.state == TAP_IRSHIFT))
+    {
+        sleep_us(us);
+        return;
+    }
+    do
+    {
+        jtag_strobe(jtag, XSVF_WAIT_TCK, xsvf.state == TAP_RESET, false);
+    } while (time_us_32() - start < us);
+}
+
+// Shifts bits of tdi from Shift-DR/IR, TDO into out if not NULL. With exit, the last bit is shifted
+// on the way to Exit1 and the TAP goes on to next in the same TMS sequence.
+static void xsvf_shift(const pio_jtag_inst_t *jtag, const uint8_t *tdi, uint8_t *out, uint32_t bits, bool exit, uint8_t next)
+{
+    uint32_t last = bits - 1;
+    uint8_t tms[4] = { 0x80 };
+    uint8_t tms_tdo[4];
+
+    if (!bits)
+        return;
+    if (!exit)
+    {
+        jtag_transfer(jtag, bits, tdi, out);
+        return;
+    }
+    if (last)
+        jtag_transfer(jtag, last, tdi, out);
+    xsvf.state++;
+    jtag_tms_sequence(jtag, tap_path(tms, 1, next), tms, (tdi[last / 8] >> (last % 8)) & 1, tms_tdo);
+    if (out)
+    {
+        if (!(last % 8))
+            out[last / 8] = 0;
+        out[last / 8] |= (tms_tdo[0] >> 7) << (last % 8);
+    }
+}
+
+// Compares tdo with tdo_expected, under mask unless NULL
+static bool tdo_matches(uint32_t bits, const uint8_t *mask)
+{
+    uint32_t n = vector_bytes(bits);
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint8_t diff = (tdo[i] ^ tdo_expected[i]) & (mask ? mask[i] : 0xFF);
+        // the bits past the end of a partial last byte were not shifted
+        if ((i == n - 1) && (bits & 7))
+            diff &= 0xFF >> (8 - (bits & 7));
+        if (diff)
+            return false;
+    }
+    return true;
+}
+
+// XSDR and XSDRTDO: shift, check TDO, retry through Pause-DR up to XREPEAT times, as XAPP503 does
+static bool xsvf_sdr(const pio_jtag_inst_t *jtag, const uint8_t *tdi)
+{
+    uint32_t runtest = xsvf.runtest;
+    bool matches;
+
+    for (uint32_t attempt = 0; ; attempt++)
+    {
+        // a retry needs TDO before the TAP leaves Exit1-DR
+        bool retry_possible = runtest && (attempt < xsvf.repeat);
+        tap_goto(jtag, TAP_DRSHIFT);
+        xsvf_shift(jtag, tdi, tdo, xsvf.sdr_size, true, retry_possible ? TAP_DREXIT1 : xsvf.end_dr);
+        matches = tdo_matches(xsvf.sdr_size, tdo_mask);
+        if (retry_possible)
+        {
+            if (matches)
+            {
+                tap_goto(jtag, xsvf.end_dr);
+            }
+            else
+            {
+                tap_goto(jtag, TAP_DRPAUSE);
+                tap_goto(jtag, TAP_DRSHIFT);
+                runtest += runtest >> 2;
+            }
+        }
+        if (runtest)
+            xsvf_wait(jtag, runtest);
+        if (matches || !retry_possible)
+            return matches;
+    }
+}
+
+// Runs a whole instruction, false when it fails
+static bool xsvf_execute(const pio_jtag_inst_t *jtag)
+{
+    const uint8_t *args = &instruction[1];
+    uint32_t sdr_bytes = vector_bytes(xsvf.sdr_size);
+    uint8_t op = instruction[0];
+
+    switch (op)
+    {
+    case XCOMPLETE:
+        xsvf.done = true;
+        break;
+
+    case XTDOMASK:
+        vector_to_shift_order(tdo_mask, args, xsvf.sdr_size);
+        break;
+
+    case XSIR:
+    case XSIR2:
+    {
+        uint32_t bits = (op == XSIR) ? args[0] : ((args[0] << 8) | args[1]);
+        uint8_t *tdi = &instruction[(op == XSIR) ? 2 : 3];
+        vector_to_shift_order(tdi, tdi, bits);
+        tap_goto(jtag, TAP_IRSHIFT);
+        xsvf_shift(jtag, tdi, NULL, bits, true, xsvf.end_ir);
+        if (xsvf.runtest)
+            xsvf_wait(jtag, xsvf.runtest);
+        break;
+    }
+
+    case XSDRTDO:
+        vector_to_shift_order(tdo_expected, args + sdr_bytes, xsvf.sdr_size);
+        // fall through
+    case XSDR:
+    {
+        // XSDR compares with the expected value of the last XSDRTDO
+        uint8_t *tdi = &instruction[1];
+        vector_to_shift_order(tdi, tdi, xsvf.sdr_size);
+        if (!xsvf_sdr(jtag, tdi))
+        {
+            xsvf.status = XSVF_TDO_MISMATCH;
+            return false;
+        }
+        break;
+    }
+
+    case XSDRB:
+    case XSDRC:
+    case XSDRE:
+    case XSDRTDOB:
+    case XSDRTDOC:
+    case XSDRTDOE:
+    {
+        // shifts of a register in pieces: B enters Shift-DR, C stays there, E leaves it
+        bool check = op >= XSDRTDOB;
+        bool exit = (op == XSDRE) || (op == XSDRTDOE);
+        uint8_t *tdi = &instruction[1];
+        if (check)
+            vector_to_shift_order(tdo_expected, args + sdr_bytes, xsvf.sdr_size);
+        vector_to_shift_order(tdi, tdi, xsvf.sdr_size);
+        tap_goto(jtag, TAP_DRSHIFT);
+        xsvf_shift(jtag, tdi, check ? tdo : NULL, xsvf.sdr_size, exit, xsvf.end_dr);
+        // all the bits count, XTDOMASK is for XSDR and XSDRTDO
+        if (check && !tdo_matches(xsvf.sdr_size, NULL))
+        {
+            xsvf.status = XSVF_TDO_MISMATCH;
+            return false;
+        }
+        break;
+    }
+
+    case XRUNTEST:
+        xsvf.runtest = get_u32(args);
+        break;
+
+    case XREPEAT:
+        xsvf.repeat = args[0];
+        break;
+
+    case XSDRSIZE:
+        xsvf.sdr_size = get_u32(args);
+        if (vector_bytes(xsvf.sdr_size) > XSVF_VECTOR_SIZE)
+        {
+            xsvf.status = XSVF_TOO_LONG;
+            return false;
+        }
+        break;
+
+    case XSTATE:
+        tap_goto(jtag, args[0] & 0x0F);
+        break;
+
+    case XENDIR:
+        xsvf.end_ir = args[0] ? TAP_IRPAUSE : TAP_IDLE;
+        break;
+
+    case XENDDR:
+        xsvf.end_dr = args[0] ? TAP_DRPAUSE : TAP_IDLE;
+        break;
+
+    case XWAIT:
+        tap_goto(jtag, args[0] & 0x0F);
+        xsvf_wait(jtag, get_u32(args + 2));
+        tap_goto(jtag, args[1] & 0x0F);
+        break;
+
+    default:
+        xsvf.status = XSVF_UNSUPPORTED;
+        return false;
+    }
+    return true;
+}
+
+void xsvf_begin(const pio_jtag_inst_t *jtag)
+{
+    memset(&xsvf, 0, sizeof(xsvf));
+    xsvf.status = XSVF_TRUNCATED;
+    xsvf.end_ir = TAP_IDLE;
+    xsvf.end_dr = TAP_IDLE;
+    // nothing is checked before the first XTDOMASK
+    memset(tdo_mask, 0, sizeof(tdo_mask));
+    memset(tdo_expected, 0, sizeof(tdo_expected));
+    jtag_set_bit_order(jtag, true);
+    // the TAP state is not known before
+    tap_goto(jtag, TAP_RESET);
+}
+
+void xsvf_data(const pio_jtag_inst_t *jtag, const uint8_t *data, uint32_t count)
+{
+    const uint8_t *end = data + count;
+
+    while ((data < end) && !xsvf.done)
+    {
+        if (xsvf.comment)
+        {
+            // the text is not kept, only its end matters
+            if (!*data++)
+            {
+                xsvf.comment = false;
+                xsvf.index++;
+            }
+            continue;
+        }
+        if (!xsvf.count)
+        {
+            if (*data == XCOMMENT)
+            {
+                xsvf.comment = true;
+                data++;
+                continue;
+            }
+            instruction[xsvf.count++] = *data++;
+        }
+        uint32_t length = xsvf_length(xsvf.count);
+        if (length > sizeof(instruction))
+        {
+            xsvf.status = XSVF_TOO_LONG;
+            xsvf.done = true;
+            break;
+        }
+        uint32_t n = MIN((uint32_t)(end - data), length - xsvf.count);
+        memcpy(&instruction[xsvf.count], data, n);
+        xsvf.count += n;
+        data += n;
+        if (xsvf.count < xsvf_length(xsvf.count))
+            continue;
+        xsvf.count = 0;
+        if (!xsvf_execute(jtag))
+        {
+            xsvf.done = true;
+            break;
+        }
+        if (xsvf.done)
+        {
+            xsvf.status = XSVF_OK;
+            break;
+        }
+        xsvf.index++;
+    }
+}
+
+enum xsvf_status xsvf_end(uint32_t *index)
+{
+    *index = xsvf.index;
+    return xsvf.status;
+}
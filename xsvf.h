@@ -0,0 +1,51 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2020-2022 Patrick Dussud
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+
+#ifndef _XSVF_H
+#define _XSVF_H
+
+#include <stdint.h>
+#include "pio_jtag.h"
+
+// Outcome of an XSVF stream, the first byte of the CMD_XSVF answer
+enum xsvf_status {
+    XSVF_OK = 0,            // XCOMPLETE reached
+    XSVF_TDO_MISMATCH = 1,  // TDO differed from the expected value under XTDOMASK, after the XREPEAT retries
+    XSVF_UNSUPPORTED = 2,   // instruction unknown, or XSETSDRMASKS/XSDRINC
+    XSVF_TOO_LONG = 3,      // vector longer than XSVF_VECTOR_SIZE bytes
+    XSVF_TRUNCATED = 4,     // the stream ended before XCOMPLETE
+};
+
+// Starts playing an XSVF stream: resets the TAP and the XSVF registers
+void xsvf_begin(const pio_jtag_inst_t *jtag);
+
+// Plays the next count bytes of the stream, instructions may be split anywhere. Once an
+// instruction fails or XCOMPLETE is reached the rest is ignored.
+void xsvf_data(const pio_jtag_inst_t *jtag, const uint8_t *data, uint32_t count);
+
+// Ends the stream, returns its status and in index the instruction it stopped at, counted from 0
+enum xsvf_status xsvf_end(uint32_t *index);
+
+#endif